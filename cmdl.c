@@ -1,175 +1,608 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "common.h"
+#include "rcache.h"
+#include "relay.h"
+#include "rpslot.h"
+#include "sarena.h"
 #include "squeue.h"
+#include "tokenize.h"
 
-#define STRMEMCPY(dest, src) \
-    memcpy(dest, src, strlen(src) > sizeof(dest) ? sizeof(dest) : strlen(src)); 
+/**
+ * Affiche l'aide et quitte.
+ */
+void usage(void);
 
-void sighandler(int sig);
+/* Durée de validité par défaut d'un résultat mis en cache, en secondes */
+#define CACHE_TTL_DEFAULT 60
+
+/* Durée de validité maximale d'un résultat mis en cache, en secondes */
+#define CACHE_TTL_MAX 86400
+
+/**
+ * Construit la clé de cache de la commande cmd (voir struct request) : elle
+ * comprend l'utilisateur, le répertoire courant, la commande, puis le chemin,
+ * la date de modification et la taille de chacun des n fichiers d'entrée
+ * inputs. Un fichier absent est désigné par "-".
+ *
+ * @arg     keylen  Reçoit la longueur de la clé.
+ * @return          La clé.
+ */
+char *cachekey(const char *cmd, char *const inputs[], size_t n,
+        size_t *keylen);
+
+/**
+ * Recherche le résultat de la commande dans le cache des résultats du
+ * daemon. S'il est présent, sa sortie est écrite sur la sortie standard sans
+ * qu'aucune requête ne soit envoyée.
+ *
+ * @arg     code    Reçoit le code de retour du client (voir rpexit()).
+ * @return          0 si le résultat a été trouvé, -1 sinon.
+ */
+int rqcached(int *code);
+
+/**
+ * Alloue len octets dans la zone sa. Si la zone est pleine, les allocations
+ * des clients terminés sans les libérer sont récupérées avant un second essai.
+ *
+ * @arg     sa      La zone d'allocation du daemon.
+ * @arg     len     Le nombre d'octets à allouer.
+ * @return          Le décalage de l'allocation, -1 en cas d'échec.
+ */
+ssize_t rqalloc(SArena sa, size_t len);
+
+/**
+ * Envoie la commande cmd au daemon par la file partagée.
+ *
+ * La sortie de la commande est reçue par un tube nommé et transférée vers la
+ * sortie standard. La réponse du daemon est attendue dans un emplacement de
+ * réponse (voir rpslot.h) alloué avec la requête.
+ *
+ * @arg     cmd     La commande à exécuter.
+ * @arg     cmdlen  La longueur de la commande.
+ * @return          Le code de retour du client.
+ */
+int rqqueue(const char *cmd, size_t cmdlen);
+
+/**
+ * Envoie la commande cmd au daemon par DAEMON_SOCKET.
+ *
+ * L'entrée, la sortie et l'erreur standard du client accompagnent la
+ * requête : la commande les utilise directement. La fin de la commande est
+ * signalée par une struct reply reçue sur la connexion.
+ *
+ * @arg     cmd     La commande à exécuter.
+ * @arg     cmdlen  La longueur de la commande.
+ * @return          Le code de retour du client.
+ */
+int rqsocket(const char *cmd, size_t cmdlen);
+
+/**
+ * Renvoie le code de retour du client correspondant à la réponse rp du daemon
+ * (le code de retour de la commande, ou 128 plus le numéro du signal qui l'a
+ * terminée), après avoir affiché les ressources consommées si l'option
+ * --stats a été donnée (seul le statut pour un résultat trouvé dans le
+ * cache), puis le résultat de chaque étape d'un pipeline.
+ *
+ * @arg     rp      La réponse du daemon.
+ * @return          Le code de retour du client.
+ */
+int rpexit(const struct reply *rp);
+
+/* Indique si l'option --stats a été donnée */
+static bool g_stats;
+
+/* La classe de priorité donnée par l'option --priority */
+static uint32_t g_prio = RQ_PRIO_NORMAL;
+
+/* Le nom de client donné par l'option --tenant, vide si aucun */
+static char g_tenant[REQUEST_TENANT_MAX];
+
+/* La durée de validité donnée par l'option --cache, 0 si aucune */
+static uint32_t g_ttl;
+
+/* Indique si l'option --coalesce a été donnée */
+static bool g_coalesce;
+
+/* La clé de cache de la requête, vide sans --cache ni --coalesce */
+static const char *g_key = "";
+static size_t g_keylen;
+
+/* Les arguments de la commande, découpés par tk_split() */
+static char *g_args;
+static uint32_t *g_offs;
+static size_t g_argc;
+static size_t g_argslen;
+
+/* Indique si le résultat a été trouvé dans le cache */
+static bool g_cached;
+
+/* Noms des classes de priorité, dans l'ordre de enum rq_priority */
+static const char *prionames[] = { "high", "normal", "low" };
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: cmdl '<command>'\n");
+    static const struct option longopts[] = {
+        { "socket", no_argument, NULL, 's' },
+        { "stats", no_argument, NULL, 'S' },
+        { "priority", required_argument, NULL, 'p' },
+        { "tenant", required_argument, NULL, 't' },
+        { "cache", optional_argument, NULL, 'c' },
+        { "input", required_argument, NULL, 'i' },
+        { "coalesce", no_argument, NULL, 'C' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    /* Les options s'arrêtent à la commande (premier argument non-option) */
+    bool sock = false;
+    char *inputs[argc];
+    size_t ninputs = 0;
+    int c;
+    while ((c = getopt_long(argc, argv, "+shp:t:i:", longopts, NULL))
+            != -1) {
+        switch (c) {
+        case 's':
+            sock = true;
+            break;
+        case 'S':
+            g_stats = true;
+            break;
+        case 'p':
+            for (g_prio = 0; g_prio < RQ_PRIO_COUNT; g_prio++) {
+                if (strcmp(optarg, prionames[g_prio]) == 0) {
+                    break;
+                }
+            }
+            if (g_prio == RQ_PRIO_COUNT) {
+                usage();
+            }
+            break;
+        case 't':
+            if (*optarg == '\0' || strlen(optarg) >= REQUEST_TENANT_MAX) {
+                fprintf(stderr, "Error: tenant name must be 1 to %d bytes.\n",
+                        REQUEST_TENANT_MAX - 1);
+                exit(EXIT_FAILURE);
+            }
+            strcpy(g_tenant, optarg);
+            break;
+        case 'c':
+            g_ttl = CACHE_TTL_DEFAULT;
+            if (optarg != NULL) {
+                char *end;
+                long ttl = strtol(optarg, &end, 10);
+                if (*end != '\0' || ttl < 1 || ttl > CACHE_TTL_MAX) {
+                    fprintf(stderr, "Error: cache duration must be 1 to %d "
+                            "seconds.\n", CACHE_TTL_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                g_ttl = (uint32_t) ttl;
+            }
+            break;
+        case 'i':
+            inputs[ninputs++] = optarg;
+            break;
+        case 'C':
+            g_coalesce = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 || *argv[optind] == '\0'
+            || (ninputs > 0 && g_ttl == 0 && !g_coalesce)) {
+        usage();
+    }
+
+    size_t cmdlen = strlen(argv[optind]);
+    if (cmdlen > REQUEST_CMD_MAX) {
+        fprintf(stderr, "Error: command too long (%zu bytes max).\n",
+                (size_t) REQUEST_CMD_MAX);
         exit(EXIT_FAILURE);
     }
-    
-    /* Affecte la gestion de SIG_FAILURE et SIG_SUCCESS a sighandler() */
-    struct sigaction act;
-    act.sa_handler = sighandler;
-    act.sa_flags = 0;
-    if (sigfillset(&act.sa_mask) == -1) {
-        perror("sigfillset");
+
+    /* La commande est découpée une fois pour toutes : le daemon reçoit ses
+     * arguments prêts à être exécutés */
+    g_args = malloc(cmdlen + 1);
+    g_offs = malloc(TK_ARGC_MAX(cmdlen) * sizeof(*g_offs));
+    if (g_args == NULL || g_offs == NULL) {
+        perror("malloc");
         exit(EXIT_FAILURE);
     }
-    if (sigaction(SIG_FAILURE, &act, NULL) == -1) {
-        perror("sigaction");
+    ssize_t argslen = tk_split(argv[optind], g_args, g_offs, &g_argc);
+    if (argslen == -1) {
+        fprintf(stderr, "Error: unterminated quote or escape, or empty "
+                "pipeline stage in command.\n");
         exit(EXIT_FAILURE);
     }
-    if (sigaction(SIG_SUCCESS, &act, NULL) == -1) {
-        perror("sigaction");
+    if (g_argc == 0) {
+        usage();
+    }
+    if (tk_stages(g_offs, g_argc) > REQUEST_STAGES_MAX) {
+        fprintf(stderr, "Error: too many pipeline stages (%d max).\n",
+                REQUEST_STAGES_MAX);
         exit(EXIT_FAILURE);
     }
+    g_argslen = (size_t) argslen;
+
+    /* La clé désigne aussi les requêtes identiques à regrouper */
+    if (g_ttl != 0 || g_coalesce) {
+        g_key = cachekey(argv[optind], inputs, ninputs, &g_keylen);
+        if (g_keylen > REQUEST_KEY_MAX) {
+            fprintf(stderr, "Error: cache key too long (%zu bytes max).\n",
+                    (size_t) REQUEST_KEY_MAX);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Un résultat présent dans le cache est servi sans solliciter le
+     * daemon */
+    int code;
+    if (g_ttl != 0 && rqcached(&code) == 0) {
+        return code;
+    }
+
+    return sock ? rqsocket(argv[optind], cmdlen)
+                : rqqueue(argv[optind], cmdlen);
+}
+
+void usage(void) {
+    printf("Usage: cmdl [-s | --socket] [--stats] "
+            "[-p | --priority <high | normal | low>] "
+            "[-t | --tenant <name>] [--cache[=<seconds>]] [--coalesce] "
+            "[-i | --input <file>]... '<command>'\n");
+    exit(EXIT_FAILURE);
+}
 
-    /* Assure le passage de SIG_FAILURE */
-    sigset_t set;
-    if (sigemptyset(&set) == -1) {
-        perror("sigemptyset");
+char *cachekey(const char *cmd, char *const inputs[], size_t n,
+        size_t *keylen) {
+    char *key;
+    FILE *f = open_memstream(&key, keylen);
+    char *cwd = getcwd(NULL, 0);
+    if (f == NULL || cwd == NULL) {
+        perror("cachekey");
         exit(EXIT_FAILURE);
     }
-    if (sigaddset(&set, SIG_FAILURE) == -1) {
-        perror("sigaddset");
+
+    /* Chaque champ est terminé par '\0' : aucun ne peut déborder sur le
+     * suivant */
+    fprintf(f, "%u%c%s%c%s%c", (unsigned) getuid(), 0, cwd, 0, cmd, 0);
+    free(cwd);
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        if (stat(inputs[i], &st) == -1) {
+            fprintf(f, "%s%c-%c", inputs[i], 0, 0);
+        } else {
+            fprintf(f, "%s%c%lld.%09ld %lld%c", inputs[i], 0,
+                    (long long) st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+                    (long long) st.st_size, 0);
+        }
+    }
+
+    if (fclose(f) == EOF) {
+        perror("cachekey");
         exit(EXIT_FAILURE);
     }
-    if (sigprocmask(SIG_UNBLOCK, &set, NULL) == -1) {
-        perror("sigprocmask");
+    return key;
+}
+
+int rqcached(int *code) {
+    /* Le cache n'existe pas si le daemon est arrêté ou s'il est désactivé */
+    RCache rc = rc_open(SHM_CACHE, SHM_CACHE_ARENA);
+    if (rc == NULL) {
+        return -1;
+    }
+
+    int status;
+    char *out;
+    size_t outlen;
+    if (rc_lookup(rc, g_key, g_keylen, &status, &out, &outlen) == -1) {
+        return -1;
+    }
+
+    for (size_t done = 0; done < outlen; ) {
+        ssize_t r = write(STDOUT_FILENO, out + done, outlen - done);
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        done += (size_t) r;
+    }
+    free(out);
+
+    g_cached = true;
+    *code = rpexit(&(struct reply) { .status = status });
+    return 0;
+}
+
+int rqsocket(const char *cmd, size_t cmdlen) {
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        perror("socket");
         exit(EXIT_FAILURE);
     }
 
-    /* Bloque temporairement le passage de SIG_SUCCESS */
-    if (sigemptyset(&set) == -1) {
-        perror("sigemptyset");
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, DAEMON_SOCKET, sizeof(addr.sun_path) - 1);
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Error: failed to reach daemon.\n");
         exit(EXIT_FAILURE);
     }
-    if (sigaddset(&set, SIG_SUCCESS) == -1) {
-        perror("sigaddset");
+
+    /* L'en-tête et la commande partent en un seul message, accompagnés des
+     * descripteurs standard */
+    struct request hdr = {
+        .pid = getpid(),
+        .cmdlen = (uint32_t) cmdlen,
+        .argc = (uint32_t) g_argc,
+        .argslen = (uint32_t) g_argslen,
+        .pipelen = 0,
+        .prio = g_prio,
+        .uid = getuid(),
+        .keylen = (uint32_t) g_keylen,
+        .ttl = g_ttl,
+        .flags = g_coalesce ? RQ_COALESCE : 0
+    };
+    memcpy(hdr.tenant, g_tenant, REQUEST_TENANT_MAX);
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov[] = {
+        { &hdr, sizeof(hdr) },
+        { g_offs, g_argc * sizeof(*g_offs) },
+        { g_args, g_argslen },
+        { (char *) cmd, cmdlen },
+        { (char *) g_key, g_keylen }
+    };
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = sizeof(iov) / sizeof(*iov),
+        .msg_control = ctl.buf,
+        .msg_controllen = sizeof(ctl.buf)
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t r = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    if (r == -1) {
+        perror("sendmsg");
         exit(EXIT_FAILURE);
     }
-    if (sigprocmask(SIG_BLOCK, &set, NULL) == -1) {
-        perror("sigprocmask");
+
+    /* Une longue commande peut dépasser le tampon du socket : le reste de la
+     * requête est envoyé sans les descripteurs */
+    msg.msg_control = NULL;
+    msg.msg_controllen = 0;
+    while (1) {
+        while (msg.msg_iovlen > 0 && (size_t) r >= msg.msg_iov->iov_len) {
+            r -= (ssize_t) msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen == 0) {
+            break;
+        }
+        msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + r;
+        msg.msg_iov->iov_len -= (size_t) r;
+        r = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (r == -1) {
+            perror("sendmsg");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Attend la fin de la commande */
+    struct reply rp;
+    if (recv(sock, &rp, sizeof(rp), MSG_WAITALL) != (ssize_t) sizeof(rp)) {
+        fprintf(stderr, "Error: connection to daemon lost.\n");
         exit(EXIT_FAILURE);
     }
+    close(sock);
 
-    /* Création de la requête */
+    if (rp.aborted) {
+        fprintf(stderr, "Error: request aborted.\n");
+        return EXIT_FAILURE;
+    }
+    return rpexit(&rp);
+}
+
+ssize_t rqalloc(SArena sa, size_t len) {
+    ssize_t off = sa_alloc(sa, len);
+    if (off == -1 && sa_reclaim(sa) > 0) {
+        off = sa_alloc(sa, len);
+    }
+    return off;
+}
+
+int rqqueue(const char *cmd, size_t cmdlen) {
     pid_t pid = getpid();
     char pipe[PATH_MAX] = { 0 };
     snprintf(pipe, sizeof(pipe), "/tmp/cmdl_pipe_%d", pid);
+    size_t pipelen = strlen(pipe);
 
-    struct request rq;
-    STRMEMCPY(rq.cmd, argv[1]);
-    STRMEMCPY(rq.pipe, pipe);
-    rq.pid = pid;
-    
-    /* Ouvre la file et enfile la requête */
+    /* Ouvre la zone d'allocation et la file du daemon */
+    SArena sa = sa_open(SHM_ARENA);
     SQueue sq = sq_open(SHM_QUEUE);
-    if (sq == NULL) {
+    if (sa == NULL || sq == NULL) {
         fprintf(stderr, "Error: failed to reach daemon.\n");
         exit(EXIT_FAILURE);
     }
 
-    if (sq_enqueue(sq, &rq) == -1) {
-        fprintf(stderr, "Error: failed to enqueue.\n");
+    /* La requête et son emplacement de réponse sont construits directement
+     * en mémoire partagée */
+    ssize_t rpoff = rqalloc(sa, sizeof(struct rpslot));
+    ssize_t off = rqalloc(sa, RQ_SIZE(g_argc, g_argslen, cmdlen, pipelen,
+                g_keylen));
+    if (off == -1 || rpoff == -1) {
+        fprintf(stderr, "Error: failed to allocate request.\n");
         exit(EXIT_FAILURE);
     }
 
-    /* Créé et ouvre le tube de communication */
+    struct rpslot *slot = sa_ptr(sa, (size_t) rpoff);
+    rs_init(slot);
+
+    struct request *rq = sa_ptr(sa, (size_t) off);
+    rq->pid = pid;
+    rq->cmdlen = (uint32_t) cmdlen;
+    rq->argc = (uint32_t) g_argc;
+    rq->argslen = (uint32_t) g_argslen;
+    rq->pipelen = (uint32_t) pipelen;
+    rq->prio = g_prio;
+    rq->uid = getuid();
+    rq->keylen = (uint32_t) g_keylen;
+    rq->ttl = g_ttl;
+    rq->flags = g_coalesce ? RQ_COALESCE : 0;
+    memcpy(rq->tenant, g_tenant, REQUEST_TENANT_MAX);
+    rq->reply = rpoff;
+    rq->replygen = sa_gen(sa, (size_t) rpoff);
+    memcpy(RQ_ARGV(rq), g_offs, g_argc * sizeof(*g_offs));
+    memcpy(RQ_ARGS(rq), g_args, g_argslen);
+    memcpy(RQ_CMD(rq), cmd, cmdlen + 1);
+    memcpy(RQ_PIPE(rq), pipe, pipelen + 1);
+    memcpy(RQ_KEY(rq), g_key, g_keylen);
+    RQ_KEY(rq)[g_keylen] = '\0';
+
+    /* Créé et ouvre le tube de communication avant d'enfiler la requête : le
+     * worker l'ouvre sans attendre, et le daemon peut y signaler l'abandon de
+     * la requête. L'ouverture non bloquante n'attend pas d'écrivain */
     if (mkfifo(pipe, S_IRUSR | S_IWUSR) == -1) {
         perror("mkfifo");
+        sa_free(sa, (size_t) off);
+        sa_free(sa, (size_t) rpoff);
         exit(EXIT_FAILURE);
     }
-
-    int fd = open(pipe, O_RDONLY);
+    int fd = open(pipe, O_RDONLY | O_NONBLOCK);
     if (fd == -1) {
         perror("open");
+        unlink(pipe);
+        sa_free(sa, (size_t) off);
+        sa_free(sa, (size_t) rpoff);
         exit(EXIT_FAILURE);
     }
 
-    if (unlink(pipe) == -1) {
-        perror("unlink");
+    /* Enfile le décalage de la requête, libérée par le daemon une fois
+     * défilée. Elle reste à la charge du client jusque là : si celui-ci est
+     * tué en attendant une place dans la file, elle est récupérée par
+     * sa_reclaim (voir struct rqref) */
+    struct rqref ref = {
+        .off = (uint64_t) off,
+        .gen = sa_gen(sa, (size_t) off)
+    };
+    if (sq_enqueue(sq, &ref) == -1) {
+        fprintf(stderr, "Error: failed to enqueue.\n");
+        sa_free(sa, (size_t) off);
+        sa_free(sa, (size_t) rpoff);
+        unlink(pipe);
         exit(EXIT_FAILURE);
     }
 
-    /* Lecture depuis le tube et écriture sur STDOUT */
-    struct stat st;
-    if (fstat(fd, &st) == -1) {
-        perror("fstat");
-        exit(EXIT_FAILURE);
+    /* Attend l'ouverture du tube par le worker (ou par le daemon en cas
+     * d'abandon) : POLLHUP n'est signalé qu'une fois un écrivain apparu */
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (poll(&pfd, 1, -1) == -1) {
+        if (errno != EINTR) {
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
     }
-    ssize_t blksize_in = st.st_blksize;
 
-    if (fstat(STDOUT_FILENO, &st) == -1) {
-        perror("fstat");
+    if (unlink(pipe) == -1) {
+        perror("unlink");
         exit(EXIT_FAILURE);
     }
-    ssize_t blksize_out = st.st_blksize;
-
-    char buf[blksize_in];
-    ssize_t r;
-    while ((r = read(fd, buf, (size_t) blksize_in)) > 0) {
-        char *buf_out = buf;
-        do {
-            ssize_t btw = r > blksize_out ? blksize_out : r;
-            if ((r = write(STDOUT_FILENO, buf_out, (size_t) btw)) == -1) {
-                perror("write");
-                exit(EXIT_FAILURE);
-            }
-            r -= btw;
-            buf_out += btw;
-        } while (r > 0);
-    }
-
-    /* Débloque le passage de SIG_SUCCESS */
-    if (sigprocmask(SIG_UNBLOCK, &set, NULL) == -1) {
-        perror("sigprocmask");
+    if (fcntl(fd, F_SETFL, 0) == -1) {
+        perror("fcntl");
         exit(EXIT_FAILURE);
     }
 
-    /* Place le processus en attente de SIG_SUCCESS */
-    if (sigfillset(&set) == -1) {
-        perror("sigfillset");
+    /* Transfère la sortie de la commande depuis le tube vers STDOUT, sans
+     * recopie en espace utilisateur lorsque STDOUT le permet */
+    if (rl_relay(fd, STDOUT_FILENO, RL_SPLICE, NULL) == -1) {
+        perror("relay");
         exit(EXIT_FAILURE);
     }
-    if (sigdelset(&set, SIG_FAILURE) == -1) {
-        perror("sigdelset");
-        exit(EXIT_FAILURE);
-    }
-    if (sigdelset(&set, SIG_SUCCESS) == -1) {
-        perror("sigdelset");
+
+    /* Attend la réponse du daemon, puis abandonne son emplacement */
+    struct reply rp;
+    if (rs_wait(slot, &rp) == -1) {
+        perror("rs_wait");
         exit(EXIT_FAILURE);
     }
-    sigsuspend(&set);
-    if (errno != EINTR) {
-        perror("sigsuspend");
-        exit(EXIT_FAILURE);
+    if (rs_release(slot, RS_CLIENT)) {
+        sa_free(sa, (size_t) rpoff);
     }
 
-    return EXIT_SUCCESS;
+    if (rp.aborted) {
+        fprintf(stderr, "Error: request aborted.\n");
+        return EXIT_FAILURE;
+    }
+    return rpexit(&rp);
 }
 
-void sighandler(int sig) {
-    if (sig == SIG_FAILURE) {
-        fprintf(stderr, "Error: request aborted.\n");
-        exit(EXIT_FAILURE);
+int rpexit(const struct reply *rp) {
+    int code = WIFSIGNALED(rp->status) ? 128 + WTERMSIG(rp->status)
+                                       : WEXITSTATUS(rp->status);
+    if (!g_stats) {
+        return code;
     }
-    if (sig == SIG_SUCCESS) {
-        exit(EXIT_SUCCESS);
+
+    if (WIFSIGNALED(rp->status)) {
+        fprintf(stderr, "status   killed by signal %d (%s)\n",
+                WTERMSIG(rp->status), strsignal(WTERMSIG(rp->status)));
+    } else {
+        fprintf(stderr, "status   exited with code %d\n", code);
     }
+    if (g_ttl != 0) {
+        fprintf(stderr, "cache    %s\n", g_cached ? "hit" : "miss");
+    }
+    if (g_cached) {
+        return code;
+    }
+    fprintf(stderr, "queue    %.3f ms\n", (double) rp->queue / 1e6);
+    fprintf(stderr, "wall     %.3f ms\n", (double) rp->wall / 1e6);
+    fprintf(stderr, "user     %.3f ms\n", (double) rp->utime / 1e6);
+    fprintf(stderr, "sys      %.3f ms\n", (double) rp->stime / 1e6);
+    fprintf(stderr, "maxrss   %" PRId64 " KiB\n", rp->maxrss);
+    fprintf(stderr, "ctxsw    %" PRId64 " voluntary, %" PRId64
+            " involuntary\n", rp->nvcsw, rp->nivcsw);
+
+    /* Les étapes d'un pipeline sont détaillées dans l'ordre de la commande */
+    for (uint32_t i = 0; rp->nstages > 1 && i < rp->nstages
+            && i < REQUEST_STAGES_MAX; i++) {
+        const struct stage *st = &rp->stages[i];
+        fprintf(stderr, "stage %-3" PRIu32, i + 1);
+        if (WIFSIGNALED(st->status)) {
+            fprintf(stderr, "killed by signal %d", WTERMSIG(st->status));
+        } else {
+            fprintf(stderr, "exited with code %d", WEXITSTATUS(st->status));
+        }
+        fprintf(stderr, ", start +%.3f ms, wall %.3f ms, user %.3f ms, "
+                "sys %.3f ms\n", (double) st->start / 1e6,
+                (double) st->wall / 1e6, (double) st->utime / 1e6,
+                (double) st->stime / 1e6);
+    }
+
+    return code;
 }
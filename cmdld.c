@@ -1,5 +1,8 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
@@ -9,21 +12,41 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "alog.h"
 #include "common.h"
 #include "config.h"
+#include "flight.h"
+#include "istack.h"
+#include "sarena.h"
+#include "jobsched.h"
+#include "metrics.h"
+#include "pcache.h"
+#include "rcache.h"
+#include "relay.h"
+#include "rpslot.h"
+#include "rthist.h"
+#include "spawner.h"
 #include "squeue.h"
+#include "tokenize.h"
+#include "zygote.h"
 
 /* --- DIVERS -------------------------------------------------------------- */
 
-/* Les deux options possibles sur la ligne de commande */
+/* Les options possibles sur la ligne de commande */
 #define OPT_START "start"
 #define OPT_STOP "stop"
+#define OPT_STATS "stats"
 #define opt_test(opt) strcmp(opt, argv[1]) == 0
 
 /* Le chemin vers le fichier de configuration du daemon */
@@ -57,19 +80,48 @@ void die(const char *format, ...);
  */
 #define died(msg, ...) die("(%s:%d) " msg, __FILE__, __LINE__, #__VA_ARGS__)
 
+/**
+ * Inscrit un message de niveau level dans les logs, mis en forme comme pour
+ * printf : au travers du journal asynchrone g_log une fois celui-ci lancé, et
+ * directement avec syslog auparavant (ou après son arrêt).
+ */
+#define dlog(level, ...) \
+    (g_log != NULL ? al_log(g_log, level, __VA_ARGS__) \
+                   : syslog(level, __VA_ARGS__))
+
 /**
  * Affiche l'aide et quitte.
  */
 void usage(void);
 
+/**
+ * Créé un thread exécutant fun(arg), tous ses signaux étant masqués.
+ *
+ * Seul le thread principal du daemon reçoit ainsi SIGTERM, ce qui permet à
+ * cleanup() d'annuler et d'attendre les autres threads.
+ *
+ * @arg     th      Le thread à créer.
+ * @arg     fun     La fonction de démarrage du thread.
+ * @arg     arg     L'argument passé à fun.
+ * @return          0 en cas de succès, un code d'erreur sinon.
+ */
+int thcreate(pthread_t *th, void *(*fun)(void *), void *arg);
+
 /* --- DAEMON -------------------------------------------------------------- */
 
 /* Nom associé au sémaphore qui assure l'unicité du daemon */
 #define DAEMON_RUN_MUTEX "/cmdld_run_mutex"
 
+/* Signal par lequel le daemon confirme son lancement au processus parent */
+#define SIG_SUCCESS SIGUSR2
+
 /* Nom associé au SHM pour stocker le PID du daemon */
 #define DAEMON_SHM_PID "/cmdld_shm_pid"
 
+/* Nombre de messages du journal en attente d'écriture, au-delà duquel les
+ * messages sont perdus */
+#define DAEMON_LOG_CAPACITY 4096
+
 /**
  * Lance le processus de daemonisation.
  *
@@ -99,9 +151,256 @@ int unlock(void);
 
 /**
  * Démarre le programme principal du daemon.
+ *
+ * Le thread principal reçoit les requêtes depuis la file partagée et les
+ * place dans la file d'attente du daemon, d'où le thread de répartition les
+ * confie aux workers libres. Les requêtes reçues par DAEMON_SOCKET le sont
+ * par le thread d'acceptation.
  */
 void maind(void);
 
+/* Délai maximal de réception d'une requête sur une connexion, en
+ * millisecondes */
+#define DAEMON_SOCKET_TIMEOUT 1000
+
+/**
+ * Fonction de démarrage du thread d'acceptation.
+ *
+ * Le thread accepte les connexions sur DAEMON_SOCKET, reçoit la requête et
+ * les descripteurs de chaque client avec rqreceive(), puis place le travail
+ * correspondant dans la file d'attente du daemon.
+ *
+ * @arg arg Inutilisé.
+ */
+void *acstart(void *arg);
+
+/**
+ * Reçoit une requête sur la connexion conn et initialise job en conséquence.
+ *
+ * @arg     conn    La connexion du client.
+ * @arg     job     Le travail à initialiser.
+ * @return          0 en cas de succès, -1 si la requête est invalide ou n'a
+ *                  pas pu être reçue.
+ */
+int rqreceive(int conn, struct job *job);
+
+/**
+ * Vérifie les champs de l'en-tête de requête hdr communs à DAEMON_SOCKET et à
+ * la file partagée : longueurs de la commande, des arguments, du nom du tube
+ * et de la clé, nombre d'arguments.
+ *
+ * @arg     hdr     L'en-tête reçu.
+ * @return          true si l'en-tête est valide, false sinon.
+ */
+bool rqhdrok(const struct request *hdr);
+
+/**
+ * Vérifie la requête rq de len octets avant de l'accepter : son en-tête (voir
+ * rqhdrok()), sa longueur, la terminaison de ses chaînes et ses arguments,
+ * exécutés tels quels par le worker, qui ne doivent désigner que des chaînes
+ * de la requête (tk_check()) et former au plus REQUEST_STAGES_MAX étapes.
+ *
+ * @arg     rq      La requête reçue.
+ * @arg     len     La longueur de la requête.
+ * @return          true si la requête est valide, false sinon.
+ */
+bool rqvalid(const struct request *rq, size_t len);
+
+/* Nombre maximal de requêtes défilées en une fois par maind() */
+#define DAEMON_BATCH_MAX 32
+
+/**
+ * Fonction de démarrage du thread de répartition.
+ *
+ * Le thread est réveillé par g_wakeup à chaque arrivée de requêtes et à chaque
+ * fois qu'un worker se libère, ou lorsque l'échéance d'une requête en attente
+ * est atteinte. Il appelle alors dispatch().
+ *
+ * @arg arg Inutilisé.
+ */
+void *dpstart(void *arg);
+
+/**
+ * Abandonne les requêtes en attente dont l'échéance est dépassée, puis confie
+ * les suivantes aux workers libres, dans la limite de ceux-ci. Si aucun worker
+ * n'est libre, un nouveau worker est lancé tant que DAEMON_WORKER_MAX n'est pas
+ * atteint.
+ */
+void dispatch(void);
+
+/**
+ * Lance un nouveau worker. Le worker n'est pas placé dans g_idle : il est
+ * destiné à recevoir aussitôt une requête.
+ *
+ * Le nombre de workers ne change qu'au sein du thread de répartition.
+ *
+ * @return  L'indice du worker lancé, -1 si DAEMON_WORKER_MAX est atteint ou
+ *          en cas d'erreur.
+ */
+ssize_t wkgrow(void);
+
+/**
+ * Arrête les workers excédentaires à la fin de chaque période de
+ * DAEMON_WORKER_IDLE millisecondes.
+ *
+ * Seuls sont arrêtés, dans la limite de DAEMON_WORKER_MIN, autant de workers
+ * qu'il en est resté libres en permanence pendant toute la période : un
+ * worker lancé ou occupé pendant celle-ci n'est arrêté qu'à la fin de la
+ * suivante, ce qui évite d'arrêter puis de relancer des workers au gré des
+ * fluctuations de la charge.
+ *
+ * @arg     now     L'instant présent.
+ */
+void wkshrink(const struct timespec *now);
+
+/* Période minimale entre deux rapports de pqreport(), en millisecondes */
+#define DAEMON_REPORT_PERIOD 60000
+
+/**
+ * Inscrit dans les logs, au plus une fois par DAEMON_REPORT_PERIOD et si des
+ * requêtes ont été retirées de g_sched depuis le précédent rapport, les
+ * centiles des durées d'attente des requêtes (voir pqlog()).
+ *
+ * @arg     now     L'instant présent.
+ */
+void pqreport(const struct timespec *now);
+
+/**
+ * Inscrit dans les logs les centiles des durées d'attente waits des requêtes
+ * de chaque classe de priorité, depuis le lancement du daemon.
+ */
+void pqlog(const struct histo waits[RQ_PRIO_COUNT]);
+
+/**
+ * Abandonne la requête du travail job : le client est prévenu avec rqreply()
+ * et le travail est libéré avec rqrelease().
+ *
+ * @arg     job     Le travail à abandonner.
+ * @arg     reason  La raison de l'abandon, inscrite dans les logs.
+ */
+void rqabort(struct job *job, const char *reason);
+
+/**
+ * Transmet la réponse rp au client du travail job.
+ *
+ * Si la requête provient de la file partagée, la réponse est publiée dans son
+ * emplacement de réponse, qui réveille le client, et le daemon abandonne sa
+ * part de l'emplacement. Si elle a été abandonnée,
+ * le tube du client est de plus ouvert puis refermé, afin que le client qui
+ * attend la sortie de la commande constate la fin de fichier. Sinon, la
+ * réponse est envoyée sur la connexion du client.
+ *
+ * @arg     job     Le travail terminé ou abandonné.
+ * @arg     rp      La réponse à transmettre.
+ */
+void rqreply(const struct job *job, const struct reply *rp);
+
+/**
+ * Publie la réponse rp dans l'emplacement de réponse de la requête rq, reçue
+ * par la file partagée, puis abandonne la part du daemon de l'emplacement.
+ *
+ * @arg     rq      La requête.
+ * @arg     rp      La réponse à publier.
+ */
+void rqpost(const struct request *rq, const struct reply *rp);
+
+/**
+ * Libère la requête du travail job et ferme ses descripteurs.
+ *
+ * @arg     job     Le travail à libérer.
+ */
+void rqrelease(struct job *job);
+
+/**
+ * Copie hors de la zone partagée la requête désignée par ref.
+ *
+ * La requête, reprise par le daemon, est libérée. L'emplacement de réponse
+ * est aussi repris jusqu'à rqreply() : ni l'un ni l'autre ne sont récupérés
+ * par sa_reclaim si le client se termine entre temps.
+ *
+ * Une requête invalide (voir rqvalid()) est abandonnée : le client en est
+ * prévenu par son emplacement de réponse.
+ *
+ * @arg     ref     L'élément défilé de la file partagée.
+ * @return          Une copie de la requête, à libérer avec free(), NULL si
+ *                  la requête est invalide ou si elle ou son emplacement de
+ *                  réponse ont déjà été récupérés.
+ */
+struct request *rqload(const struct rqref *ref);
+
+/**
+ * Estime le coût de la requête rq pour la file d'attente (voir jobsched.h),
+ * d'après la durée moyenne de ses exécutions précédentes.
+ *
+ * Doit être appelée avec g_lock.
+ *
+ * @return  La durée estimée en millisecondes (au moins 1), 0 si la commande
+ *          est inconnue.
+ */
+uint32_t rqcost(const struct request *rq);
+
+/**
+ * Signale à g_sched la fin du travail job, retiré de la file d'attente, et
+ * enregistre la durée de sa commande dans g_hist si elle a été lancée.
+ *
+ * @arg     job     Le travail terminé.
+ * @arg     rp      La réponse du travail.
+ */
+void rqdone(const struct job *job, const struct reply *rp);
+
+/**
+ * Indique si la clé de la requête rq désigne bien son utilisateur et sa
+ * commande : un client ne peut pas associer à sa clé le résultat d'une autre
+ * commande, ni se rattacher à la commande d'un autre utilisateur.
+ */
+bool rqkeyok(const struct request *rq);
+
+/**
+ * Indique si le résultat de la requête rq doit être mis en cache : le cache
+ * est activé, la requête le demande, et sa clé est valide (voir rqkeyok()).
+ */
+bool rqcacheable(const struct request *rq);
+
+/**
+ * Ouvre en écriture le tube du client de la requête rq.
+ *
+ * Le client ouvre son tube avant d'enfiler la requête : l'ouverture ne
+ * bloque donc pas, et échoue si le client n'est plus là pour lire. Le
+ * descripteur renvoyé est bloquant.
+ *
+ * @arg     rq  La requête.
+ * @return      Le descripteur du tube en cas de succès, -1 sinon.
+ */
+int rqopen(const struct request *rq);
+
+/**
+ * Rattache le travail job, s'il demande à être regroupé, à la requête
+ * identique en cours dans g_flights. Sinon, sa requête devient la requête en
+ * cours de sa clé et le travail doit être placé dans la file d'attente.
+ *
+ * Une copie du travail est confiée à la requête en cours, avec la sortie du
+ * client. Un travail qui ne peut être rattaché est exécuté normalement.
+ *
+ * @arg     job     Le travail reçu.
+ * @return          true si le travail a été rattaché (il appartient alors à
+ *                  la requête en cours), false s'il doit être placé dans la
+ *                  file d'attente.
+ */
+bool rqjoin(struct job *job);
+
+/**
+ * Répond aux clients rattachés à la requête en cours f, terminée, puis libère
+ * celle-ci. La copie du travail de son propriétaire est seulement libérée.
+ *
+ * @arg     f       La requête en cours, retirée de g_flights.
+ * @arg     rp      La réponse de la commande.
+ * @arg     tstart  L'instant de lancement de la commande, pour le temps
+ *                  d'attente de chaque client (ou NULL si rp est un abandon).
+ * @return          Le nombre de clients rattachés.
+ */
+size_t rqfanout(Flight f, const struct reply *rp,
+        const struct timespec *tstart);
+
 /**
  * Gestionnaire de signaux du daemon.
  */
@@ -123,68 +422,255 @@ pid_t retrievepid(void);
  * @field   id      Un numéro d'identification.
  * @field   th      Le thread associé.
  * @field   mutex   Sémaphore de mise en attente.
- * @field   avail   Indique la disponibilité du worker.
- * @field   rq      La requête qu'exécute le worker.
+ * @field   job     Le travail qu'exécute le worker (job.rq est une copie privée
+ *                  de la requête), job.rq vaut NULL si le worker est libre.
+ * @field   run     En mode event, l'emplacement de g_runs réservé au travail.
+ * @field   alive   Indique si le thread associé est lancé.
+ * @field   retire  Demande au worker de s'arrêter à son prochain réveil.
  */
 struct worker {
     int id;
     pthread_t th;
     sem_t mutex;
-    bool avail;
-    struct request rq;
+    struct job job;
+    size_t run;
+    bool alive;
+    bool retire;
 };
 
 /**
  * Fonction de démarrage des workers.
  *
  * La fonction lance une boucle infinie et le thread associé au worker se met
- * en attente d'une requête. La requête est effectuée dans un processus fils,
- * et une entrée est ajoutée aux logs du daemon.
+ * en attente d'une requête. La requête est effectuée dans un processus fils
+ * par étape, lancés par le module spawner, et une entrée est ajoutée aux logs
+ * du daemon.
  *
  * @arg wk Un pointeur vers un worker.
  */
 void *wkstart(struct worker *wk);
 
 /**
- * Compte le nombre d'arguments présents dans str.
+ * Enregistre dans g_cache le résultat de la commande du worker wk, dont la
+ * sortie a été recueillie dans le fichier anonyme tmp, puis transmet cette
+ * sortie vers out.
+ *
+ * @arg     wk      Le worker.
+ * @arg     tmp     Le fichier qui contient la sortie de la commande.
+ * @arg     out     La sortie du client.
+ * @arg     rp      La réponse de la commande.
+ */
+void wkcache(struct worker *wk, int tmp, int out, const struct reply *rp);
+
+/**
+ * Enregistre dans g_cache le résultat de la commande du worker wk : sa sortie
+ * data, de longueur len, et la réponse rp.
+ *
+ * Seul le résultat d'une commande lancée et terminée normalement (quel que
+ * soit son code de retour), et dont la sortie ne dépasse pas RC_OUTPUT_MAX,
+ * est enregistré.
+ */
+void wkstore(struct worker *wk, const char *data, size_t len,
+        const struct reply *rp);
+
+/**
+ * Confie au thread de récupération la commande pid lancée par le worker wk,
+ * en mode event. Le travail du worker est transféré dans l'emplacement
+ * wk->run de g_runs.
+ *
+ * @arg     wk      Le worker.
+ * @arg     pid     Le processus lancé.
+ * @arg     tstart  L'instant de lancement du processus.
+ * @return          0 en cas de succès, -1 si le processus ne peut être
+ *                  surveillé (le worker doit alors l'attendre lui-même).
+ */
+int wkhandoff(struct worker *wk, pid_t pid, const struct timespec *tstart);
+
+/**
+ * Lance les nstages étapes de la commande du worker wk, reliées par des tubes
+ * de capacité PIPE_SIZE : la première lit fds->in, la dernière écrit dans
+ * fds->out, et chacune écrit ses erreurs dans fds->err. Une étape qui ne peut
+ * être lancée est ignorée : ses voisines trouvent leur tube fermé. Si un tube
+ * ne peut être créé, ni l'étape qui devait y écrire ni les suivantes ne sont
+ * lancées.
+ *
+ * @arg     wk      Le worker.
+ * @arg     argv    Les arguments des étapes, chacune terminée par NULL.
+ * @arg     nstages Le nombre d'étapes, au plus REQUEST_STAGES_MAX.
+ * @arg     fds     Les descripteurs de la commande.
+ * @arg     pids    Reçoit le PID de chaque étape, -1 si elle n'a pas été
+ *                  lancée.
+ * @arg     tstart  L'instant de lancement de la commande.
+ * @arg     rp      La réponse, qui reçoit le nombre d'étapes et l'instant de
+ *                  lancement de chacune.
+ * @return          Le nombre d'étapes lancées.
+ */
+size_t wkpipeline(struct worker *wk, char *const argv[], size_t nstages,
+        const struct sp_fds *fds, pid_t pids[], const struct timespec *tstart,
+        struct reply *rp);
+
+/**
+ * Lance la commande (ou l'étape) argv du worker wk, directement ou par
+ * l'intermédiaire du zygote si SPAWN_ZYGOTE est activé. Le fichier de la
+ * commande est pris dans le cache des chemins g_paths plutôt que cherché dans
+ * PATH par le fils.
+ *
+ * @arg     wk      Le worker.
+ * @arg     argv    Les arguments de la commande, terminés par NULL.
+ * @arg     fds     Les descripteurs à rediriger.
+ * @return          Le PID du processus lancé en cas de succès, -1 sinon.
+ */
+pid_t wkspawn(struct worker *wk, char *const argv[],
+        const struct sp_fds *fds);
+
+/**
+ * Attend la fin des étapes pids lancées par le worker wk et remplit rp avec
+ * leur statut et les ressources qu'elles ont consommées. Les étapes d'un
+ * pipeline sont attendues dans l'ordre où elles se terminent, afin que la
+ * durée de chacune soit exacte.
  *
- * @arg str La chaîne à analyser.
- * @return Le nombre d'arguments dans str.
+ * @arg     wk      Le worker.
+ * @arg     pids    Le PID de chaque étape, -1 si elle n'a pas été lancée.
+ * @arg     n       Le nombre d'étapes.
+ * @arg     tstart  L'instant de lancement de la commande (CLOCK_MONOTONIC).
+ * @arg     rp      La réponse à remplir.
  */
-size_t argcount(const char *str);
+void rpwait(struct worker *wk, const pid_t pids[], size_t n,
+        const struct timespec *tstart, struct reply *rp);
 
 /**
- * Construit un tableau d'arguments à partir de str.
+ * Attend la fin du processus pid, étape i de la commande du worker wk, et
+ * l'ajoute à rp (voir rpfill()).
  *
- * Le tableau argv doit être de longueur au moins égale à argcount(str) + 1.
- * Il est utilisé pour y placer les pointeurs vers les chaînes dans buf. Le
- * dernier élément est un pointeur NULL.
+ * @return  0 en cas de succès, -1 sinon.
+ */
+int rpreap(struct worker *wk, pid_t pid, const struct timespec *tstart,
+        size_t i, struct reply *rp);
+
+/**
+ * Ajoute à rp le statut status et les ressources ru de l'étape i d'une
+ * commande lancée à l'instant tstart, et qui vient de se terminer. Le statut
+ * de la réponse devient celui de l'étape si elle est la dernière.
+ */
+void rpfill(int status, const struct rusage *ru, const struct timespec *tstart,
+        size_t i, struct reply *rp);
+
+/* --- RÉCUPÉRATION (MODE EVENT) ------------------------------------------- */
+
+/**
+ * Structure contenant une commande en cours d'exécution en mode event.
+ *
+ * @field   job     Le travail, transféré depuis le worker qui l'a lancé.
+ * @field   pid     Le processus lancé, 0 si l'emplacement est libre.
+ * @field   pidfd   Le descripteur du processus, surveillé par g_epoll.
+ * @field   tstart  L'instant de lancement du processus.
+ */
+struct run {
+    struct job job;
+    pid_t pid;
+    int pidfd;
+    struct timespec tstart;
+};
+
+/* Nombre maximal d'événements traités par itération de rpstart() */
+#define DAEMON_EVENT_MAX 64
+
+/**
+ * Fonction de démarrage du thread de récupération.
+ *
+ * Le thread attend sur g_epoll que les processus surveillés se terminent.
+ * Chacun est alors attendu, sa réponse transmise au client, et son
+ * emplacement rendu à g_freeruns avant que le thread de répartition ne soit
+ * réveillé.
  *
- * Le tampon buf doit être de taille au moins égale à la taille de la zone
- * mémoire pointée par str (strlen(str) + 1). Il est utilisé pour y placer les
- * chaînes que sont les arguments extraits de str.
+ * @arg arg Inutilisé.
+ */
+void *rpstart(void *arg);
+
+/* --- STATISTIQUES -------------------------------------------------------- */
+
+/* Période de rafraîchissement par défaut de cmdld stats --watch, en
+ * secondes */
+#define STATS_PERIOD_DEFAULT 1.0
+
+/* Période de rafraîchissement maximale de cmdld stats --watch, en secondes */
+#define STATS_PERIOD_MAX 3600.0
+
+/**
+ * Affiche les métriques du daemon en cours d'exécution (cmdld stats), lues
+ * dans la page SHM_METRICS sans solliciter le daemon.
  *
- * En cas de non respect des contraintes de taille sur argv et buf, le
- * comportement de strtoargs est indéfini.
+ * Sans option, les métriques sont affichées une fois. Avec --watch, elles
+ * sont rafraîchies périodiquement, avec le débit des compteurs. Avec
+ * --prometheus, elles sont écrites au format texte de Prometheus.
  *
- * @arg     str     La chaîne à analyser.
- * @arg     argv    Le tableau d'arguments à remplir.
- * @arg     buf     Un tampon vide de même taille que str.
+ * @arg     argc    Le nombre d'arguments, "stats" compris.
+ * @arg     argv    Les arguments, à partir de "stats".
+ * @return          Le code de retour du programme.
+ */
+int stats(int argc, char *argv[]);
+
+/**
+ * Affiche les métriques de la page m. Si prev n'est pas NULL, le débit de
+ * chaque compteur depuis les valeurs prev, relevées elapsed secondes plus
+ * tôt, est également affiché.
+ */
+void stprint(Metrics m, const uint64_t prev[MT_COUNTERS], double elapsed);
+
+/**
+ * Écrit les métriques de la page m au format texte de Prometheus.
  */
-void strtoargs(const char *str, char *argv[], char *buf);
+void stprometheus(Metrics m);
 
 /* --- MAIN ---------------------------------------------------------------- */
 
 static SQueue g_queue;              /* La file en mémoire partagée */
+static SArena g_arena;              /* Les requêtes en mémoire partagée */
 static struct config g_config;      /* La configuration du daemon */
 static struct worker *g_workers;    /* Liste des workers */
+static IStack g_idle;               /* Indices des workers libres */
+static size_t g_live;               /* Nombre de workers lancés */
+static size_t g_lowidle;            /* Minimum de g_idle sur la période */
+static struct timespec g_scaleat;   /* Fin de la période de wkshrink() */
+static struct timespec g_reportat;  /* Date du prochain pqreport() */
+static uint64_t g_reported;         /* Requêtes retirées au dernier rapport */
+static Zygote g_zygote;             /* Le zygote (si SPAWN_ZYGOTE) */
+static JobSched g_sched;            /* Les requêtes en attente d'un worker */
+static RtHist g_hist;               /* L'historique des durées (ou NULL) */
+static RCache g_cache;              /* Le cache des résultats (ou NULL) */
+static FlTable g_flights;           /* Les requêtes regroupées en cours */
+static Metrics g_metrics;           /* La page de métriques */
+static ALog g_log;                  /* Le journal (NULL hors de maind()) */
+static PCache g_paths;              /* Le cache des chemins (ou NULL) */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER; /* Protège
+                                                              g_sched et
+                                                              g_hist */
+static pthread_mutex_t g_cachelock = PTHREAD_MUTEX_INITIALIZER; /* Protège
+                                                                   g_cache */
+static sem_t g_wakeup;              /* Réveille le thread de répartition */
+static pthread_t g_dispatcher;      /* Le thread de répartition */
+static bool g_dispatching;          /* Indique si g_dispatcher est lancé */
+static int g_socket = -1;           /* Le socket d'écoute DAEMON_SOCKET */
+static pthread_t g_acceptor;        /* Le thread d'acceptation */
+static bool g_accepting;            /* Indique si g_acceptor est lancé */
+static struct run *g_runs;          /* Commandes en cours (mode event) */
+static IStack g_freeruns;           /* Indices des emplacements libres */
+static int g_epoll = -1;            /* Surveille les pidfd de g_runs */
+static pthread_t g_reaper;          /* Le thread de récupération */
+static bool g_reaping;              /* Indique si g_reaper est lancé */
 
 int main(int argc, char *argv[]) {
     /* Affiche l'aide si les options sont incorrectes */
-    if (argc < 2 || !(opt_test(OPT_START) || opt_test(OPT_STOP))) {
+    if (argc < 2 || !(opt_test(OPT_START) || opt_test(OPT_STOP)
+                || opt_test(OPT_STATS))) {
         usage();
     }
 
+    /* La consultation des métriques ne dépend pas de l'unicité du daemon */
+    if (opt_test(OPT_STATS)) {
+        return stats(argc - 1, argv + 1);
+    }
+
     /* Gestion des options start/stop */
     bool isrunning = (trylock() == -1);
     if (opt_test(OPT_START) && isrunning) {
@@ -221,8 +707,10 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    /* Ouvre la connexion au système de log */
+    /* Ouvre la connexion au système de log, utilisée directement jusqu'au
+     * lancement du journal */
     openlog("cmdld", LOG_PID, LOG_DAEMON);
+    setlogmask(LOG_UPTO(g_config.LOG_LEVEL));
 
     /* Construit le nom d'un tube nommé à partir du PID du processus */
     pid_t pid = getpid();
@@ -298,13 +786,95 @@ int main(int argc, char *argv[]) {
 
 void cleanup(void) {
     /* Terminaison des threads */
+    if (g_accepting) {
+        pthread_cancel(g_acceptor);
+        pthread_join(g_acceptor, NULL);
+    }
+
+    if (g_dispatching) {
+        pthread_cancel(g_dispatcher);
+        pthread_join(g_dispatcher, NULL);
+    }
+
+    if (g_reaping) {
+        pthread_cancel(g_reaper);
+        pthread_join(g_reaper, NULL);
+    }
+
     if (g_workers != NULL) {
         for (size_t i = 0; i < g_config.DAEMON_WORKER_MAX; i++) {
-            struct worker wk = g_workers[i];
-            pthread_cancel(wk.th);
-            pthread_join(wk.th, NULL);
-            kill(wk.rq.pid, SIG_FAILURE);
+            struct worker *wk = &g_workers[i];
+            if (!wk->alive) {
+                continue;
+            }
+            pthread_cancel(wk->th);
+            pthread_join(wk->th, NULL);
+            if (wk->job.rq != NULL) {
+                rqreply(&wk->job, &(struct reply) { .aborted = 1 });
+            }
+        }
+    }
+
+    /* Les commandes en cours ne sont pas interrompues, mais leurs clients
+     * sont prévenus comme ceux des workers */
+    if (g_runs != NULL) {
+        for (size_t i = 0; i < g_config.DAEMON_JOB_MAX; i++) {
+            if (g_runs[i].pid != 0) {
+                rqreply(&g_runs[i].job, &(struct reply) { .aborted = 1 });
+                rqrelease(&g_runs[i].job);
+            }
+        }
+        free(g_runs);
+        g_runs = NULL;
+        is_dispose(&g_freeruns);
+    }
+
+    if (g_zygote != NULL) {
+        zy_dispose(&g_zygote);
+    }
+
+    if (g_hist != NULL) {
+        rh_dispose(&g_hist);
+    }
+
+    if (g_cache != NULL) {
+        rc_dispose(&g_cache);
+    }
+
+    /* Abandon des clients rattachés aux requêtes en cours, avant celui des
+     * requêtes en attente qui en sont propriétaires */
+    if (g_flights != NULL) {
+        Flight f;
+        while ((f = fl_drain(g_flights)) != NULL) {
+            rqfanout(f, &(struct reply) { .aborted = 1 }, NULL);
+        }
+        fl_dispose(&g_flights);
+    }
+
+    /* Abandon des requêtes en attente */
+    if (g_sched != NULL) {
+        struct job job;
+        /* Les autres threads sont arrêtés : g_lock n'est pas nécessaire, et
+         * a pu être laissé pris par un thread annulé */
+        struct histo waits[RQ_PRIO_COUNT];
+        for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+            waits[p] = *js_waits(g_sched, (enum rq_priority) p);
         }
+        pqlog(waits);
+        while (js_drain(g_sched, &job) == 0) {
+            rqabort(&job, "daemon terminated");
+        }
+        js_dispose(&g_sched);
+    }
+
+    if (g_paths != NULL) {
+        pc_dispose(&g_paths);
+    }
+
+    /* Les messages restants sont écrits avant la fermeture du fichier ou du
+     * socket du journal */
+    if (g_log != NULL) {
+        al_dispose(&g_log);
     }
 
     /* Fermeture des descripteurs de fichiers */
@@ -318,6 +888,18 @@ void cleanup(void) {
         sq_dispose(&g_queue);
     }
 
+    if (g_arena != NULL) {
+        sa_dispose(&g_arena);
+    }
+
+    if (g_metrics != NULL) {
+        mt_dispose(&g_metrics);
+    }
+
+    if (g_socket != -1) {
+        unlink(DAEMON_SOCKET);
+    }
+
     shm_unlink(DAEMON_SHM_PID);
     unlock();
 }
@@ -334,17 +916,27 @@ void die(const char *format, ...) {
     va_end(args);
 
     fprintf(stderr, "Error: daemon died '%s' (%s)", msg, strerr);
-    syslog(LOG_ERR, "[maind] daemon died: '%s' (%s)", msg, strerr);
+    dlog(LOG_ERR, "[maind] daemon died: '%s' (%s)", msg, strerr);
 
     cleanup();
     exit(EXIT_FAILURE);
 }
 
 void usage(void) {
-    printf("Usage: cmdld <start | stop>\n");
+    printf("Usage: cmdld <start | stop | "
+            "stats [--watch[=<seconds>] | --prometheus]>\n");
     exit(EXIT_FAILURE);
 }
 
+int thcreate(pthread_t *th, void *(*fun)(void *), void *arg) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(th, NULL, fun, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return ret;
+}
+
 /* ------------------------------------------------------------------------- */
 
 void daemonise(const char *pipename) {
@@ -423,107 +1015,884 @@ void maind(void) {
     if (sigprocmask(SIG_SETMASK, &masked, NULL) == -1) {
        die("sigprocmask");
     }
-    
-    /* Initialise la file de requêtes */
-    g_queue = sq_empty(SHM_QUEUE, sizeof(struct request),
-                       (size_t) g_config.REQUEST_QUEUE_MAX);
+
+    /* Lance le zygote avant toute allocation et tout thread : son espace
+     * mémoire, dupliqué à chaque lancement, reste ainsi minimal */
+    if (g_config.SPAWN_ZYGOTE) {
+        g_zygote = zy_create(g_config.DAEMON_WORKER_MAX,
+                g_config.SPAWN_BACKEND);
+        if (g_zygote == NULL) {
+            die("zy_create");
+        }
+    }
+
+    /* Lance le journal, dont le thread d'écriture ne doit pas exister lors
+     * de la création du zygote */
+    g_log = al_create("cmdld", LOG_DAEMON, g_config.LOG_LEVEL,
+            *g_config.LOG_FILE == '\0' ? NULL : g_config.LOG_FILE,
+            DAEMON_LOG_CAPACITY);
+    if (g_log == NULL) {
+        die("al_create");
+    }
+
+    /* Le cache des chemins suit les répertoires du PATH du daemon, hérité
+     * par les commandes */
+    g_paths = pc_create(getenv("PATH"));
+    if (g_paths == NULL) {
+        dlog(LOG_WARNING, "[maind] pc_create: commands will be looked up in "
+                "PATH (%s)", strerror(errno));
+    }
+
+    /* Initialise la zone d'allocation des requêtes */
+    g_arena = sa_empty(SHM_ARENA, REQUEST_ARENA_SIZE);
+    if (g_arena == NULL) {
+        die("sa_empty");
+    }
+
+    /* Initialise la file de requêtes (décalages dans g_arena) */
+    g_queue = sq_empty(SHM_QUEUE, sizeof(struct rqref),
+                       (size_t) g_config.REQUEST_QUEUE_MAX,
+                       g_config.REQUEST_QUEUE_ENGINE);
     if (g_queue == NULL) {
         die("sq_empty");
     }
 
+    /* Initialise la page de métriques, consultée par cmdld stats */
+    g_metrics = mt_empty(SHM_METRICS);
+    if (g_metrics == NULL) {
+        die("mt_empty");
+    }
+
     /* Tableau des workers */
     struct worker wks[g_config.DAEMON_WORKER_MAX];
     g_workers = wks;
 
-    /* Initialise les workers */
+    /* Pile des workers libres */
+    g_idle = is_create(g_config.DAEMON_WORKER_MAX);
+    if (g_idle == NULL) {
+        die("is_create");
+    }
+
+    /* Initialise les workers. Seuls les DAEMON_WORKER_MIN premiers sont
+     * lancés, les suivants le seront par wkgrow() */
     for (size_t i = 0; i < g_config.DAEMON_WORKER_MAX; i++) {
         wks[i].id = (int) i;
-        wks[i].avail = true;
+        wks[i].alive = false;
+        wks[i].retire = false;
 
         if (sem_init(&wks[i].mutex, 0, 0) == -1) {
             die("(sem_init) failed to initialise worker's mutex");
         }
 
-        /* Assure la présence d'une valeur dans le champ pid pour que la
-         * fonction cleanup() effectue des envois de signaux corrects dans le
-         * cas où tout les workers n'auraient pas été utilisés; ceci afin de ne 
-         * pas mécontenter valgrind. */
-        wks[i].rq.pid = 0;
-
-        int ret = pthread_create(&wks[i].th, NULL,
-                (void *(*)(void *)) wkstart, &wks[i]);
+        /* Aucune requête tant que le worker n'a pas été utilisé */
+        wks[i].job.rq = NULL;
+    }
+    for (size_t i = 0; i < g_config.DAEMON_WORKER_MIN; i++) {
+        int ret = thcreate(&wks[i].th, (void *(*)(void *)) wkstart, &wks[i]);
         if (ret != 0) {
             die("(pthread_create) failed to create worker");
         }
+        wks[i].alive = true;
+        g_live++;
     }
+    mt_set(g_metrics, MT_WORKERS, (int64_t) g_live);
 
-    syslog(LOG_INFO, "[maind] daemon started with %zu workers",
-            g_config.DAEMON_WORKER_MAX);
+    /* Les workers de plus petits numéros sont au sommet de la pile */
+    for (size_t i = g_config.DAEMON_WORKER_MIN; i > 0; i--) {
+        is_push(g_idle, i - 1);
+    }
 
-    /* Boucle principale du daemon */
-    struct request rq;
-    while (sq_dequeue(g_queue, &rq) == 0) {
-        syslog(LOG_DEBUG, "[maind] request dequeued { %s, %s, %d }",
-                rq.cmd, rq.pipe, rq.pid);
-        bool wk_found = false;
-        for (size_t i = 0; i < g_config.DAEMON_WORKER_MAX; i++) {
-            if (wks[i].avail) {
-                wk_found = true;
-                memcpy(&wks[i].rq, &rq, sizeof(struct request));
-                if (sem_post(&wks[i].mutex) == -1) {
-                    die("(sem_post) failed to unlock worker %d", wks[i].id);
-                }
-                syslog(LOG_DEBUG, "[maind] unlocked wk#%02d", wks[i].id);
-                wks[i].avail = false;
-                break;
-            }
+    /* En mode event, chaque commande en cours occupe un emplacement de
+     * g_runs et un pidfd (ainsi que la connexion d'un client par socket) : la
+     * limite du nombre de descripteurs est portée au maximum autorisé */
+    if (g_config.EXEC_MODE == EXEC_EVENT) {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
         }
 
-        if (!wk_found) {
-            if (kill(rq.pid, SIG_FAILURE) == -1) {
-                die("(kill) failed to send %d to process %d", SIG_FAILURE,
-                        rq.pid);
-            }
+        g_runs = calloc(g_config.DAEMON_JOB_MAX, sizeof(*g_runs));
+        g_freeruns = is_create(g_config.DAEMON_JOB_MAX);
+        if (g_runs == NULL || g_freeruns == NULL) {
+            die("(calloc) failed to allocate running jobs");
+        }
+        for (size_t i = g_config.DAEMON_JOB_MAX; i > 0; i--) {
+            is_push(g_freeruns, i - 1);
         }
-    }
-}
 
-void sighandler(int sig) {
-    if (sig == SIGTERM) {
-        cleanup();
-        syslog(LOG_INFO, "[maind] daemon terminated");
-        exit(EXIT_SUCCESS);
+        g_epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (g_epoll == -1) {
+            die("epoll_create1");
+        }
+        if (thcreate(&g_reaper, rpstart, NULL) != 0) {
+            die("(pthread_create) failed to create reaper");
+        }
+        g_reaping = true;
     }
 
-    if (sig == SIGALRM) {
-        die("failed to start");
+    /* Sans historique, les commandes ont toutes le même coût : la file
+     * d'attente reste utilisable, dans l'ordre d'arrivée */
+    if (*g_config.HISTORY_FILE != '\0') {
+        g_hist = rh_open(g_config.HISTORY_FILE);
+        if (g_hist == NULL) {
+            dlog(LOG_WARNING, "[maind] failed to open history '%s' (%s)",
+                    g_config.HISTORY_FILE, strerror(errno));
+        }
     }
-}
-
-pid_t storepid(void) {
-    size_t shm_size = sizeof(pid_t);
 
-    int fd = shm_open(DAEMON_SHM_PID, O_RDWR | O_CREAT | O_EXCL,
-            S_IRUSR | S_IWUSR);
-    if (fd == -1) {
-        return -1;
+    /* Initialise le cache des résultats, consulté directement par les
+     * clients */
+    if (g_config.CACHE_SIZE > 0) {
+        g_cache = rc_empty(SHM_CACHE, SHM_CACHE_ARENA,
+                g_config.CACHE_SIZE * 1024);
+        if (g_cache == NULL) {
+            die("rc_empty");
+        }
     }
 
-    if (ftruncate(fd, (off_t) shm_size) == -1) {
-        return -1;
+    /* Initialise la table des requêtes regroupées en cours */
+    g_flights = fl_create();
+    if (g_flights == NULL) {
+        die("fl_create");
     }
 
-    pid_t *shm_pid = mmap(NULL, shm_size, PROT_WRITE, MAP_SHARED, fd, 0);
-    if (shm_pid == MAP_FAILED) {
-        return -1;
+    /* Initialise la file d'attente et lance le thread de répartition */
+    g_sched = js_create(g_config.DAEMON_BACKLOG_MAX,
+            g_config.EXEC_MODE == EXEC_EVENT ? g_config.DAEMON_JOB_MAX
+                                             : g_config.DAEMON_WORKER_MAX,
+            g_config.DAEMON_PRIORITY_POLICY, g_config.DAEMON_JOB_ORDER,
+            g_config.DAEMON_PRIORITY_AGING, g_config.DAEMON_TENANT_WORKERS);
+    if (g_sched == NULL) {
+        die("js_create");
     }
+    if (sem_init(&g_wakeup, 0, 0) == -1) {
+        die("(sem_init) failed to initialise dispatcher's semaphore");
+    }
+    if (thcreate(&g_dispatcher, dpstart, NULL) != 0) {
+        die("(pthread_create) failed to create dispatcher");
+    }
+    g_dispatching = true;
+
+    /* Ouvre le socket d'écoute et lance le thread d'acceptation. Un socket
+     * subsistant d'une instance précédente est supprimé : l'unicité du
+     * daemon est assurée par trylock() */
+    g_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (g_socket == -1) {
+        die("socket");
+    }
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, DAEMON_SOCKET, sizeof(addr.sun_path) - 1);
+    unlink(DAEMON_SOCKET);
+    if (bind(g_socket, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        die("bind");
+    }
+    if (chmod(DAEMON_SOCKET, S_IRUSR | S_IWUSR) == -1) {
+        die("chmod");
+    }
+    if (listen(g_socket, SOMAXCONN) == -1) {
+        die("listen");
+    }
+    if (thcreate(&g_acceptor, acstart, NULL) != 0) {
+        die("(pthread_create) failed to create acceptor");
+    }
+    g_accepting = true;
+
+    dlog(LOG_INFO, "[maind] daemon started with %zu workers (max %zu)",
+            g_config.DAEMON_WORKER_MIN, g_config.DAEMON_WORKER_MAX);
+
+    /* Boucle principale du daemon : les requêtes présentes dans la file
+     * partagée sont défilées en un seul lot et placées ensemble dans la file
+     * d'attente, puis le thread de répartition est réveillé */
+    struct rqref refs[DAEMON_BATCH_MAX];
+    ssize_t n;
+    while ((n = sq_dequeue_batch(g_queue, refs, DAEMON_BATCH_MAX)) > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        struct job job = { .conn = -1, .fds = { -1, -1, -1 }, .queued = now };
+        if (g_config.DAEMON_BACKLOG_TIMEOUT > 0) {
+            job.deadline = ts_add_ms(now, g_config.DAEMON_BACKLOG_TIMEOUT);
+        }
 
-    *shm_pid = getpid();
+        struct job rejected[DAEMON_BATCH_MAX];
+        size_t nrejected = 0;
+        mt_add(g_metrics, MT_SUBMITTED, (uint64_t) n);
 
-    return *shm_pid;
-}
+        pthread_mutex_lock(&g_lock);
+        for (ssize_t k = 0; k < n; k++) {
+            job.rq = rqload(&refs[k]);
+            if (job.rq == NULL) {
+                continue;
+            }
+            job.cost = rqcost(job.rq);
+            dlog(LOG_DEBUG, "[maind] request dequeued { %s, %s, %d, %u, "
+                    "%" PRIu32 " ms }", RQ_CMD(job.rq), RQ_PIPE(job.rq),
+                    job.rq->pid, job.rq->prio, job.cost);
+            if (rqjoin(&job)) {
+                continue;
+            }
+            if (js_push(g_sched, &job) == -1) {
+                rejected[nrejected++] = job;
+            }
+        }
+        mt_set(g_metrics, MT_QUEUED, (int64_t) js_length(g_sched));
+        pthread_mutex_unlock(&g_lock);
 
-pid_t retrievepid(void) {
+        if (sem_post(&g_wakeup) == -1) {
+            die("(sem_post) failed to wake dispatcher");
+        }
+
+        for (size_t k = 0; k < nrejected; k++) {
+            rqabort(&rejected[k], "backlog full");
+        }
+    }
+}
+
+void *acstart(void *arg) {
+    (void) arg;
+    while (1) {
+        int conn = accept4(g_socket, NULL, NULL, SOCK_CLOEXEC);
+        if (conn == -1) {
+            dlog(LOG_ERR, "[accpt] accept: failed to accept (%s)",
+                    strerror(errno));
+            continue;
+        }
+
+        struct job job;
+        if (rqreceive(conn, &job) == -1) {
+            dlog(LOG_WARNING, "[accpt] invalid request (%s)",
+                    strerror(errno));
+            close(conn);
+            continue;
+        }
+        dlog(LOG_DEBUG, "[accpt] request received { %s, %d }",
+                RQ_CMD(job.rq), job.rq->pid);
+        mt_add(g_metrics, MT_SUBMITTED, 1);
+
+        if (rqjoin(&job)) {
+            continue;
+        }
+
+        pthread_mutex_lock(&g_lock);
+        job.cost = rqcost(job.rq);
+        int ret = js_push(g_sched, &job);
+        mt_set(g_metrics, MT_QUEUED, (int64_t) js_length(g_sched));
+        pthread_mutex_unlock(&g_lock);
+
+        if (ret == -1) {
+            rqabort(&job, "backlog full");
+        } else if (sem_post(&g_wakeup) == -1) {
+            dlog(LOG_ERR, "[accpt] sem_post: failed to wake dispatcher");
+        }
+    }
+}
+
+int rqreceive(int conn, struct job *job) {
+    struct timeval tv = {
+        .tv_sec = DAEMON_SOCKET_TIMEOUT / 1000,
+        .tv_usec = DAEMON_SOCKET_TIMEOUT % 1000 * 1000
+    };
+    if (setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
+        return -1;
+    }
+
+    /* L'en-tête arrive avec les descripteurs du client, marqués pour être
+     * fermés à l'exécution des commandes des autres workers */
+    struct request hdr;
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = { &hdr, sizeof(hdr) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctl.buf,
+        .msg_controllen = sizeof(ctl.buf)
+    };
+    ssize_t r = recvmsg(conn, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    if (r == -1) {
+        return -1;
+    }
+
+    *job = (struct job) { .rq = NULL, .conn = conn, .fds = { -1, -1, -1 } };
+    /* Les descripteurs reçus sont installés dans le daemon quel que soit
+     * leur nombre : ils sont conservés dans job->fds pour être fermés par
+     * rqrelease() si la requête est refusée */
+    size_t nfds = 0;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+            && cmsg->cmsg_type == SCM_RIGHTS) {
+        nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(job->fds, CMSG_DATA(cmsg), (nfds > 3 ? 3 : nfds) * sizeof(int));
+    }
+
+    if (r != (ssize_t) sizeof(hdr) || nfds != 3
+            || (msg.msg_flags & MSG_CTRUNC) || hdr.pipelen != 0
+            || !rqhdrok(&hdr)) {
+        errno = EPROTO;
+        goto error;
+    }
+
+    /* Le PID du client est celui du processus connecté, pas celui annoncé */
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
+        goto error;
+    }
+
+    size_t size = RQ_SIZE(hdr.argc, hdr.argslen, hdr.cmdlen, 0, hdr.keylen);
+    job->rq = malloc(size);
+    if (job->rq == NULL) {
+        goto error;
+    }
+    *job->rq = hdr;
+    job->rq->pid = cred.pid;
+    job->rq->uid = cred.uid;
+    job->rq->reply = -1;
+
+    size_t argsize = hdr.argc * sizeof(uint32_t) + hdr.argslen;
+    r = recv(conn, RQ_ARGV(job->rq), argsize, MSG_WAITALL);
+    if (r != (ssize_t) argsize) {
+        errno = (r == -1 ? errno : EPROTO);
+        goto error;
+    }
+
+    r = recv(conn, RQ_CMD(job->rq), hdr.cmdlen, MSG_WAITALL);
+    if (r != (ssize_t) hdr.cmdlen) {
+        errno = (r == -1 ? errno : EPROTO);
+        goto error;
+    }
+    RQ_CMD(job->rq)[hdr.cmdlen] = '\0';
+    RQ_PIPE(job->rq)[0] = '\0';
+    if (hdr.keylen > 0) {
+        r = recv(conn, RQ_KEY(job->rq), hdr.keylen, MSG_WAITALL);
+        if (r != (ssize_t) hdr.keylen) {
+            errno = (r == -1 ? errno : EPROTO);
+            goto error;
+        }
+    }
+    RQ_KEY(job->rq)[hdr.keylen] = '\0';
+    if (!rqvalid(job->rq, size)) {
+        errno = EPROTO;
+        goto error;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &job->queued);
+    if (g_config.DAEMON_BACKLOG_TIMEOUT > 0) {
+        job->deadline = ts_add_ms(job->queued,
+                g_config.DAEMON_BACKLOG_TIMEOUT);
+    }
+    return 0;
+
+error:
+    /* La connexion est fermée par l'appelant */
+    job->conn = -1;
+    rqrelease(job);
+    return -1;
+}
+
+bool rqhdrok(const struct request *hdr) {
+    return hdr->cmdlen != 0 && hdr->cmdlen <= REQUEST_CMD_MAX
+        && hdr->argc != 0 && hdr->argc <= TK_ARGC_MAX(hdr->cmdlen)
+        && hdr->argslen <= hdr->cmdlen + 1 && hdr->pipelen < PATH_MAX
+        && hdr->keylen <= REQUEST_KEY_MAX;
+}
+
+bool rqvalid(const struct request *rq, size_t len) {
+    if (len < sizeof(*rq) || !rqhdrok(rq) || len < RQ_SIZE(rq->argc,
+                rq->argslen, rq->cmdlen, rq->pipelen, rq->keylen)) {
+        return false;
+    }
+    return RQ_CMD(rq)[rq->cmdlen] == '\0' && RQ_PIPE(rq)[rq->pipelen] == '\0'
+        && RQ_KEY(rq)[rq->keylen] == '\0'
+        && tk_check(RQ_ARGS(rq), rq->argslen, RQ_ARGV(rq), rq->argc) == 0
+        && tk_stages(RQ_ARGV(rq), rq->argc) <= REQUEST_STAGES_MAX;
+}
+
+void *dpstart(void *arg) {
+    (void) arg;
+    while (1) {
+        struct timespec deadline;
+        pthread_mutex_lock(&g_lock);
+        bool timed = (js_deadline(g_sched, &deadline) == 0);
+        pthread_mutex_unlock(&g_lock);
+
+        /* Les workers excédentaires sont réexaminés à la fin de la période */
+        if (g_live > g_config.DAEMON_WORKER_MIN
+                && (!timed || ts_cmp(&g_scaleat, &deadline) < 0)) {
+            deadline = g_scaleat;
+            timed = true;
+        }
+
+        int r = timed ? sem_clockwait(&g_wakeup, CLOCK_MONOTONIC, &deadline)
+                      : sem_wait(&g_wakeup);
+        if (r == -1 && errno != ETIMEDOUT && errno != EINTR) {
+            dlog(LOG_ERR, "[maind] sem_wait: failed to wait (%s)",
+                    strerror(errno));
+        }
+
+        dispatch();
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        wkshrink(&now);
+        pqreport(&now);
+    }
+}
+
+void dispatch(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&g_lock);
+
+    struct job job;
+    while (js_expire(g_sched, &now, &job) == 0) {
+        rqabort(&job, "queue timeout");
+    }
+
+    /* Chaque worker libre est obtenu en temps constant depuis g_idle. En
+     * mode event, un emplacement libre de g_runs est de plus réservé au
+     * travail : il borne le nombre de commandes en cours. Les travaux des
+     * clients qui ont atteint DAEMON_TENANT_WORKERS restent en attente */
+    while (js_ready(g_sched)) {
+        ssize_t r = 0;
+        if (g_runs != NULL && (r = is_pop(g_freeruns)) == -1) {
+            break;
+        }
+        ssize_t i = is_pop(g_idle);
+        if (i == -1) {
+            i = wkgrow();
+        }
+        if (i == -1) {
+            if (g_runs != NULL) {
+                is_push(g_freeruns, (size_t) r);
+            }
+            break;
+        }
+
+        struct worker *wk = &g_workers[i];
+        js_pop(g_sched, &now, &job);
+        wk->job = job;
+        wk->run = (size_t) r;
+        if (sem_post(&wk->mutex) == -1) {
+            die("(sem_post) failed to unlock worker %d", wk->id);
+        }
+        dlog(LOG_DEBUG, "[maind] unlocked wk#%02d", wk->id);
+    }
+
+    mt_set(g_metrics, MT_QUEUED, (int64_t) js_length(g_sched));
+    pthread_mutex_unlock(&g_lock);
+
+    size_t idle = is_length(g_idle);
+    if (idle < g_lowidle) {
+        g_lowidle = idle;
+    }
+}
+
+ssize_t wkgrow(void) {
+    if (g_live == g_config.DAEMON_WORKER_MAX) {
+        return -1;
+    }
+
+    /* Les emplacements libres sont ceux des workers arrêtés par wkshrink() */
+    size_t i = 0;
+    while (g_workers[i].alive) {
+        i++;
+    }
+
+    struct worker *wk = &g_workers[i];
+    wk->retire = false;
+    if (thcreate(&wk->th, (void *(*)(void *)) wkstart, wk) != 0) {
+        dlog(LOG_ERR, "[maind] pthread_create: failed to create wk#%02d",
+                wk->id);
+        return -1;
+    }
+    wk->alive = true;
+    g_live++;
+    mt_set(g_metrics, MT_WORKERS, (int64_t) g_live);
+
+    /* Une nouvelle période commence : aucun worker n'était libre */
+    clock_gettime(CLOCK_MONOTONIC, &g_scaleat);
+    g_scaleat = ts_add_ms(g_scaleat, g_config.DAEMON_WORKER_IDLE);
+    g_lowidle = 0;
+
+    dlog(LOG_INFO, "[maind] pool grown to %zu workers (%zu pending)",
+            g_live, js_length(g_sched));
+    return (ssize_t) i;
+}
+
+void wkshrink(const struct timespec *now) {
+    if (g_live == g_config.DAEMON_WORKER_MIN
+            || ts_cmp(now, &g_scaleat) < 0) {
+        return;
+    }
+
+    size_t n = g_live - g_config.DAEMON_WORKER_MIN;
+    if (g_lowidle < n) {
+        n = g_lowidle;
+    }
+
+    /* Un worker libre n'a pas de requête : il s'arrête dès son réveil */
+    size_t k = 0;
+    ssize_t i;
+    while (k < n && (i = is_pop(g_idle)) != -1) {
+        struct worker *wk = &g_workers[i];
+        wk->retire = true;
+        if (sem_post(&wk->mutex) == -1) {
+            die("(sem_post) failed to unlock worker %d", wk->id);
+        }
+        pthread_join(wk->th, NULL);
+        wk->alive = false;
+        g_live--;
+        k++;
+    }
+
+    if (k > 0) {
+        mt_set(g_metrics, MT_WORKERS, (int64_t) g_live);
+        dlog(LOG_INFO, "[maind] pool shrunk to %zu workers", g_live);
+    }
+
+    g_scaleat = ts_add_ms(*now, g_config.DAEMON_WORKER_IDLE);
+    g_lowidle = is_length(g_idle);
+}
+
+void pqreport(const struct timespec *now) {
+    if (ts_cmp(now, &g_reportat) < 0) {
+        return;
+    }
+
+    /* Les histogrammes sont copiés pour ne pas retenir g_lock pendant les
+     * écritures dans les logs */
+    struct histo waits[RQ_PRIO_COUNT];
+    uint64_t total = 0;
+    pthread_mutex_lock(&g_lock);
+    for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+        waits[p] = *js_waits(g_sched, (enum rq_priority) p);
+        total += waits[p].count;
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    g_reportat = ts_add_ms(*now, DAEMON_REPORT_PERIOD);
+    if (total == g_reported) {
+        return;
+    }
+    g_reported = total;
+    pqlog(waits);
+}
+
+void pqlog(const struct histo waits[RQ_PRIO_COUNT]) {
+    static const char *names[RQ_PRIO_COUNT] = { "high", "normal", "low" };
+
+    for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+        const struct histo *h = &waits[p];
+        if (h->count == 0) {
+            continue;
+        }
+        dlog(LOG_INFO, "[maind] queue wait %-6s n=%" PRIu64 " p50=%.3fms "
+                "p90=%.3fms p99=%.3fms max=%.3fms", names[p], h->count,
+                (double) hi_percentile(h, 0.50) / 1e6,
+                (double) hi_percentile(h, 0.90) / 1e6,
+                (double) hi_percentile(h, 0.99) / 1e6,
+                (double) h->max / 1e6);
+    }
+}
+
+void rqabort(struct job *job, const char *reason) {
+    dlog(LOG_WARNING, "[maind] aborted request '%s' (%s)",
+            RQ_CMD(job->rq), reason);
+    struct reply rp = { .aborted = 1 };
+
+    /* Les clients rattachés à la requête sont abandonnés avec elle */
+    Flight f = NULL;
+    if (g_flights != NULL && (job->rq->flags & RQ_COALESCE)) {
+        f = fl_find(g_flights, RQ_KEY(job->rq), job->rq->keylen, job->rq);
+    }
+    if (f != NULL) {
+        fl_finish(g_flights, f);
+        rqfanout(f, &rp, NULL);
+    }
+
+    rqreply(job, &rp);
+    rqrelease(job);
+}
+
+void rqreply(const struct job *job, const struct reply *rp) {
+    mt_add(g_metrics, rp->aborted ? MT_REJECTED : MT_COMPLETED, 1);
+    if (job->conn == -1) {
+        rqpost(job->rq, rp);
+        if (rp->aborted) {
+            int fd = open(RQ_PIPE(job->rq), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+        return;
+    }
+
+    /* Le client a pu se terminer entre temps : MSG_NOSIGNAL évite SIGPIPE */
+    if (send(job->conn, rp, sizeof(*rp), MSG_NOSIGNAL) == -1) {
+        dlog(LOG_ERR, "[maind] send: failed to reply to %d (%s)",
+                job->rq->pid, strerror(errno));
+    }
+}
+
+void rqpost(const struct request *rq, const struct reply *rp) {
+    /* Si le client n'a pas encore lu la réponse, l'emplacement lui est rendu :
+     * sa_reclaim le libère si le client se termine avant */
+    size_t off = (size_t) rq->reply;
+    struct rpslot *slot = sa_ptr(g_arena, off);
+    rs_post(slot, rp);
+    if (rs_release(slot, RS_DAEMON)) {
+        sa_free(g_arena, off);
+    } else {
+        sa_own(g_arena, off, rq->replygen, rq->pid);
+    }
+}
+
+void rqrelease(struct job *job) {
+    free(job->rq);
+    job->rq = NULL;
+    if (job->conn != -1) {
+        close(job->conn);
+        job->conn = -1;
+    }
+    for (size_t i = 0; i < 3; i++) {
+        if (job->fds[i] != -1) {
+            close(job->fds[i]);
+            job->fds[i] = -1;
+        }
+    }
+}
+
+struct request *rqload(const struct rqref *ref) {
+    /* Une requête récupérée a pu être remplacée par une autre allocation :
+     * seule sa génération la désigne sans ambiguïté */
+    size_t off = (size_t) ref->off;
+    if (sa_own(g_arena, off, ref->gen, 0) == -1) {
+        dlog(LOG_WARNING, "[maind] dropped request of a terminated client");
+        return NULL;
+    }
+
+    /* La copie est proportionnelle à la longueur réelle de la requête et
+     * libère aussitôt la zone partagée */
+    size_t len = sa_length(g_arena, off);
+    if (len < sizeof(struct request)) {
+        sa_free(g_arena, off);
+        dlog(LOG_WARNING, "[maind] dropped truncated request");
+        return NULL;
+    }
+    struct request *rq = malloc(len);
+    if (rq == NULL) {
+        die("(malloc) failed to copy request");
+    }
+    memcpy(rq, sa_ptr(g_arena, off), len);
+    if (sa_free(g_arena, off) == -1) {
+        die("(sa_free) failed to release request");
+    }
+
+    /* Sans emplacement de réponse valide, le client ne peut être prévenu */
+    if (sa_own(g_arena, (size_t) rq->reply, rq->replygen, 0) == -1) {
+        dlog(LOG_WARNING, "[maind] dropped request of client %d (no reply "
+                "slot)", rq->pid);
+        free(rq);
+        return NULL;
+    }
+    if (sa_length(g_arena, (size_t) rq->reply) < sizeof(struct rpslot)) {
+        sa_own(g_arena, (size_t) rq->reply, rq->replygen, rq->pid);
+        dlog(LOG_WARNING, "[maind] dropped request of client %d (invalid "
+                "reply slot)", rq->pid);
+        free(rq);
+        return NULL;
+    }
+
+    /* Les champs d'une requête de la file sont vérifiés comme ceux d'une
+     * requête reçue par DAEMON_SOCKET : elle est sinon abandonnée */
+    if (rq->pipelen == 0 || !rqvalid(rq, len)) {
+        dlog(LOG_WARNING, "[maind] rejected invalid request of client %d",
+                rq->pid);
+        mt_add(g_metrics, MT_REJECTED, 1);
+        rqpost(rq, &(struct reply) { .aborted = 1 });
+
+        /* Le client attend l'ouverture de son tube, si son nom est lisible */
+        if (rq->pipelen > 0 && rq->pipelen < PATH_MAX
+                && len >= RQ_SIZE(rq->argc, rq->argslen, rq->cmdlen,
+                    rq->pipelen, 0)
+                && RQ_PIPE(rq)[rq->pipelen] == '\0') {
+            int fd = open(RQ_PIPE(rq), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+        free(rq);
+        return NULL;
+    }
+    return rq;
+}
+
+uint32_t rqcost(const struct request *rq) {
+    double mean;
+    double stddev;
+    if (g_hist == NULL || rh_estimate(g_hist, RQ_CMD(rq), &mean, &stddev)
+            == -1) {
+        return 0;
+    }
+    if (mean >= UINT32_MAX) {
+        return UINT32_MAX;
+    }
+    return mean < 1 ? 1 : (uint32_t) mean;
+}
+
+void rqdone(const struct job *job, const struct reply *rp) {
+    pthread_mutex_lock(&g_lock);
+    js_done(g_sched, job);
+    if (g_hist != NULL && rp->wall != 0) {
+        rh_record(g_hist, RQ_CMD(job->rq), rp->wall);
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (rp->wall != 0) {
+        mt_record(g_metrics, MT_RUN, rp->wall);
+    }
+}
+
+bool rqkeyok(const struct request *rq) {
+    /* La clé débute par l'utilisateur, le répertoire courant puis la
+     * commande */
+    char uid[16];
+    size_t n = (size_t) snprintf(uid, sizeof(uid), "%" PRIu32, rq->uid) + 1;
+    const char *key = RQ_KEY(rq);
+    if (rq->keylen < n || memcmp(key, uid, n) != 0) {
+        return false;
+    }
+    const char *cmd = memchr(key + n, '\0', rq->keylen - n);
+    if (cmd == NULL) {
+        return false;
+    }
+    cmd++;
+    return (size_t) (key + rq->keylen - cmd) > rq->cmdlen
+        && memcmp(cmd, RQ_CMD(rq), rq->cmdlen + 1) == 0;
+}
+
+bool rqcacheable(const struct request *rq) {
+    return g_cache != NULL && rq->ttl != 0 && rq->keylen != 0
+        && rqkeyok(rq);
+}
+
+int rqopen(const struct request *rq) {
+    int fd = open(RQ_PIPE(rq), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+
+    /* O_NONBLOCK serait partagé avec la sortie standard de la commande */
+    if (fcntl(fd, F_SETFL, 0) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool rqjoin(struct job *job) {
+    const struct request *rq = job->rq;
+    if (!(rq->flags & RQ_COALESCE) || rq->keylen == 0 || !rqkeyok(rq)) {
+        return false;
+    }
+
+    /* La sortie d'un client par DAEMON_SOCKET reste aussi détenue par son
+     * travail, fermé après la réponse */
+    int out = job->conn == -1 ? rqopen(rq)
+                              : fcntl(job->fds[1], F_DUPFD_CLOEXEC, 0);
+    if (out == -1) {
+        return false;
+    }
+    struct job *copy = malloc(sizeof(*copy));
+    if (copy == NULL) {
+        close(out);
+        return false;
+    }
+    *copy = *job;
+
+    int ret = fl_join(g_flights, RQ_KEY(rq), rq->keylen, rq, out, copy);
+    if (ret == -1) {
+        dlog(LOG_ERR, "[maind] fl_join: failed to coalesce '%s' (%s)",
+                RQ_CMD(rq), strerror(errno));
+        close(out);
+        free(copy);
+        return false;
+    }
+    if (ret == 0) {
+        dlog(LOG_DEBUG, "[maind] request '%s' attached to a running "
+                "identical request", RQ_CMD(rq));
+        return true;
+    }
+    return false;
+}
+
+size_t rqfanout(Flight f, const struct reply *rp,
+        const struct timespec *tstart) {
+    const void *owner = fl_owner(f);
+    size_t n = 0;
+    void *data;
+    while (fl_detach(f, &data) == 0) {
+        struct job *job = data;
+        if (job->rq != owner) {
+            /* Un client rattaché après le lancement n'a pas attendu */
+            struct reply jrp = *rp;
+            if (tstart != NULL) {
+                jrp.queue = ts_cmp(&job->queued, tstart) < 0
+                    ? (uint64_t) ts_diff_ns(&job->queued, tstart) : 0;
+            } else {
+                dlog(LOG_WARNING, "[maind] aborted request '%s' (identical "
+                        "request aborted)", RQ_CMD(job->rq));
+            }
+            rqreply(job, &jrp);
+            rqrelease(job);
+            n++;
+        }
+        free(job);
+    }
+    fl_close(&f);
+    return n;
+}
+
+void sighandler(int sig) {
+    if (sig == SIGTERM) {
+        dlog(LOG_INFO, "[maind] daemon terminated");
+        cleanup();
+        exit(EXIT_SUCCESS);
+    }
+
+    if (sig == SIGALRM) {
+        die("failed to start");
+    }
+}
+
+pid_t storepid(void) {
+    size_t shm_size = sizeof(pid_t);
+
+    int fd = shm_open(DAEMON_SHM_PID, O_RDWR | O_CREAT | O_EXCL,
+            S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t) shm_size) == -1) {
+        return -1;
+    }
+
+    pid_t *shm_pid = mmap(NULL, shm_size, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm_pid == MAP_FAILED) {
+        return -1;
+    }
+
+    *shm_pid = getpid();
+
+    return *shm_pid;
+}
+
+pid_t retrievepid(void) {
     size_t shm_size = sizeof(pid_t);
 
     int fd = shm_open(DAEMON_SHM_PID, O_RDONLY, S_IRUSR);
@@ -538,110 +1907,749 @@ pid_t retrievepid(void) {
 
 void *wkstart(struct worker *wk) {
     while (1) {
-        syslog(LOG_DEBUG, "[wk#%02d] locked (waiting)", wk->id);
+        dlog(LOG_DEBUG, "[wk#%02d] locked (waiting)", wk->id);
         if (sem_wait(&wk->mutex) == -1) {
-            syslog(LOG_ERR, "[wk#%02d] sem_wait: failed to lock worker's mutex",
+            dlog(LOG_ERR, "[wk#%02d] sem_wait: failed to lock worker's mutex",
                     wk->id);
+            continue;
         }
 
-        syslog(LOG_DEBUG, "[wk#%02d] started running", wk->id);
+        if (wk->retire) {
+            dlog(LOG_DEBUG, "[wk#%02d] retired", wk->id);
+            return NULL;
+        }
 
-        int fd;
-        int status = EXIT_FAILURE;
-        time_t tstart = time(NULL);
+        dlog(LOG_DEBUG, "[wk#%02d] started running", wk->id);
+        mt_adjust(g_metrics, MT_BUSY, 1);
 
-        char *argv[argcount(wk->rq.cmd) + 1];
-        char buf[strlen(wk->rq.cmd) + 1];
+        struct job *job = &wk->job;
 
-        pid_t pid = fork();
-        switch (pid) {
-        case -1:
-            syslog(LOG_ERR, "[wk#%02d] fork: failed to create child (%s)",
-                    wk->id, strerror(errno));
-            break;
+        /* Une commande qui ne peut être lancée se termine comme le ferait un
+         * shell, avec le code 127 */
+        struct reply rp = { .status = W_EXITCODE(127, 0) };
 
-        case 0:
-            fd = open(wk->rq.pipe, O_WRONLY);
-            if (fd == -1) {
-                syslog(LOG_ERR, "[wk#%02d] open: failed to open '%s' (%s)",
-                        wk->id, wk->rq.pipe, strerror(errno));
-                exit(EXIT_FAILURE);
+        /* Les arguments découpés par le client sont désignés en place et la
+         * sortie est préparée par le worker : le fils n'a plus qu'à installer
+         * ses descripteurs et exécuter la commande. Une requête reçue par
+         * DAEMON_SOCKET est directement exécutée avec les descripteurs du
+         * client. Un séparateur d'étapes termine les arguments d'une étape */
+        char *argv[job->rq->argc + 1];
+        for (size_t i = 0; i < job->rq->argc; i++) {
+            uint32_t off = RQ_ARGV(job->rq)[i];
+            argv[i] = (off == TK_PIPE ? NULL : RQ_ARGS(job->rq) + off);
+        }
+        argv[job->rq->argc] = NULL;
+        size_t nstages = tk_stages(RQ_ARGV(job->rq), job->rq->argc);
+
+        struct sp_fds fds = { job->fds[0], job->fds[1], job->fds[2] };
+        Flight flight = NULL;
+        if (job->rq->flags & RQ_COALESCE) {
+            flight = fl_find(g_flights, RQ_KEY(job->rq), job->rq->keylen,
+                    job->rq);
+        }
+
+        /* La sortie d'une requête regroupée est lue dans un tube, puis écrite
+         * vers tous les clients rattachés (dont celui de la requête) */
+        int rd = -1;
+        if (nstages > REQUEST_STAGES_MAX) {
+            dlog(LOG_ERR, "[wk#%02d] too many stages in '%s'", wk->id,
+                    RQ_CMD(job->rq));
+            fds.out = -1;
+            rp.aborted = 1;
+        } else if (flight != NULL) {
+            int p[2];
+            if (pipe2(p, O_CLOEXEC) == -1) {
+                dlog(LOG_ERR, "[wk#%02d] pipe2: failed to coalesce '%s' (%s)",
+                        wk->id, RQ_CMD(job->rq), strerror(errno));
+                fds.out = -1;
+                rp.aborted = 1;
+            } else {
+                rd = p[0];
+                fds.out = p[1];
+            }
+        } else if (job->conn == -1) {
+            fds.out = rqopen(job->rq);
+            if (fds.out == -1) {
+                dlog(LOG_ERR, "[wk#%02d] open: failed to open '%s' (%s)",
+                        wk->id, RQ_PIPE(job->rq), strerror(errno));
+                rp.aborted = 1;
             }
+        }
 
-            if (dup2(fd, STDOUT_FILENO) == -1) {
-                syslog(LOG_ERR, "[wk#%02d] dup2: failed to redirect STDOUT (%s)",
-                        wk->id, strerror(errno));
-                exit(EXIT_FAILURE);
+        /* La sortie d'une commande à mettre en cache est recueillie dans un
+         * fichier anonyme, transmis au client une fois la commande terminée */
+        int out = fds.out;
+        bool cache = (flight == NULL && out != -1 && rqcacheable(job->rq));
+        if (cache) {
+            fds.out = memfd_create("cmdld-cache", MFD_CLOEXEC);
+            if (fds.out == -1) {
+                dlog(LOG_ERR, "[wk#%02d] memfd_create: failed to cache "
+                        "'%s' (%s)", wk->id, RQ_CMD(job->rq), strerror(errno));
+                fds.out = out;
+                cache = false;
             }
-            if (close(fd) == -1) {
-                syslog(LOG_ERR, "[wk#%02d] close: failed to close '%s' (%s)",
-                        wk->id, wk->rq.pipe, strerror(errno));
+        }
+
+        /* En mode event, la commande lancée est confiée au thread de
+         * récupération, qui répondra au client à sa place (sauf si sa sortie
+         * doit être mise en cache ou transmise à des clients rattachés, ou
+         * s'il s'agit d'un pipeline) */
+        bool handed = false;
+        struct timespec tstart;
+        if (fds.out != -1) {
+            clock_gettime(CLOCK_MONOTONIC, &tstart);
+            rp.queue = (uint64_t) ts_diff_ns(&job->queued, &tstart);
+
+            pid_t pids[REQUEST_STAGES_MAX];
+            size_t started = wkpipeline(wk, argv, nstages, &fds, pids,
+                    &tstart, &rp);
+            struct timespec tspawn;
+            clock_gettime(CLOCK_MONOTONIC, &tspawn);
+            mt_record(g_metrics, MT_SPAWN,
+                    (uint64_t) ts_diff_ns(&tstart, &tspawn));
+            if (flight != NULL) {
+                close(fds.out);
+            } else if (!cache && job->conn == -1 && close(fds.out) == -1) {
+                dlog(LOG_ERR, "[wk#%02d] close: failed to close '%s' (%s)",
+                        wk->id, RQ_PIPE(job->rq), strerror(errno));
             }
 
-            strtoargs(wk->rq.cmd, argv, buf);
+            if (started == 0) {
+                dlog(LOG_ERR, "[wk#%02d] spawn: failed to execute '%s' (%s)",
+                        wk->id, RQ_CMD(job->rq), strerror(errno));
+            } else {
+                if (nstages > 1) {
+                    dlog(LOG_INFO, "[wk#%02d] started job '%s' (%zu/%zu "
+                            "stages)", wk->id, RQ_CMD(job->rq), started,
+                            nstages);
+                } else {
+                    dlog(LOG_INFO, "[wk#%02d] started job '%s'", wk->id,
+                            RQ_CMD(job->rq));
+                }
+                mt_add(g_metrics, MT_STARTED, 1);
+                mt_adjust(g_metrics, MT_RUNNING, 1);
+                mt_record(g_metrics, MT_WAIT, rp.queue);
+
+                /* Le tube est refermé avant l'attente : une commande qui
+                 * écrirait encore après une erreur de lecture se termine */
+                if (flight != NULL) {
+                    if (fl_run(g_flights, flight, rd) == -1) {
+                        dlog(LOG_ERR, "[wk#%02d] fl_run: failed to read "
+                                "output of '%s' (%s)", wk->id,
+                                RQ_CMD(job->rq), strerror(errno));
+                    }
+                    close(rd);
+                    rd = -1;
+                }
+                handed = (!cache && flight == NULL && nstages == 1
+                        && g_runs != NULL
+                        && wkhandoff(wk, pids[0], &tstart) == 0);
+                if (!handed) {
+                    rpwait(wk, pids, nstages, &tstart, &rp);
+                    mt_adjust(g_metrics, MT_RUNNING, -1);
+                }
+            }
 
-            syslog(LOG_INFO, "[wk#%02d] started job '%s'", wk->id, wk->rq.cmd);
-            execvp(argv[0], argv);
-            syslog(LOG_ERR, "[wk#%02d] evecvp: failed to execute '%s' (%s)",
-                wk->id, wk->rq.cmd, strerror(errno));
-            exit(EXIT_FAILURE);
-            break;
+            if (!handed) {
+                dlog(rp.status == 0 ? LOG_INFO : LOG_ERR,
+                        "[wk#%02d] finished job '%s' (%.3fs) with status %d",
+                        wk->id, RQ_CMD(job->rq), (double) rp.wall / 1e9,
+                        rp.status);
+            }
 
-        default:
-            waitpid(pid, &status, 0);
+            if (cache) {
+                wkcache(wk, fds.out, out, &rp);
+                close(fds.out);
+                if (job->conn == -1) {
+                    close(out);
+                }
+            }
         }
 
-        syslog(status == EXIT_SUCCESS ? LOG_INFO : LOG_ERR,
-                "[wk#%02d] finished job '%s' (%lds) with status %d",
-                wk->id, wk->rq.cmd, time(NULL) - tstart, status);
+        /* Les clients rattachés reçoivent la fin de la sortie, puis la même
+         * réponse que le client de la requête */
+        if (flight != NULL) {
+            if (rd != -1) {
+                close(rd);
+            }
+            fl_finish(g_flights, flight);
+            size_t len;
+            const char *output = fl_output(flight, &len);
+            if (output != NULL && !rp.aborted && rqcacheable(job->rq)) {
+                wkstore(wk, output, len, &rp);
+            }
+            size_t n = rqfanout(flight, &rp, rp.aborted ? NULL : &tstart);
+            if (n > 0) {
+                dlog(LOG_INFO, "[wk#%02d] shared job '%s' with %zu other "
+                        "clients", wk->id, RQ_CMD(job->rq), n);
+            }
+        }
 
-        int sig = (status == EXIT_SUCCESS ? SIG_SUCCESS : SIG_FAILURE);
-        if (kill(wk->rq.pid, sig) == -1) {
-            syslog(LOG_ERR, "[wk#%02d] kill: failed to send signal %d (%s)",
-                    wk->id, sig, strerror(errno));
-        } else {
-            syslog(LOG_DEBUG, "[wk#%02d] sent signal %d to %d",
-                    wk->id, sig, wk->rq.pid);
+        if (!handed) {
+            rqdone(job, &rp);
+            rqreply(job, &rp);
+            rqrelease(job);
+            if (g_runs != NULL) {
+                is_push(g_freeruns, wk->run);
+            }
+        }
+
+        /* Le worker est de nouveau libre : il est remis dans g_idle, puis le
+         * thread de répartition est réveillé pour lui confier une éventuelle
+         * requête en attente */
+        mt_adjust(g_metrics, MT_BUSY, -1);
+        is_push(g_idle, (size_t) wk->id);
+        if (sem_post(&g_wakeup) == -1) {
+            dlog(LOG_ERR, "[wk#%02d] sem_post: failed to wake dispatcher",
+                    wk->id);
         }
-        wk->avail = true;
     }
 }
 
-size_t argcount(const char *str) {
-    if (*str == '\0') {
-        return 0;
+void wkcache(struct worker *wk, int tmp, int out, const struct reply *rp) {
+    const struct request *rq = wk->job.rq;
+    struct stat st;
+    if (fstat(tmp, &st) == 0 && st.st_size <= RC_OUTPUT_MAX) {
+        size_t len = (size_t) st.st_size;
+        char *data = len == 0 ? NULL
+            : mmap(NULL, len, PROT_READ, MAP_PRIVATE, tmp, 0);
+        if (data != MAP_FAILED) {
+            wkstore(wk, data, len, rp);
+            if (data != NULL) {
+                munmap(data, len);
+            }
+        }
     }
 
-    size_t n = 1;
-    for (size_t i = 0; i < strlen(str); i++) {
-        if (str[i] == ' ' && str[i - 1] == '-' && str[i - 2] == '-') {
-            n++;
+    if (lseek(tmp, 0, SEEK_SET) == -1
+            || rl_relay(tmp, out, RL_SENDFILE, NULL) == -1) {
+        dlog(LOG_ERR, "[wk#%02d] relay: failed to send output of '%s' (%s)",
+                wk->id, RQ_CMD(rq), strerror(errno));
+    }
+}
+
+void wkstore(struct worker *wk, const char *data, size_t len,
+        const struct reply *rp) {
+    const struct request *rq = wk->job.rq;
+    if (rp->wall == 0 || !WIFEXITED(rp->status) || len > RC_OUTPUT_MAX) {
+        return;
+    }
+    pthread_mutex_lock(&g_cachelock);
+    int ret = rc_insert(g_cache, RQ_KEY(rq), rq->keylen, rp->status, data, len,
+            (long) rq->ttl * 1000);
+    pthread_mutex_unlock(&g_cachelock);
+    if (ret == -1) {
+        dlog(LOG_WARNING, "[wk#%02d] result of '%s' too large for cache",
+                wk->id, RQ_CMD(rq));
+    }
+}
+
+int wkhandoff(struct worker *wk, pid_t pid, const struct timespec *tstart) {
+    int pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1) {
+        dlog(LOG_ERR, "[wk#%02d] pidfd_open: failed to watch %d (%s)",
+                wk->id, pid, strerror(errno));
+        return -1;
+    }
+
+    /* L'emplacement est entièrement rempli avant d'être surveillé : le
+     * thread de récupération peut s'en saisir dès epoll_ctl() */
+    struct run *run = &g_runs[wk->run];
+    run->job = wk->job;
+    run->pid = pid;
+    run->pidfd = pidfd;
+    run->tstart = *tstart;
+
+    /* Les descripteurs du client ne sont plus utiles : le fils en détient
+     * une copie */
+    for (size_t i = 0; i < 3; i++) {
+        if (run->job.fds[i] != -1) {
+            close(run->job.fds[i]);
+            run->job.fds[i] = -1;
+        }
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = wk->run };
+    if (epoll_ctl(g_epoll, EPOLL_CTL_ADD, pidfd, &ev) == -1) {
+        dlog(LOG_ERR, "[wk#%02d] epoll_ctl: failed to watch %d (%s)",
+                wk->id, pid, strerror(errno));
+        run->pid = 0;
+        close(pidfd);
+        memcpy(wk->job.fds, run->job.fds, sizeof(wk->job.fds));
+        return -1;
+    }
+
+    wk->job.rq = NULL;
+    wk->job.conn = -1;
+    return 0;
+}
+
+size_t wkpipeline(struct worker *wk, char *const argv[], size_t nstages,
+        const struct sp_fds *fds, pid_t pids[], const struct timespec *tstart,
+        struct reply *rp) {
+    const struct request *rq = wk->job.rq;
+    struct sp_fds sfds = *fds;
+    char *const *stage = argv;
+    size_t started = 0;
+    rp->nstages = (uint32_t) nstages;
+
+    bool broken = false;
+    for (size_t i = 0; i < nstages; i++) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        rp->stages[i] = (struct stage) {
+            .status = W_EXITCODE(127, 0),
+            .start = (uint64_t) ts_diff_ns(tstart, &now)
+        };
+        pids[i] = -1;
+        if (broken) {
+            continue;
+        }
+
+        /* Chaque étape, sauf la dernière, écrit dans un tube lu par la
+         * suivante. Un tube plus grand que la taille par défaut (16 pages)
+         * réduit le nombre de réveils entre les étapes, et laisse splice()
+         * déplacer davantage de données à la fois */
+        int p[2] = { -1, -1 };
+        sfds.out = fds->out;
+        if (i < nstages - 1) {
+            if (pipe2(p, O_CLOEXEC) == -1) {
+                /* Sans tube, ni cette étape ni les suivantes ne sont
+                 * lancées : la précédente trouve son tube fermé */
+                dlog(LOG_ERR, "[wk#%02d] pipe2: failed to connect stage %zu "
+                        "of '%s', %zu stages not started (%s)", wk->id,
+                        i + 1, RQ_CMD(rq), nstages - i, strerror(errno));
+                if (sfds.in != fds->in) {
+                    close(sfds.in);
+                }
+                broken = true;
+                continue;
+            }
+            if (g_config.PIPE_SIZE > 0 && fcntl(p[1], F_SETPIPE_SZ,
+                        (int) g_config.PIPE_SIZE * 1024) == -1) {
+                dlog(LOG_DEBUG, "[wk#%02d] fcntl: failed to resize pipe of "
+                        "'%s' (%s)", wk->id, RQ_CMD(rq), strerror(errno));
+            }
+            sfds.out = p[1];
+        }
+
+        pids[i] = wkspawn(wk, stage, &sfds);
+        if (pids[i] != -1) {
+            started++;
+        } else if (nstages > 1) {
+            dlog(LOG_ERR, "[wk#%02d] spawn: failed to execute stage %zu of "
+                    "'%s' (%s)", wk->id, i + 1, RQ_CMD(rq), strerror(errno));
+        }
+
+        /* Les extrémités des tubes sont détenues par les étapes lancées */
+        if (sfds.in != fds->in) {
+            close(sfds.in);
+        }
+        if (p[1] != -1) {
+            close(p[1]);
+        }
+        sfds.in = p[0];
+        while (*stage != NULL) {
+            stage++;
+        }
+        stage++;
+    }
+    return started;
+}
+
+pid_t wkspawn(struct worker *wk, char *const argv[],
+        const struct sp_fds *fds) {
+    /* Une commande désignée par un chemin n'est ni un succès ni un échec du
+     * cache */
+    char buf[PATH_MAX];
+    const char *file = NULL;
+    if (g_paths != NULL) {
+        int r = pc_resolve(g_paths, argv[0], buf, sizeof(buf));
+        if (r == 1) {
+            mt_add(g_metrics, MT_PATH_HITS, 1);
+        } else if (r == 0 || errno == ENOENT) {
+            mt_add(g_metrics, MT_PATH_MISSES, 1);
+        }
+        file = (r == -1 ? NULL : buf);
+    }
+
+    pid_t pid = (g_zygote != NULL
+            ? zy_spawn(g_zygote, (size_t) wk->id, file, argv, fds)
+            : sp_spawn(g_config.SPAWN_BACKEND, file, argv, fds));
+    if (pid != -1) {
+        mt_add(g_metrics, MT_PROCESSES, 1);
+    }
+    return pid;
+}
+
+void rpwait(struct worker *wk, const pid_t pids[], size_t n,
+        const struct timespec *tstart, struct reply *rp) {
+    /* Le zygote signale la fin des processus dans l'ordre où elle survient */
+    if (g_zygote != NULL) {
+        size_t left = 0;
+        for (size_t i = 0; i < n; i++) {
+            left += (pids[i] != -1);
+        }
+        while (left > 0) {
+            int status;
+            struct rusage ru;
+            pid_t pid = zy_wait(g_zygote, (size_t) wk->id, &status, &ru);
+            if (pid == -1) {
+                dlog(LOG_ERR, "[wk#%02d] zygote: failed to wait for '%s' "
+                        "(%s)", wk->id, RQ_CMD(wk->job.rq), strerror(errno));
+                return;
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (pids[i] == pid) {
+                    rpfill(status, &ru, tstart, i, rp);
+                    left--;
+                }
+            }
+        }
+        return;
+    }
+
+    /* Les étapes d'un pipeline sont surveillées par leur pidfd : wait4()
+     * sur l'une d'elles ne doit pas retarder la fin des autres. Une étape
+     * qui ne peut être surveillée est attendue une fois les autres
+     * terminées */
+    struct pollfd pfds[n];
+    bool reaped[n];
+    size_t polled = 0;
+    for (size_t i = 0; i < n; i++) {
+        pfds[i] = (struct pollfd) { .fd = -1, .events = POLLIN };
+        reaped[i] = (pids[i] == -1);
+        if (n > 1 && !reaped[i]) {
+            pfds[i].fd = (int) syscall(SYS_pidfd_open, pids[i], 0);
+            polled += (pfds[i].fd != -1);
+        }
+    }
+    while (polled > 0) {
+        if (poll(pfds, (nfds_t) n, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            dlog(LOG_ERR, "[wk#%02d] poll: failed to wait for '%s' (%s)",
+                    wk->id, RQ_CMD(wk->job.rq), strerror(errno));
             break;
         }
-        if (str[i] == ' ') {
-            n++;
-            while (str[i++] == ' ');
+        for (size_t i = 0; i < n; i++) {
+            if (pfds[i].fd != -1 && pfds[i].revents != 0) {
+                close(pfds[i].fd);
+                pfds[i].fd = -1;
+                polled--;
+                rpreap(wk, pids[i], tstart, i, rp);
+                reaped[i] = true;
+            }
         }
     }
 
-    return n;
+    for (size_t i = 0; i < n; i++) {
+        if (pfds[i].fd != -1) {
+            close(pfds[i].fd);
+        }
+        if (!reaped[i]) {
+            rpreap(wk, pids[i], tstart, i, rp);
+        }
+    }
 }
 
-void strtoargs(const char *str, char *argv[], char *buf) {
-    memcpy(buf, str, strlen(str) + 1);
+int rpreap(struct worker *wk, pid_t pid, const struct timespec *tstart,
+        size_t i, struct reply *rp) {
+    int status;
+    struct rusage ru;
+    while (wait4(pid, &status, 0, &ru) == -1) {
+        if (errno != EINTR) {
+            dlog(LOG_ERR, "[wk#%02d] wait4: failed to wait for %d (%s)",
+                    wk->id, pid, strerror(errno));
+            return -1;
+        }
+    }
+    rpfill(status, &ru, tstart, i, rp);
+    return 0;
+}
 
-    size_t i = 0;
-    size_t j = 0;
+void rpfill(int status, const struct rusage *ru, const struct timespec *tstart,
+        size_t i, struct reply *rp) {
+    struct timespec tend;
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+    uint64_t wall = (uint64_t) ts_diff_ns(tstart, &tend);
+
+    struct stage *st = &rp->stages[i];
+    st->status = status;
+    st->wall = wall - st->start;
+    st->utime = (uint64_t) ru->ru_utime.tv_sec * 1000000000
+            + (uint64_t) ru->ru_utime.tv_usec * 1000;
+    st->stime = (uint64_t) ru->ru_stime.tv_sec * 1000000000
+            + (uint64_t) ru->ru_stime.tv_usec * 1000;
+
+    /* Les étapes se terminent dans un ordre quelconque : la réponse cumule
+     * leurs ressources, et la durée de la commande est celle de la dernière
+     * terminée */
+    if (i == rp->nstages - 1) {
+        rp->status = status;
+    }
+    if (wall > rp->wall) {
+        rp->wall = wall;
+    }
+    rp->utime += st->utime;
+    rp->stime += st->stime;
+    if (ru->ru_maxrss > rp->maxrss) {
+        rp->maxrss = ru->ru_maxrss;
+    }
+    rp->nvcsw += ru->ru_nvcsw;
+    rp->nivcsw += ru->ru_nivcsw;
+}
 
-    argv[j++] = buf;
+/* ------------------------------------------------------------------------- */
 
-    while (j < argcount(str)) {
-        if (str[i] == ' ') {
-            buf[i] = 0;
-            argv[j++] = buf + i + 1;
+void *rpstart(void *arg) {
+    (void) arg;
+    struct epoll_event evs[DAEMON_EVENT_MAX];
+    while (1) {
+        int n = epoll_wait(g_epoll, evs, DAEMON_EVENT_MAX, -1);
+        if (n == -1) {
+            if (errno != EINTR) {
+                dlog(LOG_ERR, "[reapr] epoll_wait: failed to wait (%s)",
+                        strerror(errno));
+            }
+            continue;
         }
-        i++;
+
+        /* Un emplacement doit être rendu en entier : cleanup() répond aux
+         * clients des emplacements encore occupés */
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        for (int k = 0; k < n; k++) {
+            size_t i = (size_t) evs[k].data.u64;
+            struct run *run = &g_runs[i];
+
+            /* Le pidfd est lisible une fois le processus terminé : wait4()
+             * ne bloque pas, et le PID ne peut avoir été réutilisé */
+            struct reply rp = {
+                .status = W_EXITCODE(127, 0),
+                .nstages = 1,
+                .stages = { { .status = W_EXITCODE(127, 0) } }
+            };
+            int status;
+            struct rusage ru;
+            if (wait4(run->pid, &status, WNOHANG, &ru) > 0) {
+                rpfill(status, &ru, &run->tstart, 0, &rp);
+                rp.queue = (uint64_t) ts_diff_ns(&run->job.queued,
+                        &run->tstart);
+            } else {
+                dlog(LOG_ERR, "[reapr] wait4: failed to wait for %d (%s)",
+                        run->pid, strerror(errno));
+            }
+            /* Le pidfd peut avoir été dupliqué dans un fils en cours de
+             * création par un worker : sa fermeture ne suffit pas à le
+             * retirer de g_epoll */
+            epoll_ctl(g_epoll, EPOLL_CTL_DEL, run->pidfd, NULL);
+            close(run->pidfd);
+            mt_adjust(g_metrics, MT_RUNNING, -1);
+
+            dlog(rp.status == 0 ? LOG_INFO : LOG_ERR,
+                    "[reapr] finished job '%s' (%.3fs) with status %d",
+                    RQ_CMD(run->job.rq), (double) rp.wall / 1e9, rp.status);
+
+            rqdone(&run->job, &rp);
+            rqreply(&run->job, &rp);
+            rqrelease(&run->job);
+            run->pid = 0;
+            is_push(g_freeruns, i);
+        }
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+
+        if (sem_post(&g_wakeup) == -1) {
+            dlog(LOG_ERR, "[reapr] sem_post: failed to wake dispatcher");
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+int stats(int argc, char *argv[]) {
+    static const struct option longopts[] = {
+        { "watch", optional_argument, NULL, 'w' },
+        { "prometheus", no_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    double period = 0;
+    bool prometheus = false;
+    int c;
+    while ((c = getopt_long(argc, argv, "", longopts, NULL)) != -1) {
+        switch (c) {
+        case 'w':
+            period = STATS_PERIOD_DEFAULT;
+            if (optarg != NULL) {
+                char *end;
+                period = strtod(optarg, &end);
+                if (*end != '\0' || !(period >= 0.1
+                            && period <= STATS_PERIOD_MAX)) {
+                    usage();
+                }
+            }
+            break;
+        case 'p':
+            prometheus = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc || (prometheus && period > 0)) {
+        usage();
     }
 
-    argv[j] = NULL;
+    Metrics m = mt_open(SHM_METRICS);
+    if (m == NULL) {
+        fprintf(stderr, "Error: no instance is running.\n");
+        return EXIT_FAILURE;
+    }
+    if (period == 0) {
+        if (prometheus) {
+            stprometheus(m);
+        } else {
+            stprint(m, NULL, 0);
+        }
+        mt_dispose(&m);
+        return EXIT_SUCCESS;
+    }
+
+    /* La page est rouverte à chaque rafraîchissement : la vue suit un
+     * redémarrage du daemon, et s'arrête avec lui */
+    uint64_t prev[MT_COUNTERS];
+    double prevup = 0;
+    bool first = true;
+    struct timespec delay = {
+        .tv_sec = (time_t) period,
+        .tv_nsec = (long) ((period - (double) (time_t) period) * 1e9)
+    };
+    do {
+        double up = mt_uptime(m);
+        bool rates = (!first && up > prevup);
+        printf("\033[H\033[2J");
+        stprint(m, rates ? prev : NULL, up - prevup);
+        fflush(stdout);
+
+        for (size_t i = 0; i < MT_COUNTERS; i++) {
+            prev[i] = mt_counter(m, (enum mt_counter) i);
+        }
+        prevup = up;
+        first = false;
+        mt_dispose(&m);
+        nanosleep(&delay, NULL);
+    } while ((m = mt_open(SHM_METRICS)) != NULL);
+
+    fprintf(stderr, "Daemon stopped.\n");
+    return EXIT_SUCCESS;
+}
+
+void stprint(Metrics m, const uint64_t prev[MT_COUNTERS], double elapsed) {
+    static const char *counters[MT_REQUESTS] = {
+        "submitted", "rejected", "started", "completed"
+    };
+    static const char *histos[MT_HISTOS] = { "wait", "spawn", "run" };
+
+    printf("uptime     %.1f s\n", mt_uptime(m));
+    printf("requests  ");
+    for (size_t i = 0; i < MT_REQUESTS; i++) {
+        printf(" %s %" PRIu64, counters[i],
+                mt_counter(m, (enum mt_counter) i));
+    }
+    printf("\n");
+    if (prev != NULL) {
+        printf("rate      ");
+        for (size_t i = 0; i < MT_REQUESTS; i++) {
+            uint64_t n = mt_counter(m, (enum mt_counter) i);
+            printf(" %s %.1f/s", counters[i],
+                    (double) (n - prev[i]) / elapsed);
+        }
+        printf("\n");
+    }
+    printf("queue      %" PRId64 " waiting\n", mt_gauge(m, MT_QUEUED));
+    printf("workers    %" PRId64 " busy, %" PRId64 " live\n",
+            mt_gauge(m, MT_BUSY), mt_gauge(m, MT_WORKERS));
+    printf("commands   %" PRId64 " running, %" PRIu64 " processes "
+            "spawned\n", mt_gauge(m, MT_RUNNING),
+            mt_counter(m, MT_PROCESSES));
+    printf("paths      %" PRIu64 " hits, %" PRIu64 " misses\n",
+            mt_counter(m, MT_PATH_HITS), mt_counter(m, MT_PATH_MISSES));
+
+    printf("\n%-10s %10s %10s %10s %10s %10s\n", "(ms)", "count", "p50",
+            "p90", "p99", "max");
+    for (size_t i = 0; i < MT_HISTOS; i++) {
+        struct histo h;
+        mt_histo(m, (enum mt_histo) i, &h);
+        printf("%-10s %10" PRIu64 " %10.3f %10.3f %10.3f %10.3f\n",
+                histos[i], h.count,
+                (double) hi_percentile(&h, 0.50) / 1e6,
+                (double) hi_percentile(&h, 0.90) / 1e6,
+                (double) hi_percentile(&h, 0.99) / 1e6,
+                (double) h.max / 1e6);
+    }
+}
+
+void stprometheus(Metrics m) {
+    static const char *counters[MT_REQUESTS] = {
+        "submitted", "rejected", "started", "completed"
+    };
+    static const char *gauges[MT_GAUGES][2] = {
+        { "cmdld_queue_depth", "Requests waiting for a worker." },
+        { "cmdld_workers_busy", "Workers running a request." },
+        { "cmdld_workers_live", "Worker threads started." },
+        { "cmdld_commands_running", "Commands currently running." }
+    };
+    static const char *histos[MT_HISTOS][2] = {
+        { "cmdld_queue_wait_seconds", "Time spent waiting for a worker." },
+        { "cmdld_spawn_seconds", "Time spent starting commands." },
+        { "cmdld_run_seconds", "Run time of commands." }
+    };
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+
+    printf("# HELP cmdld_uptime_seconds Time since the daemon started.\n"
+            "# TYPE cmdld_uptime_seconds gauge\n"
+            "cmdld_uptime_seconds %.3f\n", mt_uptime(m));
+
+    printf("# HELP cmdld_requests_total Requests by stage.\n"
+            "# TYPE cmdld_requests_total counter\n");
+    for (size_t i = 0; i < MT_REQUESTS; i++) {
+        printf("cmdld_requests_total{stage=\"%s\"} %" PRIu64 "\n",
+                counters[i], mt_counter(m, (enum mt_counter) i));
+    }
+
+    printf("# HELP cmdld_path_lookups_total Command lookups by path cache "
+            "result.\n"
+            "# TYPE cmdld_path_lookups_total counter\n"
+            "cmdld_path_lookups_total{result=\"hit\"} %" PRIu64 "\n"
+            "cmdld_path_lookups_total{result=\"miss\"} %" PRIu64 "\n",
+            mt_counter(m, MT_PATH_HITS), mt_counter(m, MT_PATH_MISSES));
+
+    printf("# HELP cmdld_processes_spawned_total Processes started, one per "
+            "pipeline stage.\n"
+            "# TYPE cmdld_processes_spawned_total counter\n"
+            "cmdld_processes_spawned_total %" PRIu64 "\n",
+            mt_counter(m, MT_PROCESSES));
+
+    for (size_t i = 0; i < MT_GAUGES; i++) {
+        printf("# HELP %s %s\n# TYPE %s gauge\n%s %" PRId64 "\n",
+                gauges[i][0], gauges[i][1], gauges[i][0], gauges[i][0],
+                mt_gauge(m, (enum mt_gauge) i));
+    }
+
+    for (size_t i = 0; i < MT_HISTOS; i++) {
+        struct histo h;
+        mt_histo(m, (enum mt_histo) i, &h);
+        const char *name = histos[i][0];
+        printf("# HELP %s %s\n# TYPE %s summary\n", name, histos[i][1],
+                name);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(*quantiles); q++) {
+            printf("%s{quantile=\"%g\"} %.9f\n", name, quantiles[q],
+                    (double) hi_percentile(&h, quantiles[q]) / 1e9);
+        }
+        printf("%s_sum %.9f\n%s_count %" PRIu64 "\n", name,
+                (double) h.sum / 1e9, name, h.count);
+    }
 }
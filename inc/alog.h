@@ -0,0 +1,85 @@
+/* Le type opaque ALog représente un journal asynchrone : les messages sont
+ * déposés dans un anneau en mémoire et écrits par lots par un thread dédié,
+ * vers syslog ou vers un fichier.
+ *
+ * - Le dépôt d'un message (al_log) ne fait aucun appel système dans le cas
+ * courant et ne prend aucun verrou : chaque case de l'anneau porte un numéro
+ * de séquence atomique, comme l'anneau du module squeue. Un message dont le
+ * niveau est filtré n'est pas mis en forme.
+ * - Le thread d'écriture dort tant que l'anneau est vide. Réveillé par le
+ * premier message déposé, il laisse s'accumuler les suivants pendant
+ * AL_BATCH_DELAY, puis écrit les messages présents en une seule fois
+ * (sendmmsg vers /dev/log, write vers le fichier).
+ * - Un message déposé dans un anneau plein est perdu plutôt que de bloquer
+ * l'appelant. Le nombre de messages perdus est écrit dans le journal.
+ * - Les messages trop longs sont tronqués à AL_MSG_MAX octets.
+ */
+
+#ifndef ALOG__H
+#define ALOG__H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longueur maximale d'un message, au-delà de laquelle il est tronqué */
+#define AL_MSG_MAX 1024
+
+/* Nombre maximal de messages écrits en une fois */
+#define AL_BATCH 64
+
+/* Durée d'accumulation des messages après le réveil du thread d'écriture, en
+ * microsecondes */
+#define AL_BATCH_DELAY 1000
+
+/* Chemin du socket de syslog */
+#define AL_SYSLOG_PATH "/dev/log"
+
+/**
+ * Type opaque pour la manipulation des journaux asynchrones.
+ */
+typedef struct __alog * ALog;
+
+/**
+ * Créé un nouveau journal et lance son thread d'écriture.
+ *
+ * @arg     ident       Le nom du programme, ajouté à chaque message.
+ * @arg     facility    La catégorie syslog des messages (LOG_DAEMON...).
+ * @arg     level       Le niveau (LOG_ERR...) au-delà duquel les messages
+ *                      sont ignorés.
+ * @arg     path        Le fichier dans lequel les messages sont ajoutés, NULL
+ *                      pour les transmettre à syslog.
+ * @arg     capacity    Le nombre de messages de l'anneau.
+ * @return              Un nouvel objet ALog, NULL en cas d'erreur.
+ */
+extern ALog al_create(const char *ident, int facility, int level,
+        const char *path, size_t capacity);
+
+/**
+ * Dépose dans le journal l un message de niveau level, mis en forme comme
+ * pour printf.
+ */
+extern void al_log(ALog l, int level, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * Variante de al_log recevant la liste d'arguments args.
+ */
+extern void al_vlog(ALog l, int level, const char *format, va_list args);
+
+/**
+ * Renvoie le nombre de messages du journal l perdus faute de place dans
+ * l'anneau.
+ */
+extern uint64_t al_dropped(ALog l);
+
+/**
+ * Écrit les messages restants, arrête le thread d'écriture et libère les
+ * ressources allouées pour le journal pointé par lp. Le pointeur lp est fixé
+ * à NULL à la fin de l'opération.
+ *
+ * Les messages déposés pendant l'opération peuvent être perdus.
+ */
+extern void al_dispose(ALog *lp);
+
+#endif
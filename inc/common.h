@@ -2,35 +2,221 @@
 #define COMMON__H
 
 #include <limits.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 /* Nom associé au SHM pour stocker la file */
 #define SHM_QUEUE "/cmdl_shm_queue"
 
-/* Longueur maximale de l'argument aux fonction exec (possiblement définie) */
-#ifndef ARG_MAX
-#define ARG_MAX 2048
-#endif
+/* Nom associé au SHM pour stocker les requêtes */
+#define SHM_ARENA "/cmdl_shm_arena"
+
+/* Nom associé au SHM de la page de métriques du daemon (voir metrics.h) */
+#define SHM_METRICS "/cmdl_shm_metrics"
+
+/* Noms associés aux SHM du cache des résultats (voir rcache.h) */
+#define SHM_CACHE "/cmdl_shm_cache"
+#define SHM_CACHE_ARENA "/cmdl_shm_cache_arena"
+
+/* Chemin du socket de domaine Unix sur lequel le daemon reçoit les requêtes
+ * accompagnées des descripteurs du client */
+#define DAEMON_SOCKET "/tmp/cmdld.sock"
+
+/* Capacité de la zone d'allocation des requêtes, en octets */
+#define REQUEST_ARENA_SIZE (4 * 1024 * 1024)
+
+/* Longueur maximale d'une commande */
+#define REQUEST_CMD_MAX (256 * 1024)
+
+/* Longueur maximale de la clé de cache d'une requête */
+#define REQUEST_KEY_MAX (REQUEST_CMD_MAX + 64 * 1024)
+
+/* Longueur maximale du nom de client d'une requête, '\0' compris */
+#define REQUEST_TENANT_MAX 16
+
+/* Nombre maximal d'étapes du pipeline d'une requête (voir tokenize.h), au
+ * plus ZY_CHILDREN_MAX (voir zygote.h) */
+#define REQUEST_STAGES_MAX 16
 
 /* Longueur maximale pour les noms de chemins (possiblement définie) */
 #ifndef PATH_MAX
 #define PATH_MAX 2048
 #endif
 
-/* Signaux communiquant l'état des requêtes entre le daemon et les clients */
-#define SIG_FAILURE SIGUSR1
-#define SIG_SUCCESS SIGUSR2
+/**
+ * Classes de priorité des requêtes, de la plus prioritaire à la moins
+ * prioritaire (voir jobsched.h).
+ */
+enum rq_priority {
+    RQ_PRIO_HIGH,
+    RQ_PRIO_NORMAL,
+    RQ_PRIO_LOW
+};
+
+/* Nombre de classes de priorité */
+#define RQ_PRIO_COUNT 3
 
 /**
  * Structure représentant une requête.
  *
- * @field   cmd     La commande à exécuter.
- * @field   pipe    Le nom du tube vers lequel rediriger la sortie.
+ * Une requête est un enregistrement de longueur variable : un en-tête de
+ * taille fixe suivi des arguments de la commande, puis des chaînes qu'il
+ * décrit, terminées par '\0'. Elle est allouée dans la zone SHM_ARENA et seul
+ * son décalage transite par la file.
+ *
+ * Les arguments sont découpés par le client (voir tokenize.h) : le worker les
+ * exécute sans analyser à nouveau la commande. Une commande de plusieurs
+ * étapes (pipeline) est exécutée sans shell : le worker lance chaque étape et
+ * les relie par des tubes.
+ *
+ * Une requête envoyée par DAEMON_SOCKET n'a pas de tube (pipelen vaut 0) :
+ * l'en-tête est accompagné des descripteurs de l'entrée, de la sortie et de
+ * l'erreur standard du client (SCM_RIGHTS), suivi des arguments, de la
+ * commande puis de la clé de cache, sans leur '\0' final.
+ *
  * @field   pid     Le PID du client appellant.
+ * @field   cmdlen  La longueur de la commande à exécuter.
+ * @field   argc    Le nombre d'arguments de la commande, séparateurs d'étapes
+ *                  compris.
+ * @field   argslen La longueur des arguments, '\0' compris.
+ * @field   pipelen La longueur du nom du tube vers lequel rediriger la sortie.
+ * @field   prio    La classe de priorité de la requête (enum rq_priority).
+ * @field   uid     L'utilisateur du client. Il est déclaré par le client dans
+ *                  la file partagée, et celui du processus connecté pour une
+ *                  requête reçue par DAEMON_SOCKET.
+ * @field   keylen  La longueur de la clé de cache, 0 si la requête n'est ni
+ *                  mise en cache ni regroupée.
+ * @field   ttl     La durée de validité du résultat mis en cache, en
+ *                  secondes, 0 si le résultat n'est pas mis en cache.
+ * @field   flags   Options de la requête (RQ_COALESCE).
+ * @field   tenant  Le nom du client pour l'ordonnancement équitable, vide si
+ *                  le client est désigné par uid (voir jobsched.h).
+ * @field   reply   Le décalage dans SHM_ARENA de l'emplacement de réponse
+ *                  (struct rpslot) alloué par le client (-1 pour une requête
+ *                  reçue par DAEMON_SOCKET).
+ * @field   replygen    La génération de l'emplacement de réponse (voir
+ *                      sarena.h).
+ * @field   data    Le décalage de chaque argument ou TK_PIPE pour un
+ *                  séparateur d'étapes (argc entiers uint32_t), les
+ *                  arguments, la commande, le nom du tube, puis la clé de
+ *                  cache. La clé est une suite de chaînes terminées par
+ *                  '\0' : l'utilisateur, le répertoire courant et la
+ *                  commande du client, puis chacun des fichiers d'entrée
+ *                  déclarés suivi de sa date de modification et de sa taille
+ *                  (voir cmdl.c).
  */
 struct request {
-    char cmd[ARG_MAX];
-    char pipe[PATH_MAX];
     pid_t pid;
+    uint32_t cmdlen;
+    uint32_t argc;
+    uint32_t argslen;
+    uint32_t pipelen;
+    uint32_t prio;
+    uint32_t uid;
+    uint32_t keylen;
+    uint32_t ttl;
+    uint32_t flags;
+    char tenant[REQUEST_TENANT_MAX];
+    int64_t reply;
+    uint32_t replygen;
+    char data[];
+};
+
+/* La requête est regroupée avec les requêtes identiques en cours (même clé de
+ * cache) : une seule exécution les sert toutes */
+#define RQ_COALESCE 0x1
+
+/* Taille d'une requête selon le nombre et la longueur de ses arguments et la
+ * longueur de ses chaînes */
+#define RQ_SIZE(argc, argslen, cmdlen, pipelen, keylen) \
+    (sizeof(struct request) + (argc) * sizeof(uint32_t) + (argslen) \
+     + (cmdlen) + 1 + (pipelen) + 1 + (keylen) + 1)
+
+/* Accès aux arguments d'une requête : le tableau des décalages, aligné comme
+ * l'en-tête, puis les arguments */
+#define RQ_ARGV(rq) ((uint32_t *) (void *) (rq)->data)
+#define RQ_ARGS(rq) ((rq)->data + (rq)->argc * sizeof(uint32_t))
+
+/* Accès aux chaînes d'une requête */
+#define RQ_CMD(rq) (RQ_ARGS(rq) + (rq)->argslen)
+#define RQ_PIPE(rq) (RQ_CMD(rq) + (rq)->cmdlen + 1)
+#define RQ_KEY(rq) (RQ_PIPE(rq) + (rq)->pipelen + 1)
+
+/**
+ * Structure représentant un élément de la file partagée.
+ *
+ * @field   off     Le décalage de la requête dans SHM_ARENA.
+ * @field   gen     La génération de la requête (voir sarena.h). La requête
+ *                  reste à la charge du client jusqu'à ce que le daemon la
+ *                  défile : si le client se termine avant, elle peut avoir
+ *                  été récupérée par sa_reclaim.
+ */
+struct rqref {
+    uint64_t off;
+    uint32_t gen;
+};
+
+/**
+ * Structure représentant le résultat d'une étape du pipeline d'une requête.
+ *
+ * @field   status  Le statut de l'étape tel que renvoyé par wait4(), celui
+ *                  d'un processus terminé avec le code 127 si elle n'a pas pu
+ *                  être lancée.
+ * @field   start   L'instant de lancement de l'étape, en nanosecondes depuis
+ *                  celui de la première.
+ * @field   wall    La durée d'exécution de l'étape, en nanosecondes (0 si elle
+ *                  n'a pas été lancée).
+ * @field   utime   Le temps processeur utilisateur, en nanosecondes.
+ * @field   stime   Le temps processeur système, en nanosecondes.
+ */
+struct stage {
+    int32_t status;
+    uint64_t start;
+    uint64_t wall;
+    uint64_t utime;
+    uint64_t stime;
+};
+
+/**
+ * Structure représentant la réponse du daemon à une requête : le statut de la
+ * commande et les ressources qu'elle a consommées. Elle est envoyée sur la
+ * connexion du client pour une requête reçue par DAEMON_SOCKET, et écrite dans
+ * son emplacement de réponse (voir rpslot.h) sinon.
+ *
+ * @field   aborted Non nul si la requête a été abandonnée sans être exécutée
+ *                  (les autres champs sont alors indéfinis).
+ * @field   status  Le statut de la commande tel que renvoyé par wait4(). Une
+ *                  commande qui n'a pas pu être lancée a le statut d'un
+ *                  processus terminé avec le code 127. Celui d'un pipeline
+ *                  est le statut de sa dernière étape, comme pour un shell.
+ * @field   queue   La durée d'attente de la requête dans le daemon avant sa
+ *                  prise en charge par un worker, en nanosecondes.
+ * @field   wall    La durée d'exécution de la commande, en nanosecondes,
+ *                  jusqu'à la fin de la dernière étape terminée.
+ * @field   utime   Le temps processeur utilisateur, en nanosecondes.
+ * @field   stime   Le temps processeur système, en nanosecondes.
+ * @field   maxrss  La taille maximale de la mémoire résidente, en Kio (la plus
+ *                  grande des étapes).
+ * @field   nvcsw   Le nombre de changements de contexte volontaires.
+ * @field   nivcsw  Le nombre de changements de contexte involontaires.
+ * @field   nstages Le nombre d'étapes de la commande, 0 si elle n'a pas été
+ *                  exécutée (résultat trouvé dans le cache).
+ * @field   stages  Le résultat de chacune des nstages étapes. Les temps
+ *                  processeur et les changements de contexte de la réponse
+ *                  en sont la somme.
+ */
+struct reply {
+    int32_t aborted;
+    int32_t status;
+    uint64_t queue;
+    uint64_t wall;
+    uint64_t utime;
+    uint64_t stime;
+    int64_t maxrss;
+    int64_t nvcsw;
+    int64_t nivcsw;
+    uint32_t nstages;
+    struct stage stages[REQUEST_STAGES_MAX];
 };
 
 #endif
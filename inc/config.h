@@ -1,16 +1,65 @@
 #ifndef CONFIG__H
 #define CONFIG__H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "jobsched.h"
+#include "spawner.h"
+#include "squeue.h"
+
+/**
+ * Modes d'exécution des commandes.
+ *
+ * EXEC_THREAD  Chaque worker attend la fin de la commande qu'il a lancée : le
+ *              nombre de commandes simultanées est celui des workers.
+ * EXEC_EVENT   Les workers ne font que lancer les commandes, dont la fin est
+ *              attendue par un unique thread (pidfd et epoll) : le nombre de
+ *              commandes simultanées est borné par DAEMON_JOB_MAX.
+ */
+enum exec_mode {
+    EXEC_THREAD,
+    EXEC_EVENT
+};
+
+/* Taille maximale d'une valeur du fichier de configuration */
+#define CONFIG_VALUE_MAX 128
+
 struct config {
     size_t DAEMON_WORKER_MAX;
     size_t REQUEST_QUEUE_MAX;
+    enum sq_engine REQUEST_QUEUE_ENGINE;
+    size_t DAEMON_BACKLOG_MAX;
+    long DAEMON_BACKLOG_TIMEOUT;
+    enum sp_backend SPAWN_BACKEND;
+    bool SPAWN_ZYGOTE;
+    enum exec_mode EXEC_MODE;
+    size_t DAEMON_JOB_MAX;
+    size_t DAEMON_WORKER_MIN;
+    long DAEMON_WORKER_IDLE;
+    enum js_policy DAEMON_PRIORITY_POLICY;
+    long DAEMON_PRIORITY_AGING;
+    size_t DAEMON_TENANT_WORKERS;
+    enum js_order DAEMON_JOB_ORDER;
+    size_t CACHE_SIZE;
+    size_t PIPE_SIZE;
+    int LOG_LEVEL;
+    char LOG_FILE[CONFIG_VALUE_MAX];
+    char HISTORY_FILE[CONFIG_VALUE_MAX];
 };
 
 /**
  * Charge le fichier de configuration filename.
  *
+ * Les options absentes du fichier prennent leur valeur par défaut, à
+ * l'exception de DAEMON_WORKER_MAX et REQUEST_QUEUE_MAX qui sont obligatoires.
+ * LOG_LEVEL est un niveau de syslog (LOG_ERR...), et LOG_FILE un chemin
+ * absolu, vide si les logs sont transmis à syslog. HISTORY_FILE est un chemin
+ * absolu, vide si l'historique des durées est désactivé.
+ *
  * @arg     ptr         Un pointeur vers une struct config.
  * @arg     filename    Le chemin du fichier de configuration.
+ * @return              0 en cas de succès, -1 sinon.
  */
 int config_load(struct config *ptr, const char *filename);
 
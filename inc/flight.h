@@ -0,0 +1,145 @@
+/* Le module flight regroupe les requêtes identiques en cours d'exécution
+ * (single-flight) : une seule exécution de la commande sert tous les clients.
+ *
+ * - Une table (FlTable) associe à chaque clé la requête en cours (Flight)
+ * qui la porte. Le premier client d'une clé crée la requête en cours et en
+ * devient le propriétaire : seule sa requête est exécutée. Les clients
+ * suivants de la même clé y sont rattachés (abonnés) jusqu'à sa fin.
+ * - La sortie de la commande est lue par fl_run, conservée, et écrite vers
+ * la sortie de chaque abonné. Un abonné rattaché en cours d'exécution reçoit
+ * d'abord la sortie déjà produite.
+ * - Au-delà de FL_REPLAY_MAX octets de sortie, la requête en cours est retirée
+ * de la table : les clients suivants de la même clé créent une nouvelle
+ * requête en cours, et la sortie n'est plus conservée au-delà de son écriture
+ * vers les abonnés.
+ * - Les fonctions du module sont synchronisées, et les écritures vers les
+ * abonnés ont lieu hors de tout verrou. Une requête en cours n'est lue (fl_run)
+ * que par un seul thread.
+ */
+
+#ifndef FLIGHT__H
+#define FLIGHT__H
+
+#include <stddef.h>
+
+/* Longueur maximale de la sortie conservée pour les abonnés tardifs */
+#define FL_REPLAY_MAX (16 * 1024 * 1024)
+
+/**
+ * Type opaque pour la manipulation des tables de requêtes en cours.
+ */
+typedef struct __fltable * FlTable;
+
+/**
+ * Type opaque pour la manipulation des requêtes en cours.
+ */
+typedef struct __flight * Flight;
+
+/**
+ * Créé une nouvelle table vide.
+ *
+ * @return  Un nouvel objet FlTable, NULL en cas d'erreur.
+ */
+extern FlTable fl_create(void);
+
+/**
+ * Rattache un abonné à la requête en cours de clé key dans la table t, ou
+ * crée cette requête en cours dont owner est le propriétaire si elle n'existe
+ * pas.
+ *
+ * Une requête en cours à laquelle l'abonné est rattaché peut se terminer dès
+ * le retour de la fonction.
+ *
+ * @arg     key     La clé, de longueur keylen.
+ * @arg     owner   Le propriétaire de la requête en cours si elle est créée.
+ * @arg     out     La sortie de l'abonné, ouverte en écriture et bloquante.
+ *                  En cas de succès, elle appartient à la requête en cours,
+ *                  qui la ferme.
+ * @arg     data    Les données de l'abonné, rendues par fl_detach.
+ * @return          1 si la requête en cours a été créée, 0 si l'abonné a été
+ *                  rattaché à une requête existante, -1 en cas d'erreur.
+ */
+extern int fl_join(FlTable t, const char *key, size_t keylen,
+        const void *owner, int out, void *data);
+
+/**
+ * Recherche dans la table t la requête en cours de clé key dont owner est le
+ * propriétaire.
+ *
+ * Seul le propriétaire d'une requête en cours peut la terminer : elle reste
+ * valide pour l'appelant jusqu'à ce qu'il la termine.
+ *
+ * @return  La requête en cours, NULL si elle est absente ou si elle a un autre
+ *          propriétaire.
+ */
+extern Flight fl_find(FlTable t, const char *key, size_t keylen,
+        const void *owner);
+
+/**
+ * Renvoie le propriétaire de la requête en cours f, par exemple pour
+ * distinguer son abonné des autres lors de fl_detach.
+ */
+extern const void *fl_owner(Flight f);
+
+/**
+ * Lit l'entrée in jusqu'à la fin de fichier et écrit la sortie lue vers les
+ * abonnés de la requête en cours f. Les abonnés rattachés pendant la lecture
+ * reçoivent aussitôt la sortie déjà produite.
+ *
+ * Un abonné dont la sortie ne peut plus être écrite (client terminé) est
+ * ignoré par la suite.
+ *
+ * @return  0 en cas de succès, -1 si la lecture a échoué.
+ */
+extern int fl_run(FlTable t, Flight f, int in);
+
+/**
+ * Retire de la table t la requête en cours f : les clients suivants de sa clé
+ * créent une nouvelle requête en cours. La sortie produite est écrite vers
+ * les abonnés qui ne l'ont pas encore reçue.
+ */
+extern void fl_finish(FlTable t, Flight f);
+
+/**
+ * Renvoie la sortie complète de la requête en cours f.
+ *
+ * @arg     len     Reçoit la longueur de la sortie.
+ * @return          La sortie, NULL si elle n'a pas été conservée en entier
+ *                  (voir FL_REPLAY_MAX).
+ */
+extern const char *fl_output(Flight f, size_t *len);
+
+/**
+ * Détache un abonné de la requête en cours f, terminée par fl_finish, et
+ * ferme sa sortie.
+ *
+ * @arg     data    Reçoit les données de l'abonné.
+ * @return          0 en cas de succès, -1 s'il n'y a plus d'abonné.
+ */
+extern int fl_detach(Flight f, void **data);
+
+/**
+ * Retire de la table t l'une des requêtes en cours restantes (voir
+ * fl_finish), à l'arrêt du programme.
+ *
+ * Doit être appelée une fois arrêtés les autres threads qui utilisent t : le
+ * verrou de t, qu'un thread annulé a pu laisser pris, n'est pas utilisé.
+ *
+ * @return  La requête en cours, NULL si la table est vide.
+ */
+extern Flight fl_drain(FlTable t);
+
+/**
+ * Libère les ressources allouées pour la requête en cours pointée par fp,
+ * dont tous les abonnés ont été détachés. Le pointeur fp est fixé à NULL à la
+ * fin de l'opération.
+ */
+extern void fl_close(Flight *fp);
+
+/**
+ * Libère les ressources allouées pour la table vide pointée par tp. Le
+ * pointeur tp est fixé à NULL à la fin de l'opération.
+ */
+extern void fl_dispose(FlTable *tp);
+
+#endif
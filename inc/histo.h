@@ -0,0 +1,59 @@
+/* Le module histo accumule des durées dans un histogramme afin d'en estimer
+ * les centiles.
+ *
+ * - Les valeurs sont rangées dans des classes dont la largeur croît avec la
+ * valeur : chaque puissance de deux est découpée en 8 classes, si bien qu'un
+ * centile est estimé avec une erreur relative inférieure à 12,5 %, quelle que
+ * soit l'échelle des valeurs.
+ * - Un histogramme occupe une taille fixe et ne fait aucune allocation : il
+ * peut être placé dans une mémoire partagée.
+ * - Les fonctions du module ne sont pas synchronisées.
+ */
+
+#ifndef HISTO__H
+#define HISTO__H
+
+#include <stdint.h>
+
+/* Nombre de classes d'un histogramme */
+#define HI_BUCKETS 496
+
+/**
+ * Structure représentant un histogramme.
+ *
+ * @field   count   Le nombre de valeurs enregistrées.
+ * @field   sum     La somme des valeurs enregistrées.
+ * @field   max     La plus grande valeur enregistrée.
+ * @field   buckets Le nombre de valeurs de chaque classe.
+ */
+struct histo {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HI_BUCKETS];
+};
+
+/**
+ * Vide l'histogramme h.
+ */
+extern void hi_reset(struct histo *h);
+
+/**
+ * Enregistre la valeur v dans l'histogramme h.
+ */
+extern void hi_record(struct histo *h, uint64_t v);
+
+/**
+ * Renvoie l'indice de la classe de la valeur v, inférieur à HI_BUCKETS.
+ */
+extern unsigned hi_bucket(uint64_t v);
+
+/**
+ * Estime le centile q (compris entre 0 et 1) des valeurs de l'histogramme h.
+ *
+ * @return  La borne supérieure de la classe contenant le centile, bornée par
+ *          la plus grande valeur enregistrée, 0 si h est vide.
+ */
+extern uint64_t hi_percentile(const struct histo *h, double q);
+
+#endif
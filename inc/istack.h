@@ -0,0 +1,60 @@
+/* Le type opaque IStack représente une pile d'indices sans verrou.
+ *
+ * - La pile contient des indices compris entre 0 et une borne précisée à sa
+ * création, chacun au plus une fois.
+ * - Les fonctions is_push et is_pop peuvent être appelées simultanément par
+ * plusieurs threads d'un même processus, en temps constant.
+ * - Un indice dépilé par un thread devient visible, avec toutes les écritures
+ * qui ont précédé son empilement, au thread qui le dépile.
+ */
+
+#ifndef ISTACK__H
+#define ISTACK__H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Type opaque pour la manipulation des piles d'indices.
+ */
+typedef struct __istack * IStack;
+
+/**
+ * Créé une nouvelle pile d'indices vide.
+ *
+ * @arg     n   La borne (exclue) des indices de la pile.
+ * @return      Un nouvel objet IStack, NULL en cas d'erreur.
+ */
+extern IStack is_create(size_t n);
+
+/**
+ * Empile l'indice i sur la pile s.
+ *
+ * @arg     s   La pile à utiliser.
+ * @arg     i   Un indice absent de la pile et inférieur à sa borne.
+ */
+extern void is_push(IStack s, size_t i);
+
+/**
+ * Dépile un indice de la pile s.
+ *
+ * @arg     s   La pile à utiliser.
+ * @return      L'indice dépilé, -1 si la pile est vide.
+ */
+extern ssize_t is_pop(IStack s);
+
+/**
+ * Renvoie le nombre d'indices présents dans la pile s.
+ *
+ * La valeur n'est qu'indicative si la pile est modifiée en parallèle.
+ */
+extern size_t is_length(IStack s);
+
+/**
+ * Libère les ressources allouées pour la pile pointée par sp.
+ *
+ * Le pointeur sp est fixé à NULL à la fin de l'opération.
+ */
+extern void is_dispose(IStack *sp);
+
+#endif
@@ -0,0 +1,230 @@
+/* Le type opaque JobSched représente la file d'attente des travaux du daemon.
+ *
+ * - Les travaux y patientent entre leur réception par le daemon et leur prise
+ * en charge par un worker.
+ * - La file est bornée : sa longueur maximale (toutes classes confondues) est
+ * précisée à sa création.
+ * - Chaque classe de priorité (enum rq_priority) a sa propre file. La classe
+ * servie est choisie selon la politique de la file (enum js_policy), et un
+ * travail qui attend depuis plus longtemps que le délai de vieillissement est
+ * servi avant tous les autres, ce qui évite la famine des classes les moins
+ * prioritaires (et des travaux les plus longs avec JS_SJF).
+ * - Au sein d'une classe, chaque client (voir js_push()) a sa propre file,
+ * dans l'ordre de la file (enum js_order). Les clients sont servis à tour de
+ * rôle selon leur déficit (deficit round robin) : à chaque tour, un client
+ * reçoit JS_QUANTUM de crédit, et chaque travail servi lui coûte son coût
+ * estimé. Un client qui soumet de nombreux travaux ne retarde donc pas ceux
+ * des autres clients.
+ * - Le nombre de travaux en cours d'un même client peut être borné : les
+ * travaux d'un client qui a atteint la borne attendent que l'un des siens se
+ * termine (voir js_done()).
+ * - La durée d'attente des travaux retirés est enregistrée par classe.
+ * - Les fonctions du module ne sont pas synchronisées : il revient à
+ * l'appelant d'assurer l'exclusion mutuelle si la file est partagée entre
+ * plusieurs threads.
+ */
+
+#ifndef JOBSCHED__H
+#define JOBSCHED__H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "common.h"
+#include "histo.h"
+
+/**
+ * Politiques de choix de la classe servie.
+ *
+ * JS_STRICT    La classe la plus prioritaire parmi celles qui ont des travaux.
+ * JS_WEIGHTED  Tourniquet pondéré : à chaque tour, chaque classe est servie
+ *              au plus autant de fois que son poids (JS_WEIGHT_*), les plus
+ *              prioritaires d'abord.
+ */
+enum js_policy {
+    JS_STRICT,
+    JS_WEIGHTED
+};
+
+/**
+ * Ordres des travaux dans la file d'un client.
+ *
+ * JS_FIFO  L'ordre d'arrivée.
+ * JS_SJF   Le plus court d'abord (coût estimé croissant), ce qui réduit la
+ *          durée moyenne de traitement des requêtes.
+ * JS_LJF   Le plus long d'abord (coût estimé décroissant), ce qui réduit la
+ *          durée totale de traitement d'un lot de requêtes.
+ *
+ * À coût égal, les travaux restent dans leur ordre d'arrivée.
+ */
+enum js_order {
+    JS_FIFO,
+    JS_SJF,
+    JS_LJF
+};
+
+/* Poids des classes de priorité pour JS_WEIGHTED */
+#define JS_WEIGHT_HIGH 4
+#define JS_WEIGHT_NORMAL 2
+#define JS_WEIGHT_LOW 1
+
+/* Crédit accordé à chaque client par tour, dans l'unité du coût des travaux
+ * (millisecondes d'exécution estimées) */
+#define JS_QUANTUM 100
+
+/* Coût d'un travail dont la durée d'exécution n'est pas estimée */
+#define JS_COST_DEFAULT JS_QUANTUM
+
+/* Coût maximal d'un travail : le coût d'un travail plus long est ramené à
+ * cette valeur, ce qui borne le nombre de tours nécessaires pour le servir */
+#define JS_COST_MAX (64 * JS_QUANTUM)
+
+/**
+ * Structure représentant un travail en attente.
+ *
+ * @field   rq          La requête à exécuter.
+ * @field   conn        La connexion du client si la requête a été reçue par
+ *                      DAEMON_SOCKET, -1 si elle provient de la file partagée.
+ * @field   fds         L'entrée, la sortie et l'erreur standard du client
+ *                      (si conn est valide), -1 sinon.
+ * @field   queued      L'instant de réception de la requête (CLOCK_MONOTONIC).
+ * @field   deadline    L'instant au-delà duquel la requête est abandonnée si
+ *                      elle n'a pas été prise en charge, ou { 0, 0 } si elle
+ *                      peut attendre indéfiniment.
+ * @field   cost        Le coût estimé du travail, 0 pour JS_COST_DEFAULT.
+ * @field   tenant      L'indice du client du travail dans la file, renseigné
+ *                      par la file.
+ */
+struct job {
+    struct request *rq;
+    int conn;
+    int fds[3];
+    struct timespec queued;
+    struct timespec deadline;
+    uint32_t cost;
+    size_t tenant;
+};
+
+/**
+ * Type opaque pour la manipulation des files d'attente.
+ */
+typedef struct __jobsched * JobSched;
+
+/**
+ * Créé une nouvelle file d'attente vide.
+ *
+ * @arg     max_length  La longueur maximale de la file.
+ * @arg     max_running Le nombre maximal de travaux retirés de la file et non
+ *                      encore terminés.
+ * @arg     policy      La politique de choix de la classe servie.
+ * @arg     order       L'ordre des travaux dans la file d'un client.
+ * @arg     aging       Le délai de vieillissement en millisecondes, 0 pour
+ *                      aucun.
+ * @arg     tenant_max  Le nombre maximal de travaux en cours d'un même
+ *                      client, 0 pour aucune borne.
+ * @return              Un nouvel objet JobSched, NULL en cas d'erreur.
+ */
+extern JobSched js_create(size_t max_length, size_t max_running,
+        enum js_policy policy, enum js_order order, long aging,
+        size_t tenant_max);
+
+/**
+ * Ajoute le travail job à la file s, dans la classe job->rq->prio (une classe
+ * invalide est ramenée à RQ_PRIO_NORMAL).
+ *
+ * Le client du travail est désigné par job->rq->tenant s'il n'est pas vide,
+ * par job->rq->uid sinon.
+ *
+ * @return  0 en cas de succès, -1 si la file est pleine.
+ */
+extern int js_push(JobSched s, const struct job *job);
+
+/**
+ * Indique si un travail de la file s peut être retiré par js_pop() : la file
+ * n'est pas vide et tous ses travaux n'appartiennent pas à des clients qui ont
+ * atteint leur borne.
+ */
+extern bool js_ready(JobSched s);
+
+/**
+ * Retire de la file s le prochain travail à exécuter et le copie dans job.
+ *
+ * Si now n'est pas NULL, le vieillissement des travaux est pris en compte et
+ * la durée d'attente du travail jusqu'à now est enregistrée.
+ *
+ * Le travail est compté parmi les travaux en cours de son client jusqu'à
+ * l'appel de js_done().
+ *
+ * @return  0 en cas de succès, -1 si la file est vide ou si tous ses
+ *          travaux appartiennent à des clients qui ont atteint leur borne.
+ */
+extern int js_pop(JobSched s, const struct timespec *now, struct job *job);
+
+/**
+ * Retire de la file s un travail quelconque et le copie dans job, sans tenir
+ * compte des bornes des clients. Le travail n'est pas compté parmi les
+ * travaux en cours.
+ *
+ * @return  0 en cas de succès, -1 si la file est vide.
+ */
+extern int js_drain(JobSched s, struct job *job);
+
+/**
+ * Signale la fin du travail job, retiré de la file s par js_pop().
+ */
+extern void js_done(JobSched s, const struct job *job);
+
+/**
+ * Retire de la file s un travail dont l'échéance est dépassée à l'instant now
+ * et le copie dans job.
+ *
+ * @return  0 si un tel travail a été trouvé, -1 sinon.
+ */
+extern int js_expire(JobSched s, const struct timespec *now, struct job *job);
+
+/**
+ * Copie dans ts la plus proche échéance des travaux de la file s.
+ *
+ * @return  0 en cas de succès, -1 si aucun travail n'a d'échéance.
+ */
+extern int js_deadline(JobSched s, struct timespec *ts);
+
+/**
+ * Renvoie la longueur courante de la file s.
+ */
+extern size_t js_length(JobSched s);
+
+/**
+ * Renvoie l'histogramme des durées d'attente, en nanosecondes, des travaux de
+ * la classe prio retirés de la file s.
+ */
+extern const struct histo *js_waits(JobSched s, enum rq_priority prio);
+
+/**
+ * Libère les ressources allouées pour la file pointée par sp.
+ *
+ * Les travaux encore présents ne sont pas libérés. Le pointeur sp est fixé à
+ * NULL à la fin de l'opération.
+ */
+extern void js_dispose(JobSched *sp);
+
+/**
+ * Compare les instants a et b.
+ *
+ * @return  Un entier négatif, nul ou positif selon que a est antérieur,
+ *          égal ou postérieur à b.
+ */
+extern int ts_cmp(const struct timespec *a, const struct timespec *b);
+
+/**
+ * Renvoie l'instant ts décalé de ms millisecondes.
+ */
+extern struct timespec ts_add_ms(struct timespec ts, long ms);
+
+/**
+ * Renvoie la durée écoulée de a à b, en nanosecondes.
+ */
+extern long long ts_diff_ns(const struct timespec *a, const struct timespec *b);
+
+#endif
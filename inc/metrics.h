@@ -0,0 +1,136 @@
+/* Le type opaque Metrics représente la page de métriques du daemon, partagée
+ * en mémoire avec les processus qui la consultent (cmdld stats).
+ *
+ * - La page contient des compteurs, des jauges et des histogrammes de durées
+ * (voir histo.h), dans un objet SHM de taille fixe.
+ * - Chaque mise à jour est une opération atomique, sans verrou : les threads du
+ * daemon écrivent la page en concurrence, et les lecteurs la consultent sans
+ * jamais les ralentir. Une lecture est cohérente pour chaque valeur, pas pour
+ * la page entière.
+ */
+
+#ifndef METRICS__H
+#define METRICS__H
+
+#include <stdint.h>
+
+#include "histo.h"
+
+/**
+ * Compteurs de la page : le nombre de requêtes reçues, abandonnées sans être
+ * exécutées, lancées et terminées (y compris les clients servis par une
+ * requête regroupée), puis le nombre de commandes dont le fichier a été
+ * trouvé dans le cache des chemins ou a dû être cherché dans PATH (voir
+ * pcache.h), et le nombre de processus lancés (un par étape d'un pipeline).
+ */
+enum mt_counter {
+    MT_SUBMITTED,
+    MT_REJECTED,
+    MT_STARTED,
+    MT_COMPLETED,
+    MT_PATH_HITS,
+    MT_PATH_MISSES,
+    MT_PROCESSES
+};
+
+/* Nombre de compteurs, dont les MT_REQUESTS premiers comptent les requêtes */
+#define MT_COUNTERS 7
+#define MT_REQUESTS 4
+
+/**
+ * Jauges de la page : le nombre de requêtes en attente d'un worker, de
+ * workers occupés, de workers lancés et de commandes en cours (qui, en mode
+ * event, n'occupent plus de worker).
+ */
+enum mt_gauge {
+    MT_QUEUED,
+    MT_BUSY,
+    MT_WORKERS,
+    MT_RUNNING
+};
+
+/* Nombre de jauges */
+#define MT_GAUGES 4
+
+/**
+ * Histogrammes de la page, en nanosecondes : l'attente d'un worker, le
+ * lancement et l'exécution des commandes.
+ */
+enum mt_histo {
+    MT_WAIT,
+    MT_SPAWN,
+    MT_RUN
+};
+
+/* Nombre d'histogrammes */
+#define MT_HISTOS 3
+
+/**
+ * Type opaque pour la manipulation des pages de métriques.
+ */
+typedef struct __metrics * Metrics;
+
+/**
+ * Créé une nouvelle page de métriques nulles.
+ *
+ * @arg     shm_name    Le nom unique de l'objet SHM de la page.
+ * @return              Un nouvel objet Metrics, NULL en cas d'erreur.
+ */
+extern Metrics mt_empty(const char *shm_name);
+
+/**
+ * Ouvre en lecture seule une page de métriques existante.
+ *
+ * @arg     shm_name    Le nom de l'objet SHM de la page.
+ * @return              Un objet Metrics, NULL en cas d'erreur.
+ */
+extern Metrics mt_open(const char *shm_name);
+
+/**
+ * Ajoute n au compteur c de la page m.
+ */
+extern void mt_add(Metrics m, enum mt_counter c, uint64_t n);
+
+/**
+ * Fixe à v la jauge g de la page m.
+ */
+extern void mt_set(Metrics m, enum mt_gauge g, int64_t v);
+
+/**
+ * Ajoute d, éventuellement négatif, à la jauge g de la page m.
+ */
+extern void mt_adjust(Metrics m, enum mt_gauge g, int64_t d);
+
+/**
+ * Enregistre la durée v dans l'histogramme h de la page m.
+ */
+extern void mt_record(Metrics m, enum mt_histo h, uint64_t v);
+
+/**
+ * Renvoie la valeur du compteur c de la page m.
+ */
+extern uint64_t mt_counter(Metrics m, enum mt_counter c);
+
+/**
+ * Renvoie la valeur de la jauge g de la page m.
+ */
+extern int64_t mt_gauge(Metrics m, enum mt_gauge g);
+
+/**
+ * Copie l'histogramme h de la page m dans out.
+ */
+extern void mt_histo(Metrics m, enum mt_histo h, struct histo *out);
+
+/**
+ * Renvoie la durée écoulée depuis la création de la page m, en secondes.
+ */
+extern double mt_uptime(Metrics m);
+
+/**
+ * Libère les ressources allouées pour la page pointée par mp. L'objet SHM est
+ * supprimé si la page a été créée par mt_empty. Le pointeur mp est fixé à
+ * NULL à la fin de l'opération.
+ */
+extern void mt_dispose(Metrics *mp);
+
+#endif
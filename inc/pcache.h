@@ -0,0 +1,70 @@
+/* Le type opaque PCache représente un cache des chemins des commandes : il
+ * associe un nom de commande au fichier exécutable que execvp() trouverait
+ * dans les répertoires de PATH, afin de l'exécuter directement avec execve()
+ * plutôt que d'essayer chaque répertoire à chaque lancement.
+ *
+ * - Les répertoires de PATH sont surveillés avec inotify par un thread
+ * dédié : toute création, suppression, renommage ou changement de droits
+ * dans l'un d'eux vide le cache.
+ * - Le cache ne conserve que des chemins, pas de descripteurs : le fichier
+ * peut être exécuté dans un autre processus (zygote), et un script (#!) reste
+ * exécutable par execve(). Un chemin périmé n'est pas une erreur pour
+ * l'appelant, qui se rabat sur execvp() (voir spawner.h).
+ * - Un répertoire de PATH absent à la création du cache n'est pas surveillé.
+ * Seuls les répertoires absolus sont admis : une commande que execvp()
+ * chercherait d'abord dans un répertoire relatif n'est pas mise en cache.
+ * - Les fonctions peuvent être appelées par plusieurs threads à la fois.
+ */
+
+#ifndef PCACHE__H
+#define PCACHE__H
+
+#include <stddef.h>
+
+/* Nombre d'emplacements de la table. Elle est vidée lorsqu'elle est remplie
+ * aux trois quarts */
+#define PC_SLOTS 512
+
+/* Valeur de PATH utilisée lorsqu'elle n'est pas définie (comme execvp) */
+#define PC_PATH_DEFAULT "/bin:/usr/bin"
+
+/**
+ * Type opaque pour la manipulation des caches de chemins.
+ */
+typedef struct __pcache * PCache;
+
+/**
+ * Créé un cache vide pour les répertoires de path et lance son thread de
+ * surveillance.
+ *
+ * @arg     path    La liste des répertoires, séparés par ':', ou NULL pour
+ *                  PC_PATH_DEFAULT.
+ * @return          Un nouvel objet PCache, NULL en cas d'erreur.
+ */
+extern PCache pc_create(const char *path);
+
+/**
+ * Recherche le fichier exécutable de la commande name et copie son chemin
+ * dans file.
+ *
+ * @arg     pc      Le cache.
+ * @arg     name    Le nom de la commande (argv[0]).
+ * @arg     file    Reçoit le chemin du fichier.
+ * @arg     size    La taille de file.
+ * @return          1 si le chemin a été trouvé dans le cache, 0 s'il vient
+ *                  d'être résolu (et ajouté au cache), -1 s'il ne peut pas
+ *                  l'être : errno vaut ENOENT si la commande est introuvable,
+ *                  EINVAL si name contient '/' ou si sa recherche passe par
+ *                  un répertoire relatif, ENAMETOOLONG si le chemin dépasse
+ *                  size.
+ */
+extern int pc_resolve(PCache pc, const char *name, char *file, size_t size);
+
+/**
+ * Arrête le thread de surveillance et libère les ressources allouées pour le
+ * cache pointé par pcp. Le pointeur pcp est fixé à NULL à la fin de
+ * l'opération.
+ */
+extern void pc_dispose(PCache *pcp);
+
+#endif
@@ -0,0 +1,88 @@
+/* Le type opaque RCache représente un cache partagé des résultats des
+ * commandes : leur sortie standard et leur statut.
+ *
+ * - Le cache est composé d'un index de RC_ENTRIES entrées, dans un objet SHM,
+ * et d'une zone d'allocation partagée (voir sarena.h) qui contient la clé et
+ * la sortie de chaque entrée. La capacité de cette zone borne la taille du
+ * cache.
+ * - Une entrée est identifiée par sa clé, une suite d'octets quelconque
+ * comparée en entier : deux clés de même empreinte ne sont pas confondues.
+ * - Une entrée expire au bout de la durée donnée à son insertion. Lorsque la
+ * place manque, les entrées expirées puis les moins récemment consultées sont
+ * évincées (LRU).
+ * - Un seul processus écrit dans le cache (rc_insert), sans que les lecteurs
+ * (rc_lookup) ne prennent de verrou : chaque écriture est encadrée par un
+ * compteur de séquence (seqlock), et une lecture concurrente d'une écriture
+ * est recommencée. Les appels à rc_insert doivent être synchronisés par
+ * l'appelant.
+ */
+
+#ifndef RCACHE__H
+#define RCACHE__H
+
+#include <stddef.h>
+
+/* Nombre d'entrées de l'index */
+#define RC_ENTRIES 4096
+
+/* Longueur maximale de la sortie d'une entrée */
+#define RC_OUTPUT_MAX (1024 * 1024)
+
+/**
+ * Type opaque pour la manipulation des caches.
+ */
+typedef struct __rcache * RCache;
+
+/**
+ * Créé un nouveau cache vide.
+ *
+ * @arg     shm_name    Le nom unique de l'objet SHM de l'index.
+ * @arg     arena_name  Le nom unique de l'objet SHM de la zone d'allocation.
+ * @arg     size        La capacité de la zone d'allocation, en octets.
+ * @return              Un nouvel objet RCache, NULL en cas d'erreur.
+ */
+extern RCache rc_empty(const char *shm_name, const char *arena_name,
+        size_t size);
+
+/**
+ * Ouvre un cache existant.
+ *
+ * @arg     shm_name    Le nom de l'objet SHM de l'index.
+ * @arg     arena_name  Le nom de l'objet SHM de la zone d'allocation.
+ * @return              Un objet RCache, NULL en cas d'erreur.
+ */
+extern RCache rc_open(const char *shm_name, const char *arena_name);
+
+/**
+ * Recherche dans le cache c l'entrée de clé key, de longueur keylen.
+ *
+ * En cas de succès, l'entrée est marquée comme consultée.
+ *
+ * @arg     status  Reçoit le statut enregistré avec l'entrée.
+ * @arg     out     Reçoit une copie de la sortie de l'entrée, à libérer avec
+ *                  free().
+ * @arg     outlen  Reçoit la longueur de la sortie.
+ * @return          0 en cas de succès, -1 si l'entrée est absente ou expirée
+ *                  (ou si le cache est modifié sans relâche pendant la
+ *                  recherche).
+ */
+extern int rc_lookup(RCache c, const char *key, size_t keylen, int *status,
+        char **out, size_t *outlen);
+
+/**
+ * Insère dans le cache c, ou remplace, l'entrée de clé key associée au statut
+ * status et à la sortie out de longueur outlen, valide pendant ttl
+ * millisecondes.
+ *
+ * @return  0 en cas de succès, -1 si l'entrée est trop grande pour le cache.
+ */
+extern int rc_insert(RCache c, const char *key, size_t keylen, int status,
+        const char *out, size_t outlen, long ttl);
+
+/**
+ * Libère les ressources allouées pour le cache pointé par cp, créé par
+ * rc_empty. Le pointeur cp est fixé à NULL à la fin de l'opération.
+ */
+extern void rc_dispose(RCache *cp);
+
+#endif
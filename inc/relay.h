@@ -0,0 +1,45 @@
+/* Le module relay transfère le contenu d'un descripteur vers un autre jusqu'à
+ * la fin de fichier.
+ *
+ * - Le transfert est effectué autant que possible par le noyau (splice() ou
+ * sendfile()), sans recopie des données en espace utilisateur.
+ * - Lorsqu'aucune des deux extrémités ne le permet (un terminal par exemple),
+ * les données sont recopiées par une boucle read()/write().
+ */
+
+#ifndef RELAY__H
+#define RELAY__H
+
+#include <sys/types.h>
+
+/**
+ * Méthodes de transfert, de la plus efficace à la moins efficace.
+ *
+ * RL_SPLICE    splice() : l'une des extrémités doit être un tube.
+ * RL_SENDFILE  sendfile() : l'entrée doit pouvoir être projetée en mémoire
+ *              (la plupart des systèmes de fichiers).
+ * RL_COPY      read() puis write() par l'intermédiaire d'un tampon.
+ */
+enum rl_method {
+    RL_SPLICE,
+    RL_SENDFILE,
+    RL_COPY
+};
+
+/**
+ * Transfère le contenu de in vers out jusqu'à la fin de fichier de in.
+ *
+ * Le transfert débute avec la méthode first. Si une méthode n'est pas
+ * supportée par les descripteurs, la méthode suivante est utilisée pour le
+ * reste du transfert (aucune donnée n'est perdue lors d'un changement).
+ *
+ * @arg     in      Le descripteur d'entrée, ouvert en lecture.
+ * @arg     out     Le descripteur de sortie, ouvert en écriture.
+ * @arg     first   La première méthode à essayer.
+ * @arg     used    Si non NULL, reçoit la dernière méthode utilisée.
+ * @return          Le nombre d'octets transférés, -1 en cas d'erreur.
+ */
+extern ssize_t rl_relay(int in, int out, enum rl_method first,
+        enum rl_method *used);
+
+#endif
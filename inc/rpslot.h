@@ -0,0 +1,79 @@
+/* Le module rpslot gère les emplacements de réponse des requêtes de la file
+ * partagée.
+ *
+ * - Un emplacement est alloué par le client dans SHM_ARENA avec chaque
+ * requête. Le daemon y écrit la réponse puis publie l'état de la requête, sur
+ * lequel le client attend (futex partagé).
+ * - L'emplacement a deux détenteurs, le client et le daemon, qui l'abandonnent
+ * chacun avec rs_release une fois leur rôle terminé : le dernier le libère. La
+ * part d'un client terminé sans l'abandonner est récupérée par sa_reclaim
+ * (voir sarena.h).
+ * - Un emplacement occupe un nombre fixe de blocs de la zone d'allocation.
+ * - Aucun signal n'est échangé : le client peut être une bibliothèque au sein
+ * d'un processus qui utilise déjà SIGUSR1 et SIGUSR2.
+ */
+
+#ifndef RPSLOT__H
+#define RPSLOT__H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/* États d'un emplacement de réponse */
+#define RS_PENDING 0    /* La requête est en attente ou en cours d'exécution */
+#define RS_DONE 1       /* La réponse est disponible */
+#define RS_ABORTED 2    /* La requête a été abandonnée */
+
+/* Détenteurs d'un emplacement de réponse */
+#define RS_CLIENT 0x1
+#define RS_DAEMON 0x2
+
+/**
+ * Structure représentant un emplacement de réponse.
+ *
+ * @field   state   L'état de la requête, utilisé comme futex.
+ * @field   owners  Les détenteurs de l'emplacement (RS_CLIENT, RS_DAEMON).
+ * @field   rp      La réponse, valide lorsque state vaut RS_DONE.
+ */
+struct rpslot {
+    _Atomic uint32_t state;
+    _Atomic uint32_t owners;
+    struct reply rp;
+};
+
+/**
+ * Initialise l'emplacement s à l'état RS_PENDING, détenu par le client et
+ * par le daemon.
+ */
+extern void rs_init(struct rpslot *s);
+
+/**
+ * Écrit la réponse rp dans l'emplacement s, publie l'état RS_DONE (ou
+ * RS_ABORTED si rp->aborted est non nul) et réveille le client.
+ *
+ * Le client peut lire la réponse dès l'opération terminée. L'appelant
+ * abandonne ensuite l'emplacement avec rs_release.
+ */
+extern void rs_post(struct rpslot *s, const struct reply *rp);
+
+/**
+ * Attend que l'emplacement s quitte l'état RS_PENDING et copie la réponse
+ * dans rp (rp->aborted est non nul si la requête a été abandonnée).
+ *
+ * @return  0 en cas de succès, -1 en cas d'erreur.
+ */
+extern int rs_wait(struct rpslot *s, struct reply *rp);
+
+/**
+ * Abandonne la part owner (RS_CLIENT ou RS_DAEMON) de l'emplacement s, qui ne
+ * doit plus être accédé ensuite par l'appelant.
+ *
+ * @return  true si l'appelant était le dernier détenteur et doit libérer
+ *          l'emplacement, false sinon.
+ */
+extern bool rs_release(struct rpslot *s, uint32_t owner);
+
+#endif
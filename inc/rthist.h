@@ -0,0 +1,71 @@
+/* Le type opaque RtHist représente un historique persistant des durées
+ * d'exécution des commandes.
+ *
+ * - L'historique est une table de taille fixe projetée en mémoire depuis un
+ * fichier : il survit à l'arrêt du daemon sans opération de sauvegarde.
+ * - Une commande est identifiée par sa forme normalisée : le nom de base de
+ * son premier mot (argv[0] sans son chemin) suivi de ses arguments, séparés
+ * par une seule espace. "/bin/sleep  1" et "sleep 1" sont ainsi une même
+ * commande.
+ * - La durée de chaque commande est résumée par une moyenne et une variance
+ * mobiles exponentielles (EWMA) de coefficient RH_ALPHA : les exécutions
+ * récentes comptent davantage que les anciennes.
+ * - Lorsque les emplacements possibles d'une commande sont tous occupés, celui
+ * qui a été mis à jour le moins récemment est réutilisé.
+ * - Les fonctions du module ne sont pas synchronisées.
+ */
+
+#ifndef RTHIST__H
+#define RTHIST__H
+
+#include <stddef.h>
+
+/* Coefficient des moyennes mobiles */
+#define RH_ALPHA 0.125
+
+/* Nombre d'emplacements de la table */
+#define RH_SLOTS 4096
+
+/**
+ * Type opaque pour la manipulation des historiques.
+ */
+typedef struct __rthist * RtHist;
+
+/**
+ * Ouvre l'historique enregistré dans le fichier path, qui est créé s'il
+ * n'existe pas. Un fichier qui ne contient pas un historique valide est
+ * réinitialisé.
+ *
+ * Le chemin ne doit pas être un lien symbolique, et le fichier doit être un
+ * fichier ordinaire sans autre lien, appartenant à l'utilisateur effectif du
+ * processus.
+ *
+ * @arg     path    Le chemin du fichier.
+ * @return          Un nouvel objet RtHist, NULL en cas d'erreur (errno vaut
+ *                  EPERM si le fichier n'est pas accepté).
+ */
+extern RtHist rh_open(const char *path);
+
+/**
+ * Estime la durée d'exécution de la commande cmd d'après l'historique h.
+ *
+ * @arg     mean    La durée moyenne, en millisecondes.
+ * @arg     stddev  L'écart type de la durée, en millisecondes.
+ * @return          0 en cas de succès, -1 si la commande est inconnue.
+ */
+extern int rh_estimate(RtHist h, const char *cmd, double *mean,
+        double *stddev);
+
+/**
+ * Enregistre dans l'historique h une exécution de la commande cmd d'une durée
+ * de wall nanosecondes.
+ */
+extern void rh_record(RtHist h, const char *cmd, unsigned long long wall);
+
+/**
+ * Ferme l'historique pointé par hp. Le pointeur hp est fixé à NULL à la fin de
+ * l'opération.
+ */
+extern void rh_dispose(RtHist *hp);
+
+#endif
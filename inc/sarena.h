@@ -0,0 +1,131 @@
+/* Le type opaque SArena représente une zone d'allocation partagée en mémoire.
+ *
+ * - La zone est découpée en blocs de SA_CHUNK octets. Chaque allocation occupe
+ * un nombre entier de blocs consécutifs, précédés d'un court en-tête qui
+ * mémorise la longueur demandée, le processus responsable de l'allocation et
+ * sa génération.
+ * - Les allocations sont désignées par leur décalage depuis le début de la
+ * zone, ce qui permet de les échanger entre processus (par exemple au travers
+ * d'une SQueue) quelle que soit l'adresse de projection de la SHM.
+ * - Une allocation est à la charge du processus qui l'a obtenue, jusqu'à ce
+ * qu'un autre la reprenne avec sa_own. Les allocations dont le processus
+ * responsable s'est terminé sans les libérer sont récupérées par sa_reclaim.
+ * - La génération distingue une allocation de celles obtenues plus tard au
+ * même décalage.
+ * - Les fonctions sa_alloc, sa_ptr, sa_length, sa_gen, sa_own, sa_free,
+ * sa_reclaim et sa_dispose sont à utiliser avec des objets SArena
+ * préalablement renvoyés par sa_empty ou sa_open.
+ */
+
+#ifndef SARENA__H
+#define SARENA__H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Taille d'un bloc de la zone d'allocation */
+#define SA_CHUNK 64
+
+/**
+ * Type opaque pour la manipulation des zones d'allocation partagées.
+ */
+typedef struct __sarena * SArena;
+
+/**
+ * Créé une nouvelle zone d'allocation partagée.
+ *
+ * @arg     shm_name    Le nom unique de l'objet SHM à créer.
+ * @arg     size        La capacité de la zone, en octets.
+ * @return              Un nouvel objet SArena, NULL en cas d'erreur.
+ */
+extern SArena sa_empty(const char *shm_name, size_t size);
+
+/**
+ * Ouvre une zone d'allocation partagée existante.
+ *
+ * @arg     shm_name    Le nom de l'objet SHM associé à la zone à ouvrir.
+ * @return              Un objet SArena, NULL en cas d'erreur.
+ */
+extern SArena sa_open(const char *shm_name);
+
+/**
+ * Alloue len octets dans la zone sa, à la charge du processus appelant.
+ *
+ * @arg     sa      La zone à utiliser.
+ * @arg     len     Le nombre d'octets à allouer.
+ * @return          Le décalage de l'allocation en cas de succès, -1 si la zone
+ *                  ne dispose pas d'assez de blocs consécutifs libres.
+ */
+extern ssize_t sa_alloc(SArena sa, size_t len);
+
+/**
+ * Renvoie l'adresse, dans l'espace du processus appelant, de l'allocation
+ * située au décalage off.
+ *
+ * @arg     sa      La zone à utiliser.
+ * @arg     off     Un décalage renvoyé par sa_alloc.
+ * @return          L'adresse de l'allocation.
+ */
+extern void *sa_ptr(SArena sa, size_t off);
+
+/**
+ * Renvoie la longueur demandée lors de l'allocation située au décalage off.
+ *
+ * @arg     sa      La zone à utiliser.
+ * @arg     off     Un décalage renvoyé par sa_alloc.
+ * @return          La longueur de l'allocation.
+ */
+extern size_t sa_length(SArena sa, size_t off);
+
+/**
+ * Renvoie la génération de l'allocation située au décalage off.
+ *
+ * @arg     sa      La zone à utiliser.
+ * @arg     off     Un décalage renvoyé par sa_alloc.
+ * @return          La génération de l'allocation.
+ */
+extern uint32_t sa_gen(SArena sa, size_t off);
+
+/**
+ * Confie l'allocation située au décalage off au processus owner, si elle
+ * existe toujours avec la génération gen. Une allocation confiée au processus
+ * 0 n'est jamais récupérée par sa_reclaim.
+ *
+ * @arg     sa      La zone à utiliser.
+ * @arg     off     Un décalage renvoyé par sa_alloc.
+ * @arg     gen     La génération attendue de l'allocation.
+ * @arg     owner   Le nouveau processus responsable, ou 0.
+ * @return          0 en cas de succès, -1 si l'allocation a été libérée
+ *                  entre temps.
+ */
+extern int sa_own(SArena sa, size_t off, uint32_t gen, pid_t owner);
+
+/**
+ * Libère l'allocation située au décalage off.
+ *
+ * @arg     sa      La zone à utiliser.
+ * @arg     off     Un décalage renvoyé par sa_alloc.
+ * @return          0 en cas de succès, -1 sinon.
+ */
+extern int sa_free(SArena sa, size_t off);
+
+/**
+ * Libère les allocations de la zone sa dont le processus responsable s'est
+ * terminé.
+ *
+ * @arg     sa      La zone à utiliser.
+ * @return          Le nombre d'allocations libérées, -1 en cas d'erreur.
+ */
+extern ssize_t sa_reclaim(SArena sa);
+
+/**
+ * Libère les ressources allouées pour la zone pointée par sap.
+ *
+ * Le pointeur sap est fixé à NULL à la fin de l'opération.
+ *
+ * @param   sap     Un pointeur vers la zone à libérer.
+ */
+extern void sa_dispose(SArena *sap);
+
+#endif
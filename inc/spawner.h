@@ -0,0 +1,62 @@
+/* Le module spawner lance les commandes des workers.
+ *
+ * - Plusieurs mécanismes de lancement sont disponibles (voir enum sp_backend).
+ * Tous redirigent les entrées/sorties standard, rétablissent le masque et les
+ * gestionnaires de signaux par défaut, puis exécutent la commande avec execv
+ * lorsque son fichier est connu (voir pcache.h), avec execvp sinon ou en cas
+ * d'échec.
+ * - Aucune fonction non sûre (allocation, logs) n'est appelée dans le processus
+ * fils entre sa création et l'exécution de la commande.
+ */
+
+#ifndef SPAWNER__H
+#define SPAWNER__H
+
+#include <sys/types.h>
+
+/**
+ * Mécanismes de lancement des commandes.
+ *
+ * SP_FORK          fork() puis exec : l'espace mémoire du daemon est
+ *                  dupliqué (copie sur écriture des tables de pages).
+ * SP_VFORK         clone(CLONE_VM | CLONE_VFORK) puis exec : le fils
+ *                  partage la mémoire du daemon sur une pile dédiée, et le
+ *                  worker est suspendu jusqu'à l'exécution de la commande.
+ * SP_POSIX_SPAWN   posix_spawn() ou posix_spawnp() avec des actions de
+ *                  redirection.
+ */
+enum sp_backend {
+    SP_FORK,
+    SP_VFORK,
+    SP_POSIX_SPAWN
+};
+
+/**
+ * Descripteurs à installer comme entrée, sortie et erreur standard de la
+ * commande. Un descripteur égal à -1 est hérité du daemon. Les descripteurs
+ * fournis doivent être supérieurs à STDERR_FILENO.
+ */
+struct sp_fds {
+    int in;
+    int out;
+    int err;
+};
+
+/**
+ * Lance la commande argv avec le mécanisme backend.
+ *
+ * @arg     backend     Le mécanisme de lancement.
+ * @arg     file        Le chemin du fichier à exécuter, ou NULL pour chercher
+ *                      argv[0] dans PATH. La recherche a également lieu si
+ *                      file ne peut pas être exécuté.
+ * @arg     argv        Les arguments de la commande, terminés par NULL.
+ * @arg     fds         Les descripteurs à rediriger.
+ * @return              Le PID du processus fils en cas de succès, -1 sinon
+ *                      (errno indique alors l'erreur). Avec SP_FORK, l'échec
+ *                      de l'exécution n'est pas détecté : le fils se termine
+ *                      avec le code 127.
+ */
+extern pid_t sp_spawn(enum sp_backend backend, const char *file,
+        char *const argv[], const struct sp_fds *fds);
+
+#endif
@@ -2,9 +2,13 @@
  * 
  * - La taille des éléments d'une file ainsi que la longueur maximale de cette
  * dernière sont à préciser lors de la création de la file.
- * - Les fonctions sq_enqueue, sq_dequeue, sq_length, sq_apply et sq_dispose
- * sont à utiliser avec des objets SQueue préalablement renvoyés par sq_empty
- * ou sq_create.
+ * - Deux moteurs sont disponibles et choisis lors de la création de la file :
+ * une file protégée par des sémaphores (SQ_ENGINE_SEM) et un anneau sans
+ * verrou (SQ_ENGINE_RING). Les fonctions du module s'utilisent de la même façon
+ * quel que soit le moteur.
+ * - Les fonctions sq_enqueue, sq_dequeue (et leurs variantes par lots),
+ * sq_length, sq_apply et sq_dispose sont à utiliser avec des objets SQueue
+ * préalablement renvoyés par sq_empty ou sq_create.
  * - Il est de la responsabilité de l'utilisateur d'assurer la cohérence de la
  * file vis-à-vis de la taille des objets enfilés. Ceux-ci doivent tous être de
  * la même taille. Il en va de même pour le tampon passé en paramètre de la
@@ -15,21 +19,39 @@
 #define SQUEUE__H
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 /**
  * Type opaque pour la manipulation des files synchronisées.
  */
 typedef struct __squeue * SQueue;
 
+/**
+ * Moteurs de file synchronisée.
+ *
+ * SQ_ENGINE_SEM    Tableau circulaire protégé par un mutex, avec deux
+ *                  sémaphores bloquant l'enfilage dans une file pleine et le
+ *                  défilage d'une file vide.
+ * SQ_ENGINE_RING   Anneau multi-producteurs/multi-consommateurs sans verrou :
+ *                  chaque case porte un numéro de séquence atomique, et un
+ *                  futex n'est utilisé que lorsque la file est pleine ou vide.
+ */
+enum sq_engine {
+    SQ_ENGINE_SEM,
+    SQ_ENGINE_RING
+};
+
 /**
  * Créé une nouvelle file synchronisée vide.
  *
  * @arg     shm_name    Le nom unique de l'objet SHM à créer.
  * @arg     size        La taille des objets qui seront stockés dans la file.
  * @arg     max_length  La longueur maximale autorisée de la file.
+ * @arg     engine      Le moteur à utiliser pour la file.
  * @return              Un nouvel objet SQueue.
  */
-extern SQueue sq_empty(const char *shm_name, size_t size, size_t max_length);
+extern SQueue sq_empty(const char *shm_name, size_t size, size_t max_length,
+        enum sq_engine engine);
 
 /**
  * Ouvre une file synchronisée existante.
@@ -61,6 +83,43 @@ extern int sq_enqueue(SQueue sq, const void *obj);
  */
 extern int sq_dequeue(SQueue sq, void *buf);
 
+/**
+ * Enfile les n objets contigus pointés par objs dans la file synchronisée sq.
+ *
+ * Les objets sont enfilés par lots, chacun sous une seule prise du verrou (ou
+ * une seule notification des consommateurs avec le moteur SQ_ENGINE_RING).
+ * La fonction bloque tant que tous les objets n'ont pas pu être enfilés.
+ *
+ * @arg     sq      La file à utiliser.
+ * @arg     objs    Un pointeur vers un tableau de n objets.
+ * @arg     n       Le nombre d'objets à enfiler.
+ * @return          0 en cas de succès, -1 sinon.
+ */
+extern int sq_enqueue_batch(SQueue sq, const void *objs, size_t n);
+
+/**
+ * Défile jusqu'à n objets de la file synchronisée sq dans buf.
+ *
+ * La fonction bloque jusqu'à ce qu'au moins un objet soit disponible, puis
+ * défile en une fois ceux qui sont présents, dans la limite de n.
+ *
+ * @arg     sq      La file à utiliser.
+ * @arg     buf     Un pointeur vers une zone mémoire pouvant contenir n objets.
+ * @arg     n       Le nombre maximal d'objets à défiler.
+ * @return          Le nombre d'objets défilés en cas de succès, -1 sinon.
+ */
+extern ssize_t sq_dequeue_batch(SQueue sq, void *buf, size_t n);
+
+/**
+ * Défile un objet de la file synchronisée sq sans bloquer.
+ *
+ * @arg     sq      La file à utiliser.
+ * @arg     buf     Un pointeur vers une zone mémoire.
+ * @return          0 en cas de succès, -1 sinon (errno vaut EAGAIN si la file
+ *                  est vide).
+ */
+extern int sq_try_dequeue(SQueue sq, void *buf);
+
 /**
  * Renvoie la longueur courante de la file sq.
  *
@@ -72,6 +131,9 @@ extern ssize_t sq_length(const SQueue sq);
 /**
  * Applique la fonction fun sur tous les éléments de la file sq.
  *
+ * Avec le moteur SQ_ENGINE_RING, la file n'est pas verrouillée pendant le
+ * parcours : les éléments enfilés ou défilés en parallèle peuvent être omis.
+ *
  * @param   sq      La file à utiliser.
  * @param   fun     Un pointeur vers la fonction à appliquer.
  * @return          0 en cas de succès, le retour de fun en cas d'erreur.
@@ -0,0 +1,77 @@
+/* Le module tokenize découpe une commande en arguments, en un seul passage,
+ * selon les règles de citation du shell :
+ *
+ * - Les arguments sont séparés par des blancs (espaces, tabulations et fins
+ * de ligne) ;
+ * - Entre apostrophes, tous les caractères sont pris tels quels ;
+ * - Entre guillemets, tous les caractères sont pris tels quels, sauf '\'
+ * suivi de '"', '\', '$', '`' (le caractère est gardé seul) ou d'une fin de
+ * ligne (les deux sont supprimés) ;
+ * - Hors citation, '\' protège le caractère qui le suit (une fin de ligne
+ * protégée est supprimée) ;
+ * - Des citations vides ('' ou "") forment un argument vide.
+ *
+ * - Hors citation, '|' sépare deux étapes d'un pipeline, même sans blanc
+ * autour : la sortie de chaque étape est l'entrée de la suivante.
+ *
+ * Aucune substitution n'est effectuée : '$', '*', ';' ou '&' sont des
+ * caractères comme les autres. Une citation non fermée, un '\' final ou une
+ * étape vide (commande débutant ou finissant par '|', ou "||") sont des
+ * erreurs.
+ *
+ * Les arguments produits sont rangés à la suite dans un tampon, chacun terminé
+ * par '\0', et désignés par leur décalage dans ce tampon : l'ensemble peut
+ * être recopié ou transmis tel quel, puis retrouvé sans nouvelle analyse. Les
+ * séparateurs d'étapes figurent parmi les décalages, avec la valeur TK_PIPE,
+ * mais n'occupent aucune place dans le tampon.
+ */
+
+#ifndef TOKENIZE__H
+#define TOKENIZE__H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Nombre maximal d'arguments et de séparateurs d'étapes d'une commande de
+ * longueur len : chacun occupe au moins un caractère */
+#define TK_ARGC_MAX(len) ((len) + 1)
+
+/* Décalage désignant un séparateur d'étapes parmi ceux des arguments */
+#define TK_PIPE UINT32_MAX
+
+/**
+ * Découpe la commande str en arguments.
+ *
+ * @arg     str     La commande, terminée par '\0'.
+ * @arg     args    Reçoit les arguments, chacun terminé par '\0'. Doit être de
+ *                  taille au moins égale à strlen(str) + 1.
+ * @arg     offs    Reçoit le décalage de chaque argument dans args, ou
+ *                  TK_PIPE entre deux étapes. Doit être de longueur au moins
+ *                  égale à TK_ARGC_MAX(strlen(str)).
+ * @arg     argc    Reçoit le nombre de décalages.
+ * @return          La longueur des arguments dans args, '\0' compris, -1 en
+ *                  cas de citation non fermée, de '\' final ou d'étape vide
+ *                  (errno vaut alors EINVAL).
+ */
+extern ssize_t tk_split(const char *str, char *args, uint32_t offs[],
+        size_t *argc);
+
+/**
+ * Vérifie que les argc arguments désignés par offs dans le tampon args de
+ * longueur argslen sont bien formés, tels que produits par tk_split : le
+ * premier débute le tampon, chacun débute après le '\0' du précédent, et le
+ * dernier se termine à la fin du tampon. Aucune étape ne doit être vide.
+ *
+ * @return  0 si les arguments sont bien formés, -1 sinon.
+ */
+extern int tk_check(const char *args, size_t argslen, const uint32_t offs[],
+        size_t argc);
+
+/**
+ * Renvoie le nombre d'étapes de la commande dont les argc décalages sont
+ * offs, tels que produits par tk_split (0 si argc est nul).
+ */
+extern size_t tk_stages(const uint32_t offs[], size_t argc);
+
+#endif
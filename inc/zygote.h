@@ -0,0 +1,83 @@
+/* Le type opaque Zygote représente un processus auxiliaire chargé de lancer
+ * les commandes à la place du daemon.
+ *
+ * - Le zygote est créé au lancement du daemon, avant que celui-ci n'alloue
+ * ses structures et ne lance ses threads : il est mono-thread et son espace
+ * mémoire reste minimal, si bien que le coût d'un fork() y est indépendant de
+ * la taille du daemon.
+ * - Chaque worker dispose de son propre canal (socketpair) vers le zygote,
+ * par lequel il envoie la commande et ses descripteurs, puis reçoit le PID du
+ * processus lancé et enfin son statut de terminaison. Jusqu'à ZY_CHILDREN_MAX
+ * processus (les étapes d'un pipeline) peuvent être en cours sur un canal.
+ * - Les processus lancés sont les fils du zygote : c'est lui qui les attend,
+ * et qui transmet leur statut et les ressources consommées au worker.
+ * - Le zygote se termine lorsque le daemon ferme les canaux.
+ * - Un même canal ne doit pas être utilisé par plusieurs threads à la fois.
+ */
+
+#ifndef ZYGOTE__H
+#define ZYGOTE__H
+
+#include <stddef.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "spawner.h"
+
+/* Nombre maximal de processus en cours lancés par un même canal */
+#define ZY_CHILDREN_MAX 16
+
+/**
+ * Type opaque pour la manipulation du zygote.
+ */
+typedef struct __zygote * Zygote;
+
+/**
+ * Créé le processus zygote et n canaux de communication avec celui-ci.
+ *
+ * @arg     n       Le nombre de canaux.
+ * @arg     backend Le mécanisme de lancement utilisé par le zygote.
+ * @return          Un nouvel objet Zygote, NULL en cas d'erreur.
+ */
+extern Zygote zy_create(size_t n, enum sp_backend backend);
+
+/**
+ * Lance la commande argv par l'intermédiaire du canal ch du zygote zy.
+ *
+ * Les descripteurs de fds sont transmis au zygote, qui les installe comme
+ * pour sp_spawn().
+ *
+ * @arg     zy      Le zygote à utiliser.
+ * @arg     ch      Le canal à utiliser, inférieur à leur nombre.
+ * @arg     file    Le chemin du fichier à exécuter, ou NULL (voir
+ *                  sp_spawn()).
+ * @arg     argv    Les arguments de la commande, terminés par NULL.
+ * @arg     fds     Les descripteurs à rediriger.
+ * @return          Le PID du processus lancé en cas de succès, -1 sinon
+ *                  (errno indique alors l'erreur, EAGAIN si ZY_CHILDREN_MAX
+ *                  processus lancés par le canal sont en cours).
+ */
+extern pid_t zy_spawn(Zygote zy, size_t ch, const char *file,
+        char *const argv[], const struct sp_fds *fds);
+
+/**
+ * Attend la fin de l'un des processus lancés par zy_spawn() sur le canal ch
+ * du zygote zy, dans l'ordre où ils se terminent.
+ *
+ * @arg     zy      Le zygote à utiliser.
+ * @arg     ch      Le canal à utiliser.
+ * @arg     status  Le statut du processus, au format de wait().
+ * @arg     ru      Les ressources consommées par le processus.
+ * @return          Le PID du processus terminé en cas de succès, -1 sinon.
+ */
+extern pid_t zy_wait(Zygote zy, size_t ch, int *status, struct rusage *ru);
+
+/**
+ * Ferme les canaux du zygote pointé par zyp, attend sa terminaison et libère
+ * les ressources associées.
+ *
+ * Le pointeur zyp est fixé à NULL à la fin de l'opération.
+ */
+extern void zy_dispose(Zygote *zyp);
+
+#endif
@@ -0,0 +1,426 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alog.h"
+
+/* Taille d'une ligne de cache, séparant les positions de l'anneau */
+#define AL_CACHELINE 64
+
+/* Longueur maximale d'un message mis en forme pour l'écriture (en-tête
+ * compris) */
+#define AL_LINE_MAX (AL_MSG_MAX + 128)
+
+/* Noms des niveaux, dans l'ordre de LOG_EMERG à LOG_DEBUG */
+static const char *levels[] = {
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+/**
+ * Case de l'anneau : un numéro de séquence suivi du message.
+ *
+ * Pour la position pos, la case vaut pos lorsqu'elle est libre, pos + 1
+ * lorsqu'elle contient un message, et pos + capacity une fois écrite.
+ */
+struct alslot {
+    atomic_size_t seq;
+    struct timespec ts;     /* Dépôt du message (CLOCK_REALTIME) */
+    int level;
+    size_t len;
+    char msg[AL_MSG_MAX];
+};
+
+struct __alog {
+    _Alignas(AL_CACHELINE) atomic_size_t head;  /* Prochaine position à
+                                                   remplir */
+    _Atomic uint64_t dropped;                   /* Messages perdus */
+    _Alignas(AL_CACHELINE) _Atomic uint32_t wake; /* Futex de réveil */
+    atomic_bool sleeping;   /* Le thread d'écriture attend sur wake */
+    atomic_bool stop;       /* Le thread d'écriture doit s'arrêter */
+
+    /* --- Thread d'écriture --- */
+    _Alignas(AL_CACHELINE) size_t tail; /* Prochaine position à écrire */
+    uint64_t reported;      /* Messages perdus déjà signalés */
+    int fd;                 /* Le fichier, ou le socket de syslog (-1 s'il
+                               n'est pas connecté) */
+    char *buf;              /* Messages mis en forme (AL_BATCH lignes) */
+    pthread_t th;
+
+    const char *ident;
+    int facility;
+    int level;
+    bool tosyslog;          /* Messages transmis à syslog */
+    pid_t pid;
+    size_t capacity;
+    struct alslot *slots;
+};
+
+#define AL_SLOT(l, pos) (&(l)->slots[(pos) % (l)->capacity])
+
+/* --- FUTEX --------------------------------------------------------------- */
+
+static void __futex_wait(_Atomic uint32_t *addr, uint32_t val) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT_PRIVATE, val, NULL,
+            NULL, 0);
+}
+
+static void __futex_wake(_Atomic uint32_t *addr) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL,
+            0);
+}
+
+/* --- ÉCRITURE ------------------------------------------------------------ */
+
+/**
+ * Connecte le journal l au socket de syslog.
+ *
+ * @return  0 en cas de succès, -1 sinon.
+ */
+static int __al_connect(struct __alog *l) {
+    l->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (l->fd == -1) {
+        return -1;
+    }
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, AL_SYSLOG_PATH, sizeof(addr.sun_path) - 1);
+    if (connect(l->fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(l->fd);
+        l->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Met en forme le message msg de niveau level, déposé à l'instant ts, dans
+ * line : au format de syslog (RFC 3164) ou d'une ligne du fichier.
+ *
+ * @return  La longueur de la ligne.
+ */
+static size_t __al_format(struct __alog *l, char *line,
+        const struct timespec *ts, int level, const char *msg, size_t len) {
+    struct tm tm;
+    localtime_r(&ts->tv_sec, &tm);
+    char date[32];
+    int n;
+    if (l->tosyslog) {
+        strftime(date, sizeof(date), "%b %e %T", &tm);
+        n = snprintf(line, AL_LINE_MAX, "<%d>%s %s[%d]: %.*s",
+                l->facility | level, date, l->ident, l->pid, (int) len, msg);
+    } else {
+        strftime(date, sizeof(date), "%F %T", &tm);
+        n = snprintf(line, AL_LINE_MAX, "%s.%03ld %s[%d] %s: %.*s\n", date,
+                ts->tv_nsec / 1000000, l->ident, l->pid, levels[level],
+                (int) len, msg);
+    }
+    return n < 0 ? 0 : (size_t) n >= AL_LINE_MAX ? AL_LINE_MAX - 1
+                                                  : (size_t) n;
+}
+
+/**
+ * Transmet les n messages de iov à syslog, chacun dans un datagramme. Le
+ * socket est reconnecté une fois en cas d'échec (redémarrage de syslog) ; les
+ * messages qui n'ont pu être transmis sont perdus.
+ */
+static void __al_send(struct __alog *l, struct iovec *iov, size_t n) {
+    struct mmsghdr msgs[AL_BATCH];
+    for (size_t i = 0; i < n; i++) {
+        msgs[i] = (struct mmsghdr) {
+            .msg_hdr = { .msg_iov = &iov[i], .msg_iovlen = 1 }
+        };
+    }
+
+    size_t sent = 0;
+    for (int attempt = 0; attempt < 2 && sent < n; attempt++) {
+        if (l->fd == -1 && __al_connect(l) == -1) {
+            break;
+        }
+        while (sent < n) {
+            int r = sendmmsg(l->fd, msgs + sent, (unsigned) (n - sent), 0);
+            if (r == -1 && errno == EINTR) {
+                continue;
+            }
+            if (r == -1) {
+                close(l->fd);
+                l->fd = -1;
+                break;
+            }
+            sent += (size_t) r;
+        }
+    }
+    atomic_fetch_add_explicit(&l->dropped, n - sent, memory_order_relaxed);
+}
+
+/**
+ * Ajoute les len octets de buf à la fin du fichier du journal l.
+ */
+static void __al_write(struct __alog *l, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t r = write(l->fd, buf, len);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return;
+        }
+        buf += r;
+        len -= (size_t) r;
+    }
+}
+
+/**
+ * Écrit en une fois jusqu'à AL_BATCH messages de l'anneau, précédés du nombre
+ * de messages perdus depuis le précédent lot s'il y en a.
+ *
+ * @return  Le nombre de messages de l'anneau écrits.
+ */
+static size_t __al_flush(struct __alog *l) {
+    struct iovec iov[AL_BATCH];
+    size_t n = 0;
+    size_t taken = 0;
+
+    uint64_t dropped = atomic_load_explicit(&l->dropped,
+            memory_order_relaxed);
+    if (dropped != l->reported) {
+        char msg[64];
+        int len = snprintf(msg, sizeof(msg),
+                "%" PRIu64 " log messages dropped", dropped - l->reported);
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        iov[n].iov_base = l->buf;
+        iov[n].iov_len = __al_format(l, l->buf, &ts, LOG_WARNING, msg,
+                (size_t) len);
+        n++;
+        l->reported = dropped;
+    }
+
+    while (n < AL_BATCH) {
+        struct alslot *slot = AL_SLOT(l, l->tail);
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire)
+                != l->tail + 1) {
+            break;
+        }
+        char *line = l->buf + n * AL_LINE_MAX;
+        iov[n].iov_base = line;
+        iov[n].iov_len = __al_format(l, line, &slot->ts, slot->level,
+                slot->msg, slot->len);
+        n++;
+        taken++;
+        atomic_store_explicit(&slot->seq, l->tail + l->capacity,
+                memory_order_release);
+        l->tail++;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+    if (l->tosyslog) {
+        __al_send(l, iov, n);
+        return taken;
+    }
+
+    /* Les lignes sont rassemblées pour un seul appel à write */
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        memmove(l->buf + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    __al_write(l, l->buf, len);
+    return taken;
+}
+
+/**
+ * Indique si l'anneau du journal l ne contient aucun message à écrire.
+ */
+static bool __al_empty(struct __alog *l) {
+    return atomic_load_explicit(&AL_SLOT(l, l->tail)->seq,
+            memory_order_acquire) != l->tail + 1;
+}
+
+/**
+ * Fonction de démarrage du thread d'écriture.
+ *
+ * Le thread s'inscrit dans sleeping avant de vérifier une dernière fois que
+ * l'anneau est vide, puis s'endort si wake n'a pas changé entre temps : un
+ * message déposé est ainsi soit vu, soit suivi d'un réveil.
+ */
+static void *__al_flusher(void *arg) {
+    struct __alog *l = arg;
+    while (1) {
+        while (__al_flush(l) > 0) {
+        }
+        if (atomic_load(&l->stop)) {
+            break;
+        }
+
+        uint32_t val = atomic_load_explicit(&l->wake, memory_order_acquire);
+        atomic_store(&l->sleeping, true);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (__al_empty(l) && !atomic_load(&l->stop)) {
+            __futex_wait(&l->wake, val);
+        }
+        atomic_store(&l->sleeping, false);
+
+        /* Les messages qui suivent le premier sont écrits avec lui */
+        if (!atomic_load(&l->stop)) {
+            nanosleep(&(struct timespec) {
+                .tv_nsec = AL_BATCH_DELAY * 1000L
+            }, NULL);
+        }
+    }
+
+    /* Les messages restants et le nombre de messages perdus sont écrits */
+    while (__al_flush(l) > 0) {
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+ALog al_create(const char *ident, int facility, int level, const char *path,
+        size_t capacity) {
+    if (capacity == 0 || level < LOG_EMERG || level > LOG_DEBUG) {
+        return NULL;
+    }
+
+    struct __alog *l = aligned_alloc(AL_CACHELINE,
+            (sizeof(*l) + AL_CACHELINE - 1) / AL_CACHELINE * AL_CACHELINE);
+    if (l == NULL) {
+        return NULL;
+    }
+    memset(l, 0, sizeof(*l));
+    l->slots = malloc(capacity * sizeof(*l->slots));
+    l->buf = malloc(AL_BATCH * AL_LINE_MAX);
+    if (l->slots == NULL || l->buf == NULL) {
+        goto error;
+    }
+
+    atomic_init(&l->head, 0);
+    atomic_init(&l->dropped, 0);
+    atomic_init(&l->wake, 0);
+    atomic_init(&l->sleeping, false);
+    atomic_init(&l->stop, false);
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&l->slots[i].seq, i);
+    }
+    l->tail = 0;
+    l->reported = 0;
+    l->ident = ident;
+    l->facility = facility;
+    l->level = level;
+    l->pid = getpid();
+    l->capacity = capacity;
+
+    /* Le socket de syslog est connecté au premier lot : syslog peut être
+     * lancé après le journal */
+    l->tosyslog = (path == NULL);
+    l->fd = -1;
+    if (path != NULL) {
+        l->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                S_IRUSR | S_IWUSR | S_IRGRP);
+        if (l->fd == -1) {
+            goto error;
+        }
+    }
+
+    /* Les dates sont converties dans le fuseau local par le thread
+     * d'écriture */
+    tzset();
+    if (pthread_create(&l->th, NULL, __al_flusher, l) != 0) {
+        if (l->fd != -1) {
+            close(l->fd);
+        }
+        goto error;
+    }
+    return l;
+
+error:
+    free(l->slots);
+    free(l->buf);
+    free(l);
+    return NULL;
+}
+
+void al_log(ALog l, int level, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    al_vlog(l, level, format, args);
+    va_end(args);
+}
+
+void al_vlog(ALog l, int level, const char *format, va_list args) {
+    if (level > l->level) {
+        return;
+    }
+
+    /* Réserve une case libre, comme l'anneau du module squeue */
+    size_t pos = atomic_load_explicit(&l->head, memory_order_relaxed);
+    struct alslot *slot;
+    while (1) {
+        slot = AL_SLOT(l, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&l->head, &pos,
+                        pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&l->dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&l->head, memory_order_relaxed);
+        }
+    }
+
+    /* Le message est mis en forme directement dans la case */
+    clock_gettime(CLOCK_REALTIME, &slot->ts);
+    slot->level = level;
+    int len = vsnprintf(slot->msg, sizeof(slot->msg), format, args);
+    slot->len = len < 0 ? 0 : (size_t) len >= sizeof(slot->msg)
+        ? sizeof(slot->msg) - 1 : (size_t) len;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    /* Seul le premier message déposé pendant le sommeil du thread d'écriture
+     * le réveille */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&l->sleeping, memory_order_relaxed)
+            && atomic_exchange(&l->sleeping, false)) {
+        atomic_fetch_add_explicit(&l->wake, 1, memory_order_release);
+        __futex_wake(&l->wake);
+    }
+}
+
+uint64_t al_dropped(ALog l) {
+    return atomic_load_explicit(&l->dropped, memory_order_relaxed);
+}
+
+void al_dispose(ALog *lp) {
+    struct __alog *l = *lp;
+    atomic_store(&l->stop, true);
+    atomic_fetch_add_explicit(&l->wake, 1, memory_order_release);
+    __futex_wake(&l->wake);
+    pthread_join(l->th, NULL);
+
+    if (l->fd != -1) {
+        close(l->fd);
+    }
+    free(l->slots);
+    free(l->buf);
+    free(l);
+    *lp = NULL;
+}
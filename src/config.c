@@ -1,81 +1,349 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <syslog.h>
+#include <unistd.h>
 
 #include "config.h"
 
 enum __OPTION {
     DAEMON_WORKER_MAX,
-    REQUEST_QUEUE_MAX
+    REQUEST_QUEUE_MAX,
+    REQUEST_QUEUE_ENGINE,
+    DAEMON_BACKLOG_MAX,
+    DAEMON_BACKLOG_TIMEOUT,
+    SPAWN_BACKEND,
+    SPAWN_ZYGOTE,
+    EXEC_MODE,
+    DAEMON_JOB_MAX,
+    DAEMON_WORKER_MIN,
+    DAEMON_WORKER_IDLE,
+    DAEMON_PRIORITY_POLICY,
+    DAEMON_PRIORITY_AGING,
+    DAEMON_TENANT_WORKERS,
+    DAEMON_JOB_ORDER,
+    CACHE_SIZE,
+    PIPE_SIZE,
+    LOG_LEVEL,
+    LOG_FILE,
+    HISTORY_FILE
 };
 
 static const char *optflags[] = {
     "DAEMON_WORKER_MAX",
-    "REQUEST_QUEUE_MAX"
+    "REQUEST_QUEUE_MAX",
+    "REQUEST_QUEUE_ENGINE",
+    "DAEMON_BACKLOG_MAX",
+    "DAEMON_BACKLOG_TIMEOUT",
+    "SPAWN_BACKEND",
+    "SPAWN_ZYGOTE",
+    "EXEC_MODE",
+    "DAEMON_JOB_MAX",
+    "DAEMON_WORKER_MIN",
+    "DAEMON_WORKER_IDLE",
+    "DAEMON_PRIORITY_POLICY",
+    "DAEMON_PRIORITY_AGING",
+    "DAEMON_TENANT_WORKERS",
+    "DAEMON_JOB_ORDER",
+    "CACHE_SIZE",
+    "PIPE_SIZE",
+    "LOG_LEVEL",
+    "LOG_FILE",
+    "HISTORY_FILE"
 };
 
-#define LINE_LENGTH_MAX 128
+#define LINE_LENGTH_MAX CONFIG_VALUE_MAX
 #define SEPARATOR '\t'
 #define COMMENT '#'
 
-int __load(enum __OPTION opt, const char *filename) {
+/* Valeurs de retour de __find() */
+#define FIND_FOUND 0
+#define FIND_ABSENT 1
+#define FIND_ERROR -1
+
+/**
+ * Recherche la valeur associée à l'option opt dans le fichier filename.
+ *
+ * La valeur, débarrassée des blancs de fin de ligne, est copiée dans buf.
+ *
+ * @return  FIND_FOUND si l'option est présente, FIND_ABSENT si elle ne l'est
+ *          pas, FIND_ERROR en cas d'erreur.
+ */
+static int __find(enum __OPTION opt, const char *filename, char *buf,
+        size_t size) {
     FILE *f = fopen(filename, "r");
     if (f == NULL) {
-        return -1;
+        return FIND_ERROR;
     }
-    
-    int ret = -1;
+
+    int ret = FIND_ABSENT;
 
     char line[LINE_LENGTH_MAX] = { 0 };
     while (fgets(line, sizeof(line), f) != NULL) {
         if (*line == COMMENT || *line == '\n') {
             continue;
         }
-        char flagbuf[LINE_LENGTH_MAX] = { 0 };
-        int i = 0;
-        while (line[i] != SEPARATOR) {
-            flagbuf[i] = line[i];
+
+        size_t i = strcspn(line, "\t\n");
+        const char *flag = optflags[opt];
+        if (i != strlen(flag) || strncmp(flag, line, i) != 0) {
+            continue;
+        }
+
+        while (line[i] == SEPARATOR) {
             i++;
         }
 
-        const char *flag = optflags[opt];
-        if (strncmp(flag, flagbuf, strlen(flag)) == 0) {
-            while (line[i] == SEPARATOR) {
-                i++;
-            }
-
-            int j = 0;
-            char retbuf[16];
-            while (line[i] != '\0') {
-                retbuf[j] = line[i];
-                i++;
-                j++;
-            }
-
-            ret = (int) strtol(retbuf, NULL, 10);
+        size_t len = strcspn(line + i, " \t\r\n");
+        if (len == 0 || len >= size) {
+            ret = FIND_ERROR;
             break;
         }
+        memcpy(buf, line + i, len);
+        buf[len] = '\0';
+        ret = FIND_FOUND;
+        break;
     }
 
     fclose(f);
     return ret;
 }
 
-#define VALID_DAEMON_WORKER_MAX(x) (1 <= x && x <= 64)
-#define VALID_REQUEST_QUEUE_MAX(x) (1 <= x && x <= 256)
+/**
+ * Charge la valeur entière de l'option opt.
+ *
+ * @arg     def     La valeur par défaut si l'option est absente, ou -1 si
+ *                  l'option est obligatoire.
+ * @return          La valeur de l'option, -1 en cas d'erreur.
+ */
+static int __load(enum __OPTION opt, const char *filename, int def) {
+    char buf[LINE_LENGTH_MAX];
+    switch (__find(opt, filename, buf, sizeof(buf))) {
+    case FIND_ABSENT:
+        return def;
+    case FIND_ERROR:
+        return -1;
+    }
+
+    char *end;
+    long ret = strtol(buf, &end, 10);
+    if (*end != '\0' || ret < 0 || ret > INT_MAX) {
+        return -1;
+    }
+    return (int) ret;
+}
+
+/**
+ * Charge la valeur de l'option opt parmi les noms de la liste names.
+ *
+ * @arg     names   Les valeurs possibles, terminées par NULL.
+ * @arg     def     L'indice de la valeur par défaut si l'option est absente.
+ * @return          L'indice de la valeur dans names, -1 en cas d'erreur.
+ */
+static int __loadname(enum __OPTION opt, const char *filename,
+        const char *names[], int def) {
+    char buf[LINE_LENGTH_MAX];
+    switch (__find(opt, filename, buf, sizeof(buf))) {
+    case FIND_ABSENT:
+        return def;
+    case FIND_ERROR:
+        return -1;
+    }
+
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strcmp(names[i], buf) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Noms des moteurs de file, dans l'ordre de enum sq_engine */
+static const char *engines[] = { "sem", "ring", NULL };
+
+/* Noms des mécanismes de lancement, dans l'ordre de enum sp_backend */
+static const char *backends[] = { "fork", "vfork", "posix_spawn", NULL };
+
+/* Noms des modes d'exécution, dans l'ordre de enum exec_mode */
+static const char *modes[] = { "thread", "event", NULL };
+
+/* Noms des politiques de priorité, dans l'ordre de enum js_policy */
+static const char *policies[] = { "strict", "weighted", NULL };
+
+/* Noms des ordres des travaux, dans l'ordre de enum js_order */
+static const char *orders[] = { "fifo", "sjf", "ljf", NULL };
+
+/* Noms des niveaux de log, dans l'ordre de LOG_EMERG à LOG_DEBUG */
+static const char *levels[] = {
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug", NULL
+};
+
+/* Valeur de LOG_FILE désignant syslog */
+#define LOG_FILE_SYSLOG "syslog"
+
+/* Valeur de HISTORY_FILE désactivant l'historique */
+#define HISTORY_FILE_NONE "none"
+
+/* Chemin par défaut de l'historique, propre à l'utilisateur du daemon */
+#define HISTORY_FILE_DEFAULT "/var/tmp/cmdld.%u.history"
+
+#define VALID_DAEMON_WORKER_MAX(x) (1 <= x && x <= 512)
+#define VALID_REQUEST_QUEUE_MAX(x) (1 <= x && x <= 4096)
+#define VALID_DAEMON_BACKLOG_MAX(x) (1 <= x && x <= 65536)
+#define VALID_DAEMON_BACKLOG_TIMEOUT(x) (0 <= x && x <= 86400000)
+#define VALID_SPAWN_ZYGOTE(x) (0 <= x && x <= 1)
+#define VALID_DAEMON_JOB_MAX(x) (1 <= x && x <= 65536)
+#define VALID_DAEMON_WORKER_IDLE(x) (1 <= x && x <= 86400000)
+#define VALID_DAEMON_PRIORITY_AGING(x) (0 <= x && x <= 86400000)
+#define VALID_DAEMON_TENANT_WORKERS(x) (0 <= x && x <= 65536)
+#define VALID_CACHE_SIZE(x) (0 <= x && x <= 1048576)
+#define VALID_PIPE_SIZE(x) (0 <= x && x <= 1048576)
 
 int config_load(struct config *ptr, const char *filename) {
-    int ret =  __load(DAEMON_WORKER_MAX, filename);
+    int ret =  __load(DAEMON_WORKER_MAX, filename, -1);
     if (ret == -1 || !VALID_DAEMON_WORKER_MAX(ret)) {
         return -1;
     }
     ptr->DAEMON_WORKER_MAX = (size_t) ret;
 
-    ret = __load(REQUEST_QUEUE_MAX, filename);
+    ret = __load(REQUEST_QUEUE_MAX, filename, -1);
     if (ret == -1 || !VALID_REQUEST_QUEUE_MAX(ret)) {
         return -1;
     }
     ptr->REQUEST_QUEUE_MAX = (size_t) ret;
 
+    ret = __loadname(REQUEST_QUEUE_ENGINE, filename, engines, SQ_ENGINE_RING);
+    if (ret == -1) {
+        return -1;
+    }
+    ptr->REQUEST_QUEUE_ENGINE = (enum sq_engine) ret;
+
+    ret = __load(DAEMON_BACKLOG_MAX, filename, 64);
+    if (ret == -1 || !VALID_DAEMON_BACKLOG_MAX(ret)) {
+        return -1;
+    }
+    ptr->DAEMON_BACKLOG_MAX = (size_t) ret;
+
+    ret = __load(DAEMON_BACKLOG_TIMEOUT, filename, 0);
+    if (ret == -1 || !VALID_DAEMON_BACKLOG_TIMEOUT(ret)) {
+        return -1;
+    }
+    ptr->DAEMON_BACKLOG_TIMEOUT = (long) ret;
+
+    ret = __loadname(SPAWN_BACKEND, filename, backends, SP_POSIX_SPAWN);
+    if (ret == -1) {
+        return -1;
+    }
+    ptr->SPAWN_BACKEND = (enum sp_backend) ret;
+
+    ret = __load(SPAWN_ZYGOTE, filename, 0);
+    if (ret == -1 || !VALID_SPAWN_ZYGOTE(ret)) {
+        return -1;
+    }
+    ptr->SPAWN_ZYGOTE = (ret == 1);
+
+    ret = __loadname(EXEC_MODE, filename, modes, EXEC_THREAD);
+    if (ret == -1) {
+        return -1;
+    }
+    ptr->EXEC_MODE = (enum exec_mode) ret;
+
+    /* Les processus lancés par le zygote ne peuvent être attendus que par
+     * lui : le mode event les attend depuis le daemon */
+    if (ptr->EXEC_MODE == EXEC_EVENT && ptr->SPAWN_ZYGOTE) {
+        return -1;
+    }
+
+    ret = __load(DAEMON_JOB_MAX, filename, 1024);
+    if (ret == -1 || !VALID_DAEMON_JOB_MAX(ret)) {
+        return -1;
+    }
+    ptr->DAEMON_JOB_MAX = (size_t) ret;
+
+    /* En l'absence de DAEMON_WORKER_MIN, le nombre de workers est fixe */
+    ret = __load(DAEMON_WORKER_MIN, filename, (int) ptr->DAEMON_WORKER_MAX);
+    if (ret == -1 || ret < 1 || (size_t) ret > ptr->DAEMON_WORKER_MAX) {
+        return -1;
+    }
+    ptr->DAEMON_WORKER_MIN = (size_t) ret;
+
+    ret = __load(DAEMON_WORKER_IDLE, filename, 30000);
+    if (ret == -1 || !VALID_DAEMON_WORKER_IDLE(ret)) {
+        return -1;
+    }
+    ptr->DAEMON_WORKER_IDLE = (long) ret;
+
+    ret = __loadname(DAEMON_PRIORITY_POLICY, filename, policies, JS_WEIGHTED);
+    if (ret == -1) {
+        return -1;
+    }
+    ptr->DAEMON_PRIORITY_POLICY = (enum js_policy) ret;
+
+    ret = __load(DAEMON_PRIORITY_AGING, filename, 5000);
+    if (ret == -1 || !VALID_DAEMON_PRIORITY_AGING(ret)) {
+        return -1;
+    }
+    ptr->DAEMON_PRIORITY_AGING = (long) ret;
+
+    ret = __load(DAEMON_TENANT_WORKERS, filename, 0);
+    if (ret == -1 || !VALID_DAEMON_TENANT_WORKERS(ret)) {
+        return -1;
+    }
+    ptr->DAEMON_TENANT_WORKERS = (size_t) ret;
+
+    ret = __loadname(DAEMON_JOB_ORDER, filename, orders, JS_FIFO);
+    if (ret == -1) {
+        return -1;
+    }
+    ptr->DAEMON_JOB_ORDER = (enum js_order) ret;
+
+    ret = __load(CACHE_SIZE, filename, 16384);
+    if (ret == -1 || !VALID_CACHE_SIZE(ret)) {
+        return -1;
+    }
+    ptr->CACHE_SIZE = (size_t) ret;
+
+    ret = __load(PIPE_SIZE, filename, 256);
+    if (ret == -1 || !VALID_PIPE_SIZE(ret)) {
+        return -1;
+    }
+    ptr->PIPE_SIZE = (size_t) ret;
+
+    /* Par défaut, les messages de debug ne sont pas même mis en forme */
+    ret = __loadname(LOG_LEVEL, filename, levels, LOG_INFO);
+    if (ret == -1) {
+        return -1;
+    }
+    ptr->LOG_LEVEL = ret;
+
+    /* Le daemon change de répertoire courant : le chemin doit être absolu */
+    switch (__find(LOG_FILE, filename, ptr->LOG_FILE,
+                sizeof(ptr->LOG_FILE))) {
+    case FIND_ERROR:
+        return -1;
+    case FIND_ABSENT:
+        strcpy(ptr->LOG_FILE, LOG_FILE_SYSLOG);
+    }
+    if (strcmp(ptr->LOG_FILE, LOG_FILE_SYSLOG) == 0) {
+        *ptr->LOG_FILE = '\0';
+    } else if (*ptr->LOG_FILE != '/') {
+        return -1;
+    }
+
+    switch (__find(HISTORY_FILE, filename, ptr->HISTORY_FILE,
+                sizeof(ptr->HISTORY_FILE))) {
+    case FIND_ERROR:
+        return -1;
+    case FIND_ABSENT:
+        snprintf(ptr->HISTORY_FILE, sizeof(ptr->HISTORY_FILE),
+                HISTORY_FILE_DEFAULT, (unsigned) geteuid());
+    }
+    if (strcmp(ptr->HISTORY_FILE, HISTORY_FILE_NONE) == 0) {
+        *ptr->HISTORY_FILE = '\0';
+    } else if (*ptr->HISTORY_FILE != '/') {
+        return -1;
+    }
+
     return 0;
 }
@@ -0,0 +1,311 @@
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "flight.h"
+
+/* Nombre de listes de la table */
+#define FL_BUCKETS 256
+
+/* Taille des lectures de fl_run (capacité par défaut d'un tube) */
+#define FL_CHUNK (64 * 1024)
+
+/**
+ * Abonné d'une requête en cours. Les abonnés sont ajoutés en tête de liste :
+ * le suivant d'un abonné ne change plus, ce qui permet de parcourir la liste
+ * hors verrou à partir d'une tête relevée sous verrou.
+ */
+struct flsub {
+    int out;                /* Sortie, -1 si elle ne peut plus être écrite */
+    uint64_t off;           /* Nombre d'octets de sortie déjà écrits */
+    void *data;             /* Données de l'abonné */
+    struct flsub *next;
+};
+
+struct __flight {
+    uint64_t hash;          /* Empreinte de la clé */
+    char *key;              /* Clé, de longueur keylen */
+    size_t keylen;
+    const void *owner;      /* Propriétaire */
+    int event;              /* Signale à fl_run l'arrivée d'un abonné */
+    char *buf;              /* Sortie conservée, depuis l'octet base */
+    size_t cap;             /* Capacité de buf */
+    uint64_t base;          /* Rang du premier octet de buf */
+    uint64_t total;         /* Nombre d'octets de sortie produits */
+    bool listed;            /* Présente dans la table */
+    bool sealed;            /* Sortie non conservée (FL_REPLAY_MAX) */
+    struct flsub *subs;     /* Abonnés */
+    struct __flight *hnext; /* Suivante dans la liste de la table */
+};
+
+struct __fltable {
+    pthread_mutex_t lock;
+    struct __flight *buckets[FL_BUCKETS];
+};
+
+/* Intègre l'octet c à l'empreinte h (FNV-1a) */
+#define FNV(h, c) (((h) ^ (uint8_t) (c)) * 1099511628211ULL)
+
+/**
+ * Calcule l'empreinte de la clé key de longueur keylen.
+ */
+static uint64_t __fl_hash(const char *key, size_t keylen) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < keylen; i++) {
+        h = FNV(h, key[i]);
+    }
+    return h;
+}
+
+/**
+ * Recherche la requête en cours de clé key. Doit être appelée avec le verrou
+ * de t.
+ */
+static struct __flight *__fl_lookup(FlTable t, uint64_t hash,
+        const char *key, size_t keylen) {
+    for (struct __flight *f = t->buckets[hash % FL_BUCKETS]; f != NULL;
+            f = f->hnext) {
+        if (f->hash == hash && f->keylen == keylen
+                && memcmp(f->key, key, keylen) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Retire f de la table t. Doit être appelée avec le verrou de t.
+ */
+static void __fl_unlist(FlTable t, struct __flight *f) {
+    struct __flight **p = &t->buckets[f->hash % FL_BUCKETS];
+    while (*p != f) {
+        p = &(*p)->hnext;
+    }
+    *p = f->hnext;
+    f->listed = false;
+}
+
+/**
+ * Écrit vers chaque abonné de f la sortie qu'il n'a pas encore reçue.
+ */
+static void __fl_flush(FlTable t, struct __flight *f) {
+    pthread_mutex_lock(&t->lock);
+    struct flsub *head = f->subs;
+    uint64_t total = f->total;
+    pthread_mutex_unlock(&t->lock);
+
+    for (struct flsub *s = head; s != NULL; s = s->next) {
+        while (s->out != -1 && s->off < total) {
+            ssize_t r = write(s->out, f->buf + (s->off - f->base),
+                    (size_t) (total - s->off));
+            if (r == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                close(s->out);
+                s->out = -1;
+                break;
+            }
+            s->off += (uint64_t) r;
+        }
+    }
+}
+
+FlTable fl_create(void) {
+    struct __fltable *t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&t->lock, NULL) != 0) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+int fl_join(FlTable t, const char *key, size_t keylen, const void *owner,
+        int out, void *data) {
+    struct flsub *s = malloc(sizeof(*s));
+    if (s == NULL) {
+        return -1;
+    }
+    *s = (struct flsub) { .out = out, .off = 0, .data = data };
+
+    uint64_t hash = __fl_hash(key, keylen);
+    pthread_mutex_lock(&t->lock);
+    struct __flight *f = __fl_lookup(t, hash, key, keylen);
+    bool created = (f == NULL);
+    if (created) {
+        f = calloc(1, sizeof(*f));
+        if (f == NULL || (f->key = malloc(keylen)) == NULL
+                || (f->event = eventfd(0, EFD_CLOEXEC)) == -1) {
+            pthread_mutex_unlock(&t->lock);
+            if (f != NULL) {
+                free(f->key);
+                free(f);
+            }
+            free(s);
+            return -1;
+        }
+        memcpy(f->key, key, keylen);
+        f->keylen = keylen;
+        f->hash = hash;
+        f->owner = owner;
+        f->listed = true;
+        f->hnext = t->buckets[hash % FL_BUCKETS];
+        t->buckets[hash % FL_BUCKETS] = f;
+    }
+    s->next = f->subs;
+    f->subs = s;
+
+    /* La sortie déjà produite est écrite par le thread de fl_run. La
+     * requête en cours peut être libérée dès le verrou rendu */
+    if (!created) {
+        eventfd_write(f->event, 1);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return created ? 1 : 0;
+}
+
+Flight fl_find(FlTable t, const char *key, size_t keylen,
+        const void *owner) {
+    uint64_t hash = __fl_hash(key, keylen);
+    pthread_mutex_lock(&t->lock);
+    struct __flight *f = __fl_lookup(t, hash, key, keylen);
+    if (f != NULL && f->owner != owner) {
+        f = NULL;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return f;
+}
+
+const void *fl_owner(Flight f) {
+    return f->owner;
+}
+
+int fl_run(FlTable t, Flight f, int in) {
+    struct pollfd pfds[2] = {
+        { .fd = in, .events = POLLIN },
+        { .fd = f->event, .events = POLLIN }
+    };
+    while (1) {
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            eventfd_t n;
+            if (eventfd_read(f->event, &n) == 0) {
+                __fl_flush(t, f);
+            }
+        }
+        if (pfds[0].revents == 0) {
+            continue;
+        }
+
+        /* La lecture est faite directement dans le tampon, agrandi au
+         * besoin */
+        size_t len = (size_t) (f->total - f->base);
+        if (f->cap - len < FL_CHUNK) {
+            size_t cap = f->cap == 0 ? FL_CHUNK : 2 * f->cap;
+            char *buf = realloc(f->buf, cap);
+            if (buf == NULL) {
+                return -1;
+            }
+            f->buf = buf;
+            f->cap = cap;
+        }
+        ssize_t r = read(in, f->buf + len, FL_CHUNK);
+        if (r == 0) {
+            return 0;
+        }
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        /* Au-delà de FL_REPLAY_MAX, la requête en cours quitte la table
+         * avant l'écriture : aucun abonné ne peut plus arriver, et la sortie
+         * écrite vers tous est abandonnée */
+        pthread_mutex_lock(&t->lock);
+        f->total += (uint64_t) r;
+        if (f->listed && f->total > FL_REPLAY_MAX) {
+            __fl_unlist(t, f);
+            f->sealed = true;
+        }
+        pthread_mutex_unlock(&t->lock);
+
+        __fl_flush(t, f);
+        if (f->sealed) {
+            f->base = f->total;
+        }
+    }
+}
+
+void fl_finish(FlTable t, Flight f) {
+    pthread_mutex_lock(&t->lock);
+    if (f->listed) {
+        __fl_unlist(t, f);
+    }
+    pthread_mutex_unlock(&t->lock);
+    __fl_flush(t, f);
+}
+
+const char *fl_output(Flight f, size_t *len) {
+    if (f->sealed) {
+        return NULL;
+    }
+    *len = (size_t) f->total;
+    return f->buf != NULL ? f->buf : "";
+}
+
+int fl_detach(Flight f, void **data) {
+    struct flsub *s = f->subs;
+    if (s == NULL) {
+        return -1;
+    }
+    f->subs = s->next;
+    if (s->out != -1) {
+        close(s->out);
+    }
+    *data = s->data;
+    free(s);
+    return 0;
+}
+
+Flight fl_drain(FlTable t) {
+    struct __flight *f = NULL;
+    for (size_t i = 0; i < FL_BUCKETS && f == NULL; i++) {
+        f = t->buckets[i];
+    }
+    if (f != NULL) {
+        __fl_unlist(t, f);
+    }
+    return f;
+}
+
+void fl_close(Flight *fp) {
+    struct __flight *f = *fp;
+    close(f->event);
+    free(f->key);
+    free(f->buf);
+    free(f);
+    *fp = NULL;
+}
+
+void fl_dispose(FlTable *tp) {
+    pthread_mutex_destroy(&(*tp)->lock);
+    free(*tp);
+    *tp = NULL;
+}
@@ -0,0 +1,71 @@
+#include <string.h>
+
+#include "histo.h"
+
+/* Les valeurs inférieures à 8 ont chacune leur classe. Au-delà, une valeur
+ * dont le bit de poids fort est le bit e appartient à l'une des 8 classes de
+ * [2^e, 2^(e+1)[, désignée par ses trois bits suivants. */
+#define HI_SUB 8
+#define HI_SUB_BITS 3
+
+static unsigned __hi_index(uint64_t v) {
+    if (v < HI_SUB) {
+        return (unsigned) v;
+    }
+    unsigned e = 63 - (unsigned) __builtin_clzll(v);
+    unsigned sub = (unsigned) (v >> (e - HI_SUB_BITS)) & (HI_SUB - 1);
+    return (e - HI_SUB_BITS + 1) * HI_SUB + sub;
+}
+
+/* Plus grande valeur de la classe i */
+static uint64_t __hi_upper(unsigned i) {
+    if (i < HI_SUB) {
+        return i;
+    }
+    unsigned e = i / HI_SUB + HI_SUB_BITS - 1;
+    uint64_t sub = i % HI_SUB;
+    uint64_t width = (uint64_t) 1 << (e - HI_SUB_BITS);
+    return ((uint64_t) HI_SUB + sub + 1) * width - 1;
+}
+
+void hi_reset(struct histo *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+unsigned hi_bucket(uint64_t v) {
+    return __hi_index(v);
+}
+
+void hi_record(struct histo *h, uint64_t v) {
+    h->buckets[__hi_index(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+uint64_t hi_percentile(const struct histo *h, double q) {
+    if (h->count == 0) {
+        return 0;
+    }
+
+    /* Rang (à partir de 1) de la valeur recherchée */
+    uint64_t rank = (uint64_t) (q * (double) h->count);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > h->count) {
+        rank = h->count;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HI_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t up = __hi_upper(i);
+            return up < h->max ? up : h->max;
+        }
+    }
+    return h->max;
+}
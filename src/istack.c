@@ -0,0 +1,78 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "istack.h"
+
+/* Le sommet de la pile associe l'indice du sommet (plus un, 0 désignant la
+ * pile vide) sur les 32 bits de poids faible, et un compteur de modifications
+ * sur les 32 bits de poids fort. Le compteur empêche une comparaison-échange
+ * de réussir à tort si le sommet a été dépilé puis rempilé entre temps
+ * (problème ABA). */
+struct __istack {
+    _Atomic uint64_t top;       /* Sommet et compteur de modifications */
+    atomic_size_t length;       /* Nombre d'indices empilés */
+    size_t n;                   /* Borne des indices */
+    _Atomic uint32_t next[];    /* Indice suivant (plus un) de chaque indice */
+};
+
+#define TOP(tag, idx) ((uint64_t) (tag) << 32 | (uint32_t) (idx))
+#define TOP_TAG(top) ((uint32_t) ((top) >> 32))
+#define TOP_IDX(top) ((uint32_t) (top))
+
+IStack is_create(size_t n) {
+    if (n >= UINT32_MAX) {
+        return NULL;
+    }
+    struct __istack *s = malloc(sizeof(struct __istack)
+            + n * sizeof(_Atomic uint32_t));
+    if (s == NULL) {
+        return NULL;
+    }
+    atomic_init(&s->top, TOP(0, 0));
+    atomic_init(&s->length, 0);
+    s->n = n;
+    for (size_t i = 0; i < n; i++) {
+        atomic_init(&s->next[i], 0);
+    }
+    return s;
+}
+
+void is_push(IStack s, size_t i) {
+    /* Le compteur est incrémenté avant l'empilement et décrémenté après le
+     * dépilement : il ne sous-estime jamais la longueur de la pile */
+    atomic_fetch_add_explicit(&s->length, 1, memory_order_relaxed);
+
+    uint64_t top = atomic_load_explicit(&s->top, memory_order_relaxed);
+    uint64_t ntop;
+    do {
+        atomic_store_explicit(&s->next[i], TOP_IDX(top), memory_order_relaxed);
+        ntop = TOP(TOP_TAG(top) + 1, i + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&s->top, &top, ntop,
+                memory_order_release, memory_order_relaxed));
+}
+
+ssize_t is_pop(IStack s) {
+    uint64_t top = atomic_load_explicit(&s->top, memory_order_acquire);
+    uint64_t ntop;
+    do {
+        if (TOP_IDX(top) == 0) {
+            return -1;
+        }
+        uint32_t next = atomic_load_explicit(&s->next[TOP_IDX(top) - 1],
+                memory_order_relaxed);
+        ntop = TOP(TOP_TAG(top) + 1, next);
+    } while (!atomic_compare_exchange_weak_explicit(&s->top, &top, ntop,
+                memory_order_acquire, memory_order_acquire));
+    atomic_fetch_sub_explicit(&s->length, 1, memory_order_relaxed);
+    return (ssize_t) TOP_IDX(top) - 1;
+}
+
+size_t is_length(IStack s) {
+    return atomic_load_explicit(&s->length, memory_order_relaxed);
+}
+
+void is_dispose(IStack *sp) {
+    free(*sp);
+    *sp = NULL;
+}
@@ -0,0 +1,588 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "jobsched.h"
+
+/* Les travaux sont conservés dans un ensemble de max_length nœuds, chaînés
+ * dans la file de leur client pour leur classe, dans leur ordre d'arrivée.
+ * Les clients qui ont des travaux dans une classe forment un anneau, parcouru
+ * par le curseur de la classe. Un client existe tant qu'il a des travaux en
+ * attente ou en cours : il y en a au plus max_length + max_running. Les
+ * éléments libres sont chaînés par leur champ next.
+ *
+ * Tous les travaux forment de plus une liste d'arrivée, dans leur ordre
+ * d'insertion, quels que soient leur classe et leur client : le vieillissement,
+ * l'échéance et le vidage la parcourent depuis le plus ancien travail. */
+
+#define NIL SIZE_MAX
+
+struct jsnode {
+    struct job job;
+    size_t prev;            /* Nœud précédent de la file du client */
+    size_t next;            /* Nœud suivant de la file du client */
+    size_t aprev;           /* Nœud précédent de la liste d'arrivée */
+    size_t anext;           /* Nœud suivant de la liste d'arrivée */
+};
+
+struct jsqueue {
+    size_t head;            /* Premier nœud de la file, NIL si elle est vide */
+    size_t tail;            /* Dernier nœud de la file */
+    long deficit;           /* Crédit restant du client dans la classe */
+    size_t prev;            /* Client précédent de l'anneau de la classe */
+    size_t next;            /* Client suivant de l'anneau de la classe */
+};
+
+struct jstenant {
+    uint32_t uid;           /* Identifiant du client (sans nom) */
+    char name[REQUEST_TENANT_MAX];  /* Nom du client, vide si aucun */
+    size_t hnext;           /* Client suivant de la même alvéole */
+    size_t queued;          /* Nombre de travaux en attente */
+    size_t running;         /* Nombre de travaux en cours */
+    struct jsqueue queues[RQ_PRIO_COUNT];
+};
+
+struct jsclass {
+    size_t length;          /* Nombre de travaux de la classe */
+    int credit;             /* Travaux restant à servir dans le tour courant */
+    size_t cursor;          /* Client courant de l'anneau, NIL si vide */
+    bool granted;           /* Indique si cursor a reçu son crédit du tour */
+    struct histo waits;     /* Durées d'attente des travaux retirés */
+};
+
+struct __jobsched {
+    size_t length;          /* Longueur courante de la file */
+    size_t max_length;      /* Longueur maximale de la file */
+    enum js_policy policy;  /* Politique de choix de la classe servie */
+    long aging;             /* Délai de vieillissement en millisecondes */
+    size_t tenant_max;      /* Nombre maximal de travaux en cours par client */
+    enum js_order order;    /* Ordre des travaux dans la file d'un client */
+    size_t ahead;           /* Premier nœud de la liste d'arrivée */
+    size_t atail;           /* Dernier nœud de la liste d'arrivée */
+    struct jsclass classes[RQ_PRIO_COUNT];
+    struct jsnode *nodes;   /* Nœuds des travaux */
+    size_t freenode;        /* Premier nœud libre */
+    struct jstenant *tenants;   /* Clients */
+    size_t freetenant;      /* Premier client libre */
+    size_t *buckets;        /* Table de hachage des clients */
+    size_t nbuckets;        /* Nombre d'alvéoles, puissance de deux */
+};
+
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_MSEC 1000000L
+
+#define HAS_DEADLINE(job) \
+    ((job)->deadline.tv_sec != 0 || (job)->deadline.tv_nsec != 0)
+
+static const int weights[RQ_PRIO_COUNT] = {
+    JS_WEIGHT_HIGH, JS_WEIGHT_NORMAL, JS_WEIGHT_LOW
+};
+
+/* Classe de priorité du travail job */
+static size_t __js_prio(const struct job *job) {
+    uint32_t prio = job->rq->prio;
+    return prio < RQ_PRIO_COUNT ? prio : RQ_PRIO_NORMAL;
+}
+
+/* Coût du travail job pour le deficit round robin */
+static long __js_cost(const struct job *job) {
+    if (job->cost == 0) {
+        return JS_COST_DEFAULT;
+    }
+    return job->cost < JS_COST_MAX ? (long) job->cost : JS_COST_MAX;
+}
+
+/* Indique si a doit être servi avant b, selon l'ordre de la file */
+static bool __js_fifo(const struct job *a, const struct job *b) {
+    (void) a;
+    (void) b;
+    return false;
+}
+
+static bool __js_sjf(const struct job *a, const struct job *b) {
+    return __js_cost(a) < __js_cost(b);
+}
+
+static bool __js_ljf(const struct job *a, const struct job *b) {
+    return __js_cost(a) > __js_cost(b);
+}
+
+/* Fonctions de comparaison, dans l'ordre de enum js_order */
+static bool (*const orders[])(const struct job *, const struct job *) = {
+    __js_fifo, __js_sjf, __js_ljf
+};
+
+/* Clé du client de la requête rq : le nom s'il est donné, l'uid sinon */
+static void __js_key(const struct request *rq, uint32_t *uid, char *name) {
+    memcpy(name, rq->tenant, REQUEST_TENANT_MAX);
+    name[REQUEST_TENANT_MAX - 1] = '\0';
+    *uid = (name[0] == '\0') ? rq->uid : 0;
+}
+
+/* Alvéole du client de clé (uid, name) (FNV-1a) */
+static size_t __js_hash(JobSched s, uint32_t uid, const char *name) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(uid); i++) {
+        h = (h ^ ((uid >> (8 * i)) & 0xff)) * 1099511628211ULL;
+    }
+    for (const char *c = name; *c != '\0'; c++) {
+        h = (h ^ (unsigned char) *c) * 1099511628211ULL;
+    }
+    return (size_t) h & (s->nbuckets - 1);
+}
+
+/**
+ * Renvoie l'indice du client du travail job, créé au besoin.
+ *
+ * @return  L'indice du client, NIL si le nombre maximal de clients est
+ *          atteint.
+ */
+static size_t __js_tenant(JobSched s, const struct job *job) {
+    uint32_t uid;
+    char name[REQUEST_TENANT_MAX];
+    __js_key(job->rq, &uid, name);
+    size_t b = __js_hash(s, uid, name);
+    for (size_t t = s->buckets[b]; t != NIL; t = s->tenants[t].hnext) {
+        if (s->tenants[t].uid == uid && strcmp(s->tenants[t].name, name) == 0) {
+            return t;
+        }
+    }
+
+    size_t t = s->freetenant;
+    if (t == NIL) {
+        return NIL;
+    }
+    struct jstenant *tn = &s->tenants[t];
+    s->freetenant = tn->hnext;
+    tn->uid = uid;
+    memcpy(tn->name, name, REQUEST_TENANT_MAX);
+    tn->queued = 0;
+    tn->running = 0;
+    for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+        tn->queues[p].head = NIL;
+    }
+    tn->hnext = s->buckets[b];
+    s->buckets[b] = t;
+    return t;
+}
+
+/* Libère le client t s'il n'a plus de travaux en attente ni en cours */
+static void __js_release(JobSched s, size_t t) {
+    struct jstenant *tn = &s->tenants[t];
+    if (tn->queued > 0 || tn->running > 0) {
+        return;
+    }
+    size_t *link = &s->buckets[__js_hash(s, tn->uid, tn->name)];
+    while (*link != t) {
+        link = &s->tenants[*link].hnext;
+    }
+    *link = tn->hnext;
+    tn->hnext = s->freetenant;
+    s->freetenant = t;
+}
+
+/* Indique si le client t a atteint sa borne de travaux en cours */
+static bool __js_capped(JobSched s, size_t t) {
+    return s->tenant_max > 0 && s->tenants[t].running >= s->tenant_max;
+}
+
+/* Indique si la classe p a un travail qui peut être servi */
+static bool __js_ready(JobSched s, size_t p) {
+    size_t first = s->classes[p].cursor;
+    if (first == NIL || s->tenant_max == 0) {
+        return first != NIL;
+    }
+    size_t t = first;
+    do {
+        if (!__js_capped(s, t)) {
+            return true;
+        }
+        t = s->tenants[t].queues[p].next;
+    } while (t != first);
+    return false;
+}
+
+/**
+ * Retire le nœud n de la file de son client et copie son travail dans job. Le
+ * client quitte l'anneau de la classe si sa file devient vide.
+ *
+ * @return  L'indice du client.
+ */
+static size_t __js_remove(JobSched s, size_t n, struct job *job) {
+    struct jsnode *nd = &s->nodes[n];
+    size_t t = nd->job.tenant;
+    size_t p = __js_prio(&nd->job);
+    struct jstenant *tn = &s->tenants[t];
+    struct jsqueue *q = &tn->queues[p];
+    *job = nd->job;
+
+    if (nd->prev == NIL) {
+        q->head = nd->next;
+    } else {
+        s->nodes[nd->prev].next = nd->next;
+    }
+    if (nd->next == NIL) {
+        q->tail = nd->prev;
+    } else {
+        s->nodes[nd->next].prev = nd->prev;
+    }
+    if (nd->aprev == NIL) {
+        s->ahead = nd->anext;
+    } else {
+        s->nodes[nd->aprev].anext = nd->anext;
+    }
+    if (nd->anext == NIL) {
+        s->atail = nd->aprev;
+    } else {
+        s->nodes[nd->anext].aprev = nd->aprev;
+    }
+    nd->next = s->freenode;
+    s->freenode = n;
+
+    /* Un client dont la file est vide perd son crédit restant */
+    struct jsclass *c = &s->classes[p];
+    if (q->head == NIL) {
+        if (q->next == t) {
+            c->cursor = NIL;
+        } else {
+            s->tenants[q->prev].queues[p].next = q->next;
+            s->tenants[q->next].queues[p].prev = q->prev;
+            if (c->cursor == t) {
+                c->cursor = q->next;
+                c->granted = false;
+            }
+        }
+    }
+
+    tn->queued--;
+    c->length--;
+    s->length--;
+    return t;
+}
+
+/**
+ * Choisit la classe dont la file s doit servir le prochain travail, en
+ * renseignant dans *aged le nœud du travail qui a dépassé le délai de
+ * vieillissement, NIL si aucun.
+ *
+ * @return  L'indice de la classe, RQ_PRIO_COUNT si aucun travail ne peut être
+ *          servi.
+ */
+static size_t __js_choose(JobSched s, const struct timespec *now,
+        size_t *aged) {
+    /* Le plus ancien des travaux qui ont dépassé le délai de vieillissement
+     * passe avant tous les autres */
+    *aged = NIL;
+    if (now != NULL && s->aging > 0) {
+        for (size_t n = s->ahead; n != NIL; n = s->nodes[n].anext) {
+            const struct job *j = &s->nodes[n].job;
+            struct timespec due = ts_add_ms(j->queued, s->aging);
+            if (ts_cmp(&due, now) > 0) {
+                break;
+            }
+            if (!__js_capped(s, j->tenant)) {
+                *aged = n;
+                return __js_prio(j);
+            }
+        }
+    }
+
+    bool ready[RQ_PRIO_COUNT];
+    for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+        ready[p] = __js_ready(s, p);
+    }
+
+    if (s->policy == JS_WEIGHTED) {
+        /* Un nouveau tour commence lorsqu'aucune classe prête n'a plus de
+         * crédit */
+        for (int round = 0; round < 2; round++) {
+            for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+                struct jsclass *c = &s->classes[p];
+                if (ready[p] && c->credit > 0) {
+                    c->credit--;
+                    return p;
+                }
+            }
+            for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+                s->classes[p].credit = weights[p];
+            }
+        }
+    }
+
+    size_t p = 0;
+    while (p < RQ_PRIO_COUNT && !ready[p]) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Choisit par deficit round robin le client de la classe p, qui doit être
+ * prête, dont le prochain travail est servi.
+ */
+static size_t __js_drr(JobSched s, size_t p) {
+    struct jsclass *c = &s->classes[p];
+
+    /* Le coût d'un travail étant borné par JS_COST_MAX, un client non borné
+     * est servi au plus JS_COST_MAX / JS_QUANTUM tours après son arrivée */
+    while (1) {
+        size_t t = c->cursor;
+        struct jsqueue *q = &s->tenants[t].queues[p];
+        if (!__js_capped(s, t)) {
+            if (!c->granted) {
+                q->deficit += JS_QUANTUM;
+                c->granted = true;
+            }
+            if (__js_cost(&s->nodes[q->head].job) <= q->deficit) {
+                return t;
+            }
+        }
+        c->cursor = q->next;
+        c->granted = false;
+    }
+}
+
+JobSched js_create(size_t max_length, size_t max_running,
+        enum js_policy policy, enum js_order order, long aging,
+        size_t tenant_max) {
+    struct __jobsched *s = malloc(sizeof(struct __jobsched));
+    if (s == NULL) {
+        return NULL;
+    }
+    size_t ntenants = max_length + max_running;
+    s->nbuckets = 1;
+    while (s->nbuckets < ntenants) {
+        s->nbuckets <<= 1;
+    }
+    s->nodes = malloc(max_length * sizeof(struct jsnode));
+    s->tenants = malloc(ntenants * sizeof(struct jstenant));
+    s->buckets = malloc(s->nbuckets * sizeof(size_t));
+    if (s->nodes == NULL || s->tenants == NULL || s->buckets == NULL) {
+        js_dispose(&s);
+        return NULL;
+    }
+
+    s->length = 0;
+    s->max_length = max_length;
+    s->policy = policy;
+    s->aging = aging;
+    s->tenant_max = tenant_max;
+    s->order = order;
+    s->ahead = NIL;
+    s->atail = NIL;
+    for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+        struct jsclass *c = &s->classes[p];
+        c->length = 0;
+        c->credit = weights[p];
+        c->cursor = NIL;
+        c->granted = false;
+        hi_reset(&c->waits);
+    }
+    for (size_t n = 0; n < max_length; n++) {
+        s->nodes[n].next = (n + 1 < max_length) ? n + 1 : NIL;
+    }
+    s->freenode = (max_length > 0) ? 0 : NIL;
+    for (size_t t = 0; t < ntenants; t++) {
+        s->tenants[t].hnext = (t + 1 < ntenants) ? t + 1 : NIL;
+    }
+    s->freetenant = (ntenants > 0) ? 0 : NIL;
+    for (size_t b = 0; b < s->nbuckets; b++) {
+        s->buckets[b] = NIL;
+    }
+    return s;
+}
+
+int js_push(JobSched s, const struct job *job) {
+    if (s->length == s->max_length) {
+        return -1;
+    }
+    size_t t = __js_tenant(s, job);
+    if (t == NIL) {
+        return -1;
+    }
+
+    size_t p = __js_prio(job);
+    size_t n = s->freenode;
+    s->freenode = s->nodes[n].next;
+    struct jsnode *nd = &s->nodes[n];
+    nd->job = *job;
+    nd->job.tenant = t;
+    nd->aprev = s->atail;
+    nd->anext = NIL;
+    if (s->atail == NIL) {
+        s->ahead = n;
+    } else {
+        s->nodes[s->atail].anext = n;
+    }
+    s->atail = n;
+
+    struct jstenant *tn = &s->tenants[t];
+    struct jsqueue *q = &tn->queues[p];
+    struct jsclass *c = &s->classes[p];
+    if (q->head == NIL) {
+        /* Le client rejoint l'anneau de la classe juste avant le curseur :
+         * il sera servi en dernier dans le tour courant */
+        nd->prev = NIL;
+        nd->next = NIL;
+        q->head = n;
+        q->tail = n;
+        q->deficit = 0;
+        if (c->cursor == NIL) {
+            q->prev = t;
+            q->next = t;
+            c->cursor = t;
+            c->granted = false;
+        } else {
+            size_t last = s->tenants[c->cursor].queues[p].prev;
+            q->prev = last;
+            q->next = c->cursor;
+            s->tenants[last].queues[p].next = t;
+            s->tenants[c->cursor].queues[p].prev = t;
+        }
+    } else {
+        /* Le travail est placé après le dernier de ceux qui ne doivent pas
+         * être servis après lui : l'ordre d'arrivée départage les travaux
+         * équivalents */
+        size_t m = q->tail;
+        while (m != NIL && orders[s->order](job, &s->nodes[m].job)) {
+            m = s->nodes[m].prev;
+        }
+        nd->prev = m;
+        if (m == NIL) {
+            nd->next = q->head;
+            q->head = n;
+        } else {
+            nd->next = s->nodes[m].next;
+            s->nodes[m].next = n;
+        }
+        if (nd->next == NIL) {
+            q->tail = n;
+        } else {
+            s->nodes[nd->next].prev = n;
+        }
+    }
+
+    tn->queued++;
+    c->length++;
+    s->length++;
+    return 0;
+}
+
+bool js_ready(JobSched s) {
+    for (size_t p = 0; p < RQ_PRIO_COUNT; p++) {
+        if (__js_ready(s, p)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int js_pop(JobSched s, const struct timespec *now, struct job *job) {
+    if (s->length == 0) {
+        return -1;
+    }
+    size_t n;
+    size_t p = __js_choose(s, now, &n);
+    if (p == RQ_PRIO_COUNT) {
+        return -1;
+    }
+
+    /* Un travail servi par vieillissement n'est pas décompté du crédit de
+     * son client : le crédit reste borné, et avec lui la durée de
+     * __js_drr() */
+    if (n == NIL) {
+        struct jsqueue *q = &s->tenants[__js_drr(s, p)].queues[p];
+        n = q->head;
+        q->deficit -= __js_cost(&s->nodes[n].job);
+    }
+    size_t t = __js_remove(s, n, job);
+    s->tenants[t].running++;
+
+    if (now != NULL) {
+        long long wait = ts_diff_ns(&job->queued, now);
+        hi_record(&s->classes[p].waits, wait > 0 ? (uint64_t) wait : 0);
+    }
+    return 0;
+}
+
+int js_drain(JobSched s, struct job *job) {
+    if (s->ahead == NIL) {
+        return -1;
+    }
+    __js_release(s, __js_remove(s, s->ahead, job));
+    return 0;
+}
+
+void js_done(JobSched s, const struct job *job) {
+    s->tenants[job->tenant].running--;
+    __js_release(s, job->tenant);
+}
+
+int js_expire(JobSched s, const struct timespec *now, struct job *job) {
+    for (size_t n = s->ahead; n != NIL; n = s->nodes[n].anext) {
+        struct job *j = &s->nodes[n].job;
+        if (HAS_DEADLINE(j) && ts_cmp(&j->deadline, now) <= 0) {
+            __js_release(s, __js_remove(s, n, job));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int js_deadline(JobSched s, struct timespec *ts) {
+    int ret = -1;
+    for (size_t n = s->ahead; n != NIL; n = s->nodes[n].anext) {
+        struct job *j = &s->nodes[n].job;
+        if (HAS_DEADLINE(j) && (ret == -1 || ts_cmp(&j->deadline, ts) < 0)) {
+            *ts = j->deadline;
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+size_t js_length(JobSched s) {
+    return s->length;
+}
+
+const struct histo *js_waits(JobSched s, enum rq_priority prio) {
+    return &s->classes[prio].waits;
+}
+
+void js_dispose(JobSched *sp) {
+    if (*sp != NULL) {
+        free((*sp)->nodes);
+        free((*sp)->tenants);
+        free((*sp)->buckets);
+    }
+    free(*sp);
+    *sp = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int ts_cmp(const struct timespec *a, const struct timespec *b) {
+    if (a->tv_sec != b->tv_sec) {
+        return a->tv_sec < b->tv_sec ? -1 : 1;
+    }
+    if (a->tv_nsec != b->tv_nsec) {
+        return a->tv_nsec < b->tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+struct timespec ts_add_ms(struct timespec ts, long ms) {
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * NSEC_PER_MSEC;
+    if (ts.tv_nsec >= NSEC_PER_SEC) {
+        ts.tv_sec++;
+        ts.tv_nsec -= NSEC_PER_SEC;
+    }
+    return ts;
+}
+
+long long ts_diff_ns(const struct timespec *a, const struct timespec *b) {
+    return (long long) (b->tv_sec - a->tv_sec) * NSEC_PER_SEC
+        + (b->tv_nsec - a->tv_nsec);
+}
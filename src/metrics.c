@@ -0,0 +1,162 @@
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+/**
+ * Histogramme mis à jour sans verrou (voir struct histo).
+ */
+struct mthisto {
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[HI_BUCKETS];
+};
+
+struct mtpage {
+    uint64_t started;       /* Création de la page (ns, CLOCK_MONOTONIC) */
+    _Atomic uint64_t counters[MT_COUNTERS];
+    _Atomic int64_t gauges[MT_GAUGES];
+    struct mthisto histos[MT_HISTOS];
+};
+
+struct __metrics {
+    const char *shm_name;   /* Nom de la SHM, NULL si elle est seulement
+                               ouverte */
+    struct mtpage *page;    /* La page, projetée en mémoire */
+};
+
+/**
+ * Renvoie l'instant présent en nanosecondes (CLOCK_MONOTONIC, commune à tous
+ * les processus).
+ */
+static uint64_t __mt_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+Metrics mt_empty(const char *shm_name) {
+    struct __metrics *m = malloc(sizeof(*m));
+    if (m == NULL) {
+        return NULL;
+    }
+
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        free(m);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(struct mtpage)) == -1) {
+        close(fd);
+        goto error;
+    }
+    m->page = mmap(NULL, sizeof(struct mtpage), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (m->page == MAP_FAILED) {
+        goto error;
+    }
+
+    /* La SHM est initialement nulle */
+    m->shm_name = shm_name;
+    m->page->started = __mt_now();
+    return m;
+
+error:
+    shm_unlink(shm_name);
+    free(m);
+    return NULL;
+}
+
+Metrics mt_open(const char *shm_name) {
+    struct __metrics *m = malloc(sizeof(*m));
+    if (m == NULL) {
+        return NULL;
+    }
+
+    /* Une page en cours de création n'a pas encore sa taille */
+    int fd = shm_open(shm_name, O_RDONLY, 0);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1
+            || st.st_size != (off_t) sizeof(struct mtpage)) {
+        if (fd != -1) {
+            close(fd);
+        }
+        free(m);
+        return NULL;
+    }
+    m->page = mmap(NULL, sizeof(struct mtpage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m->page == MAP_FAILED) {
+        free(m);
+        return NULL;
+    }
+    m->shm_name = NULL;
+    return m;
+}
+
+void mt_add(Metrics m, enum mt_counter c, uint64_t n) {
+    atomic_fetch_add_explicit(&m->page->counters[c], n, memory_order_relaxed);
+}
+
+void mt_set(Metrics m, enum mt_gauge g, int64_t v) {
+    atomic_store_explicit(&m->page->gauges[g], v, memory_order_relaxed);
+}
+
+void mt_adjust(Metrics m, enum mt_gauge g, int64_t d) {
+    atomic_fetch_add_explicit(&m->page->gauges[g], d, memory_order_relaxed);
+}
+
+void mt_record(Metrics m, enum mt_histo h, uint64_t v) {
+    struct mthisto *mh = &m->page->histos[h];
+    atomic_fetch_add_explicit(&mh->buckets[hi_bucket(v)], 1,
+            memory_order_relaxed);
+    atomic_fetch_add_explicit(&mh->sum, v, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&mh->max, memory_order_relaxed);
+    while (v > max && !atomic_compare_exchange_weak_explicit(&mh->max, &max,
+                v, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+uint64_t mt_counter(Metrics m, enum mt_counter c) {
+    return atomic_load_explicit(&m->page->counters[c], memory_order_relaxed);
+}
+
+int64_t mt_gauge(Metrics m, enum mt_gauge g) {
+    return atomic_load_explicit(&m->page->gauges[g], memory_order_relaxed);
+}
+
+void mt_histo(Metrics m, enum mt_histo h, struct histo *out) {
+    /* Le nombre de valeurs est celui des classes copiées : hi_percentile()
+     * reste exact pour la copie, même lue pendant des mises à jour */
+    struct mthisto *mh = &m->page->histos[h];
+    out->count = 0;
+    for (size_t i = 0; i < HI_BUCKETS; i++) {
+        out->buckets[i] = atomic_load_explicit(&mh->buckets[i],
+                memory_order_relaxed);
+        out->count += out->buckets[i];
+    }
+    out->sum = atomic_load_explicit(&mh->sum, memory_order_relaxed);
+    out->max = atomic_load_explicit(&mh->max, memory_order_relaxed);
+}
+
+double mt_uptime(Metrics m) {
+    return (double) (__mt_now() - m->page->started) / 1e9;
+}
+
+void mt_dispose(Metrics *mp) {
+    struct __metrics *m = *mp;
+    munmap(m->page, sizeof(struct mtpage));
+    if (m->shm_name != NULL) {
+        shm_unlink(m->shm_name);
+    }
+    free(m);
+    *mp = NULL;
+}
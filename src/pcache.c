@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pcache.h"
+
+/* Événements invalidant le cache dans un répertoire surveillé */
+#define PC_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+        | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* Taille du tampon de lecture des événements */
+#define PC_EVENTS_SIZE 4096
+
+/* Étape de l'empreinte FNV-1a */
+#define FNV(h, c) (((h) ^ (uint8_t) (c)) * 1099511628211ULL)
+
+struct __pcache {
+    pthread_mutex_t lock;
+    uint64_t gen;               /* Incrémenté à chaque vidage */
+    size_t count;               /* Nombre d'entrées */
+    uint64_t hashes[PC_SLOTS];  /* Empreinte des noms, 0 si libre */
+    char *entries[PC_SLOTS];    /* Le nom puis le chemin, terminés par '\0' */
+    bool stale;                 /* La surveillance s'est arrêtée */
+
+    int fd;                     /* L'instance inotify */
+    pthread_t th;               /* Le thread de surveillance */
+
+    char *path;                 /* Copie de PATH, découpée en répertoires */
+    size_t ndirs;
+    char **dirs;
+};
+
+/**
+ * Calcule l'empreinte du nom name.
+ *
+ * @return  L'empreinte, jamais nulle.
+ */
+static uint64_t __pc_hash(const char *name) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const char *c = name; *c != '\0'; c++) {
+        h = FNV(h, *c);
+    }
+    return h != 0 ? h : 1;
+}
+
+/**
+ * Recherche l'entrée du nom name, d'empreinte hash. Doit être appelée avec
+ * pc->lock.
+ *
+ * @return  L'entrée, NULL si elle est absente.
+ */
+static const char *__pc_find(PCache pc, uint64_t hash, const char *name) {
+    for (size_t i = 0; i < PC_SLOTS; i++) {
+        size_t k = (hash + i) % PC_SLOTS;
+        if (pc->hashes[k] == 0) {
+            return NULL;
+        }
+        if (pc->hashes[k] == hash && strcmp(pc->entries[k], name) == 0) {
+            return pc->entries[k];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Vide le cache. Doit être appelée avec pc->lock.
+ */
+static void __pc_flush(PCache pc) {
+    for (size_t k = 0; k < PC_SLOTS; k++) {
+        free(pc->entries[k]);
+        pc->entries[k] = NULL;
+        pc->hashes[k] = 0;
+    }
+    pc->count = 0;
+    pc->gen++;
+}
+
+/**
+ * Ajoute l'entrée associant le nom name de longueur namelen, d'empreinte
+ * hash, au chemin file de longueur filelen. Doit être appelée avec pc->lock.
+ * Une entrée qui ne peut être allouée n'est pas ajoutée.
+ */
+static void __pc_insert(PCache pc, uint64_t hash, const char *name,
+        size_t namelen, const char *file, size_t filelen) {
+    if (pc->count >= PC_SLOTS / 4 * 3) {
+        __pc_flush(pc);
+    }
+    char *e = malloc(namelen + 1 + filelen + 1);
+    if (e == NULL) {
+        return;
+    }
+    memcpy(e, name, namelen + 1);
+    memcpy(e + namelen + 1, file, filelen + 1);
+
+    size_t k = hash % PC_SLOTS;
+    while (pc->hashes[k] != 0) {
+        k = (k + 1) % PC_SLOTS;
+    }
+    pc->hashes[k] = hash;
+    pc->entries[k] = e;
+    pc->count++;
+}
+
+/**
+ * Cherche la commande name de longueur namelen dans les répertoires de PATH,
+ * dans l'ordre, comme le ferait execvp().
+ *
+ * @arg     file    Reçoit le chemin du premier fichier exécutable trouvé.
+ * @arg     filelen Reçoit la longueur de ce chemin.
+ * @return          0 en cas de succès, -1 sinon (voir pc_resolve()).
+ */
+static int __pc_search(PCache pc, const char *name, size_t namelen,
+        char *file, size_t size, size_t *filelen) {
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        const char *dir = pc->dirs[i];
+        if (*dir != '/') {
+            errno = EINVAL;
+            return -1;
+        }
+        size_t dirlen = strlen(dir);
+        if (dirlen + 1 + namelen >= size) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(file, dir, dirlen);
+        file[dirlen] = '/';
+        memcpy(file + dirlen + 1, name, namelen + 1);
+
+        struct stat st;
+        if (stat(file, &st) == 0 && S_ISREG(st.st_mode)
+                && faccessat(AT_FDCWD, file, X_OK, AT_EACCESS) == 0) {
+            *filelen = dirlen + 1 + namelen;
+            return 0;
+        }
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+/**
+ * Thread de surveillance : chaque lot d'événements reçu vide le cache.
+ */
+static void *__pc_watch(void *arg) {
+    PCache pc = arg;
+    _Alignas(struct inotify_event) char buf[PC_EVENTS_SIZE];
+    while (1) {
+        ssize_t r = read(pc->fd, buf, sizeof(buf));
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+
+        /* Sans surveillance, les chemins ne sont plus mis en cache */
+        pthread_mutex_lock(&pc->lock);
+        __pc_flush(pc);
+        pc->stale = (r <= 0);
+        pthread_mutex_unlock(&pc->lock);
+        if (r <= 0) {
+            return NULL;
+        }
+    }
+}
+
+PCache pc_create(const char *path) {
+    struct __pcache *pc = calloc(1, sizeof(struct __pcache));
+    if (pc == NULL) {
+        return NULL;
+    }
+    pc->path = strdup(path != NULL ? path : PC_PATH_DEFAULT);
+    if (pc->path == NULL) {
+        goto error;
+    }
+
+    /* Les répertoires sont désignés en place dans la copie de PATH. Un
+     * répertoire vide désigne le répertoire courant, comme pour execvp */
+    pc->ndirs = 1;
+    for (const char *c = pc->path; *c != '\0'; c++) {
+        pc->ndirs += (*c == ':');
+    }
+    pc->dirs = malloc(pc->ndirs * sizeof(*pc->dirs));
+    if (pc->dirs == NULL) {
+        goto error;
+    }
+    char *dir = pc->path;
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        pc->dirs[i] = dir;
+        dir += strcspn(dir, ":");
+        if (*dir == ':') {
+            *dir++ = '\0';
+        }
+    }
+
+    pc->fd = inotify_init1(IN_CLOEXEC);
+    if (pc->fd == -1) {
+        goto error;
+    }
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        if (*pc->dirs[i] == '/') {
+            inotify_add_watch(pc->fd, pc->dirs[i], PC_EVENTS | IN_ONLYDIR);
+        }
+    }
+
+    if (pthread_mutex_init(&pc->lock, NULL) != 0) {
+        close(pc->fd);
+        goto error;
+    }
+    if (pthread_create(&pc->th, NULL, __pc_watch, pc) != 0) {
+        pthread_mutex_destroy(&pc->lock);
+        close(pc->fd);
+        goto error;
+    }
+    return pc;
+
+error:
+    free(pc->dirs);
+    free(pc->path);
+    free(pc);
+    return NULL;
+}
+
+int pc_resolve(PCache pc, const char *name, char *file, size_t size) {
+    if (*name == '\0' || strchr(name, '/') != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t namelen = strlen(name);
+    uint64_t hash = __pc_hash(name);
+
+    pthread_mutex_lock(&pc->lock);
+    const char *e = __pc_find(pc, hash, name);
+    if (e != NULL) {
+        const char *f = e + namelen + 1;
+        size_t len = strlen(f);
+        int ret = 1;
+        if (len < size) {
+            memcpy(file, f, len + 1);
+        } else {
+            errno = ENAMETOOLONG;
+            ret = -1;
+        }
+        pthread_mutex_unlock(&pc->lock);
+        return ret;
+    }
+    uint64_t gen = pc->gen;
+    bool stale = pc->stale;
+    pthread_mutex_unlock(&pc->lock);
+
+    /* La recherche a lieu hors du verrou : son résultat n'est pas ajouté si
+     * le cache a été vidé entre temps, car il a pu être obtenu avant la
+     * modification qui a provoqué le vidage */
+    size_t len;
+    if (__pc_search(pc, name, namelen, file, size, &len) == -1) {
+        return -1;
+    }
+    if (!stale) {
+        pthread_mutex_lock(&pc->lock);
+        if (pc->gen == gen && __pc_find(pc, hash, name) == NULL) {
+            __pc_insert(pc, hash, name, namelen, file, len);
+        }
+        pthread_mutex_unlock(&pc->lock);
+    }
+    return 0;
+}
+
+void pc_dispose(PCache *pcp) {
+    struct __pcache *pc = *pcp;
+    pthread_cancel(pc->th);
+    pthread_join(pc->th, NULL);
+    close(pc->fd);
+    __pc_flush(pc);
+    pthread_mutex_destroy(&pc->lock);
+    free(pc->dirs);
+    free(pc->path);
+    free(pc);
+    *pcp = NULL;
+}
@@ -0,0 +1,338 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rcache.h"
+#include "sarena.h"
+
+/* Une entrée occupe l'un des RC_PROBE emplacements de l'index qui suivent
+ * celui désigné par l'empreinte de sa clé (sondage linéaire). Sa clé puis sa
+ * sortie sont placées bout à bout dans une même allocation de la zone. */
+
+#define RC_PROBE 8
+
+/* Nombre maximal de tentatives d'une lecture concurrente d'écritures */
+#define RC_RETRY 64
+
+struct rcentry {
+    uint64_t hash;          /* Empreinte de la clé, 0 si l'entrée est libre */
+    uint64_t off;           /* Décalage de la clé et de la sortie */
+    uint32_t keylen;        /* Longueur de la clé */
+    uint32_t outlen;        /* Longueur de la sortie */
+    int32_t status;         /* Statut de la commande */
+    uint64_t expires;       /* Échéance de l'entrée (ms, CLOCK_MONOTONIC) */
+    _Atomic uint64_t used;  /* Dernière consultation (ms, CLOCK_MONOTONIC) */
+};
+
+struct rcindex {
+    _Atomic uint32_t seq;   /* Compteur de séquence, impair pendant une
+                               écriture */
+    uint64_t size;          /* Capacité de la zone d'allocation */
+    struct rcentry entries[RC_ENTRIES];
+};
+
+struct __rcache {
+    const char *shm_name;   /* Nom de la SHM de l'index */
+    struct rcindex *idx;    /* L'index, projeté en mémoire */
+    SArena data;            /* La zone des clés et des sorties */
+};
+
+/* Intègre l'octet c à l'empreinte h (FNV-1a) */
+#define FNV(h, c) (((h) ^ (uint8_t) (c)) * 1099511628211ULL)
+
+/**
+ * Calcule l'empreinte de la clé key de longueur keylen.
+ *
+ * @return  L'empreinte, jamais nulle.
+ */
+static uint64_t __rc_hash(const char *key, size_t keylen) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < keylen; i++) {
+        h = FNV(h, key[i]);
+    }
+    return h != 0 ? h : 1;
+}
+
+/**
+ * Renvoie l'instant présent en millisecondes (CLOCK_MONOTONIC, commune à
+ * tous les processus).
+ */
+static uint64_t __rc_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+/**
+ * Copie des champs d'une entrée, lus une seule fois.
+ */
+struct rcview {
+    uint64_t off;
+    uint32_t outlen;
+    int32_t status;
+    uint64_t expires;
+};
+
+/**
+ * Recherche l'entrée de clé key, d'empreinte hash, et copie ses champs dans
+ * view.
+ *
+ * Les champs d'une entrée lue pendant une écriture peuvent être incohérents :
+ * ils sont lus une seule fois, puis vérifiés avant tout accès à la zone.
+ *
+ * @return  L'entrée, NULL si elle est absente.
+ */
+static struct rcentry *__rc_find(RCache c, uint64_t hash, const char *key,
+        size_t keylen, struct rcview *view) {
+    for (size_t i = 0; i < RC_PROBE; i++) {
+        struct rcentry *e = &c->idx->entries[(hash + i) % RC_ENTRIES];
+        const volatile struct rcentry *v = e;
+        if (v->hash != hash || v->keylen != keylen) {
+            continue;
+        }
+        view->off = v->off;
+        view->outlen = v->outlen;
+        view->status = v->status;
+        view->expires = v->expires;
+        if (view->outlen > RC_OUTPUT_MAX
+                || view->off + keylen + view->outlen > c->idx->size) {
+            continue;
+        }
+        if (memcmp(sa_ptr(c->data, view->off), key, keylen) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Débute (odd vaut true) ou termine une écriture dans l'index de c.
+ */
+static void __rc_write(RCache c, bool odd) {
+    if (odd) {
+        atomic_fetch_add_explicit(&c->idx->seq, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    } else {
+        atomic_fetch_add_explicit(&c->idx->seq, 1, memory_order_release);
+    }
+}
+
+/**
+ * Libère l'entrée e et son allocation.
+ */
+static void __rc_evict(RCache c, struct rcentry *e) {
+    sa_free(c->data, e->off);
+    e->hash = 0;
+}
+
+/**
+ * Choisit l'entrée à évincer pour faire de la place : une entrée expirée,
+ * sinon la moins récemment consultée.
+ *
+ * @return  L'entrée, NULL si le cache est vide.
+ */
+static struct rcentry *__rc_victim(RCache c, uint64_t now) {
+    struct rcentry *victim = NULL;
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < RC_ENTRIES; i++) {
+        struct rcentry *e = &c->idx->entries[i];
+        if (e->hash == 0) {
+            continue;
+        }
+        uint64_t used = e->expires <= now ? 0 : atomic_load_explicit(&e->used,
+                memory_order_relaxed);
+        if (victim == NULL || used < oldest) {
+            victim = e;
+            oldest = used;
+        }
+    }
+    return victim;
+}
+
+RCache rc_empty(const char *shm_name, const char *arena_name, size_t size) {
+    struct __rcache *c = malloc(sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        free(c);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(struct rcindex)) == -1) {
+        close(fd);
+        goto error;
+    }
+    c->idx = mmap(NULL, sizeof(struct rcindex), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (c->idx == MAP_FAILED) {
+        goto error;
+    }
+
+    c->data = sa_empty(arena_name, size);
+    if (c->data == NULL) {
+        munmap(c->idx, sizeof(struct rcindex));
+        goto error;
+    }
+
+    /* La SHM est initialement nulle : toutes les entrées sont libres */
+    c->shm_name = shm_name;
+    c->idx->size = size / SA_CHUNK * SA_CHUNK;
+    return c;
+
+error:
+    shm_unlink(shm_name);
+    free(c);
+    return NULL;
+}
+
+RCache rc_open(const char *shm_name, const char *arena_name) {
+    struct __rcache *c = malloc(sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+
+    int fd = shm_open(shm_name, O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        free(c);
+        return NULL;
+    }
+    c->idx = mmap(NULL, sizeof(struct rcindex), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (c->idx == MAP_FAILED) {
+        free(c);
+        return NULL;
+    }
+
+    c->data = sa_open(arena_name);
+    if (c->data == NULL) {
+        munmap(c->idx, sizeof(struct rcindex));
+        free(c);
+        return NULL;
+    }
+    c->shm_name = shm_name;
+    return c;
+}
+
+int rc_lookup(RCache c, const char *key, size_t keylen, int *status,
+        char **out, size_t *outlen) {
+    uint64_t hash = __rc_hash(key, keylen);
+    uint64_t now = __rc_now();
+
+    for (size_t k = 0; k < RC_RETRY; k++) {
+        uint32_t seq = atomic_load_explicit(&c->idx->seq,
+                memory_order_acquire);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        /* La sortie est copiée avant de vérifier qu'aucune écriture n'a eu
+         * lieu : l'allocation a pu être libérée et réutilisée entre temps */
+        struct rcview view;
+        struct rcentry *e = __rc_find(c, hash, key, keylen, &view);
+        char *copy = NULL;
+        if (e != NULL && view.expires > now) {
+            copy = malloc(view.outlen + 1);
+            if (copy == NULL) {
+                return -1;
+            }
+            memcpy(copy, (char *) sa_ptr(c->data, view.off) + keylen,
+                    view.outlen);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&c->idx->seq, memory_order_relaxed) != seq) {
+            free(copy);
+            continue;
+        }
+        if (copy == NULL) {
+            return -1;
+        }
+
+        atomic_store_explicit(&e->used, now, memory_order_relaxed);
+        *status = view.status;
+        *out = copy;
+        *outlen = view.outlen;
+        return 0;
+    }
+    return -1;
+}
+
+int rc_insert(RCache c, const char *key, size_t keylen, int status,
+        const char *out, size_t outlen, long ttl) {
+    if (outlen > RC_OUTPUT_MAX || keylen > UINT32_MAX) {
+        return -1;
+    }
+    uint64_t hash = __rc_hash(key, keylen);
+    uint64_t now = __rc_now();
+
+    __rc_write(c, true);
+
+    /* L'entrée de même clé est remplacée. À défaut, l'entrée retenue parmi
+     * celles de l'empreinte est une entrée libre, sinon expirée, sinon la
+     * moins récemment consultée */
+    struct rcview view;
+    struct rcentry *e = __rc_find(c, hash, key, keylen, &view);
+    if (e == NULL) {
+        uint64_t oldest = UINT64_MAX;
+        for (size_t i = 0; i < RC_PROBE; i++) {
+            struct rcentry *t = &c->idx->entries[(hash + i) % RC_ENTRIES];
+            uint64_t used = t->hash == 0 ? 0
+                : t->expires <= now ? 1
+                : atomic_load_explicit(&t->used, memory_order_relaxed) + 2;
+            if (e == NULL || used < oldest) {
+                e = t;
+                oldest = used;
+            }
+        }
+    }
+    if (e->hash != 0) {
+        __rc_evict(c, e);
+    }
+
+    /* Fait de la place dans la zone tant que l'allocation échoue */
+    ssize_t off;
+    while ((off = sa_alloc(c->data, keylen + outlen)) == -1) {
+        struct rcentry *victim = __rc_victim(c, now);
+        if (victim == NULL) {
+            __rc_write(c, false);
+            return -1;
+        }
+        __rc_evict(c, victim);
+    }
+
+    char *p = sa_ptr(c->data, (size_t) off);
+    memcpy(p, key, keylen);
+    memcpy(p + keylen, out, outlen);
+    e->off = (uint64_t) off;
+    e->keylen = (uint32_t) keylen;
+    e->outlen = (uint32_t) outlen;
+    e->status = status;
+    e->expires = now + (uint64_t) ttl;
+    atomic_store_explicit(&e->used, now, memory_order_relaxed);
+    e->hash = hash;
+
+    __rc_write(c, false);
+    return 0;
+}
+
+void rc_dispose(RCache *cp) {
+    struct __rcache *c = *cp;
+    sa_dispose(&c->data);
+    munmap(c->idx, sizeof(struct rcindex));
+    shm_unlink(c->shm_name);
+    free(c);
+    *cp = NULL;
+}
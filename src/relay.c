@@ -0,0 +1,84 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include "relay.h"
+
+/* Quantité maximale transférée par appel système */
+#define RL_CHUNK (1 << 20)
+
+/* Taille du tampon de RL_COPY */
+#define RL_BUFSIZE (64 * 1024)
+
+/* Vrai si l'erreur indique que la méthode n'est pas supportée par les
+ * descripteurs (et non une erreur de transfert) */
+#define UNSUPPORTED(err) ((err) == EINVAL || (err) == ENOSYS \
+        || (err) == EOPNOTSUPP)
+
+/**
+ * Transfère au plus RL_CHUNK octets de in vers out avec la méthode m.
+ *
+ * @return  Le nombre d'octets transférés (0 en fin de fichier), -1 en cas
+ *          d'erreur.
+ */
+static ssize_t __transfer(int in, int out, enum rl_method m) {
+    switch (m) {
+    case RL_SPLICE:
+        return splice(in, NULL, out, NULL, RL_CHUNK,
+                SPLICE_F_MOVE | SPLICE_F_MORE);
+    case RL_SENDFILE:
+        return sendfile(out, in, NULL, RL_CHUNK);
+    case RL_COPY:
+        break;
+    }
+
+    char buf[RL_BUFSIZE];
+    ssize_t r = read(in, buf, sizeof(buf));
+    if (r <= 0) {
+        return r;
+    }
+
+    /* L'écriture peut être partielle : le reste du tampon est écrit avant
+     * la lecture suivante */
+    for (ssize_t w = 0; w < r; ) {
+        ssize_t n = write(out, buf + w, (size_t) (r - w));
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        w += n;
+    }
+    return r;
+}
+
+ssize_t rl_relay(int in, int out, enum rl_method first,
+        enum rl_method *used) {
+    enum rl_method m = first;
+    ssize_t total = 0;
+
+    while (1) {
+        ssize_t n = __transfer(in, out, m);
+        if (n == 0) {
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (m != RL_COPY && UNSUPPORTED(errno)) {
+                m++;
+                continue;
+            }
+            return -1;
+        }
+        total += n;
+    }
+
+    if (used != NULL) {
+        *used = m;
+    }
+    return total;
+}
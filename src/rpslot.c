@@ -0,0 +1,50 @@
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "rpslot.h"
+
+/* Le futex est utilisé sans FUTEX_PRIVATE_FLAG : l'emplacement est partagé
+ * entre le daemon et le client */
+
+void rs_init(struct rpslot *s) {
+    atomic_init(&s->state, RS_PENDING);
+    atomic_init(&s->owners, RS_CLIENT | RS_DAEMON);
+}
+
+void rs_post(struct rpslot *s, const struct reply *rp) {
+    /* La réponse est écrite avant la publication de l'état (release) : le
+     * client qui observe le nouvel état (acquire) la voit entièrement */
+    memcpy(&s->rp, rp, sizeof(*rp));
+    atomic_store_explicit(&s->state, rp->aborted ? RS_ABORTED : RS_DONE,
+            memory_order_release);
+    syscall(SYS_futex, (uint32_t *) &s->state, FUTEX_WAKE, INT_MAX, NULL,
+            NULL, 0);
+}
+
+int rs_wait(struct rpslot *s, struct reply *rp) {
+    while (atomic_load_explicit(&s->state, memory_order_acquire)
+            == RS_PENDING) {
+        long r = syscall(SYS_futex, (uint32_t *) &s->state, FUTEX_WAIT,
+                RS_PENDING, NULL, NULL, 0);
+        if (r == -1 && errno != EAGAIN && errno != EINTR) {
+            return -1;
+        }
+    }
+
+    memcpy(rp, &s->rp, sizeof(*rp));
+    if (atomic_load_explicit(&s->state, memory_order_relaxed) == RS_ABORTED) {
+        rp->aborted = 1;
+    }
+    return 0;
+}
+
+bool rs_release(struct rpslot *s, uint32_t owner) {
+    /* Les accès de l'autre détenteur précèdent son abandon (acq_rel) : le
+     * dernier peut libérer l'emplacement sans risque */
+    return atomic_fetch_and_explicit(&s->owners, ~owner, memory_order_acq_rel)
+        == owner;
+}
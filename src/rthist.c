@@ -0,0 +1,179 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rthist.h"
+
+/* Le fichier contient un en-tête suivi de RH_SLOTS emplacements. Une commande
+ * occupe l'un des RH_PROBE emplacements qui suivent celui désigné par son
+ * empreinte (sondage linéaire). Deux commandes de même empreinte sur 64 bits
+ * sont confondues. */
+
+#define RH_MAGIC 0x31747368646d63ULL   /* "cmdhst1" */
+#define RH_PROBE 8
+
+struct rhslot {
+    uint64_t key;           /* Empreinte de la commande, 0 si libre */
+    uint64_t stamp;         /* Rang de la dernière mise à jour */
+    uint64_t count;         /* Nombre d'exécutions enregistrées */
+    double mean;            /* Moyenne mobile de la durée (ms) */
+    double var;             /* Variance mobile de la durée (ms²) */
+};
+
+struct __rthist {
+    uint64_t magic;         /* RH_MAGIC si le fichier est valide */
+    uint64_t nslots;        /* Nombre d'emplacements (RH_SLOTS) */
+    uint64_t stamp;         /* Rang de la prochaine mise à jour */
+    struct rhslot slots[];
+};
+
+#define RH_SIZE (sizeof(struct __rthist) + RH_SLOTS * sizeof(struct rhslot))
+
+/* Intègre l'octet c à l'empreinte h (FNV-1a) */
+#define FNV(h, c) (((h) ^ (uint8_t) (c)) * 1099511628211ULL)
+
+/**
+ * Calcule l'empreinte de la forme normalisée de la commande cmd.
+ *
+ * @return  L'empreinte, jamais nulle.
+ */
+static uint64_t __rh_key(const char *cmd) {
+    while (isspace((unsigned char) *cmd)) {
+        cmd++;
+    }
+
+    /* Seul le nom de base du premier mot est retenu */
+    const char *base = cmd;
+    for (const char *c = cmd; *c != '\0' && !isspace((unsigned char) *c);
+            c++) {
+        if (*c == '/') {
+            base = c + 1;
+        }
+    }
+
+    /* Chaque suite de blancs compte pour une espace, sauf en fin de
+     * commande */
+    uint64_t h = 14695981039346656037ULL;
+    bool space = false;
+    for (const char *c = base; *c != '\0'; c++) {
+        if (isspace((unsigned char) *c)) {
+            space = true;
+            continue;
+        }
+        if (space) {
+            h = FNV(h, ' ');
+            space = false;
+        }
+        h = FNV(h, *c);
+    }
+    return h != 0 ? h : 1;
+}
+
+/**
+ * Recherche l'emplacement de la commande d'empreinte key.
+ *
+ * @return  L'emplacement de la commande, NULL si elle est absente.
+ */
+static struct rhslot *__rh_find(RtHist h, uint64_t key) {
+    for (size_t i = 0; i < RH_PROBE; i++) {
+        struct rhslot *s = &h->slots[(key + i) % RH_SLOTS];
+        if (s->key == key) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+RtHist rh_open(const char *path) {
+    /* Le fichier est redimensionné et réinitialisé s'il n'est pas valide :
+     * seul un fichier ordinaire du propriétaire du processus est accepté,
+     * jamais la cible d'un lien symbolique ni un fichier aux liens multiples */
+    int fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+            S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() || st.st_nlink != 1) {
+        close(fd);
+        errno = EPERM;
+        return NULL;
+    }
+    if (st.st_size != (off_t) RH_SIZE
+            && ftruncate(fd, (off_t) RH_SIZE) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    struct __rthist *h = mmap(NULL, RH_SIZE, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (h->magic != RH_MAGIC || h->nslots != RH_SLOTS) {
+        memset(h, 0, RH_SIZE);
+        h->magic = RH_MAGIC;
+        h->nslots = RH_SLOTS;
+    }
+    return h;
+}
+
+int rh_estimate(RtHist h, const char *cmd, double *mean, double *stddev) {
+    struct rhslot *s = __rh_find(h, __rh_key(cmd));
+    if (s == NULL) {
+        return -1;
+    }
+    *mean = s->mean;
+    *stddev = sqrt(s->var);
+    return 0;
+}
+
+void rh_record(RtHist h, const char *cmd, unsigned long long wall) {
+    uint64_t key = __rh_key(cmd);
+    double x = (double) wall / 1e6;
+
+    struct rhslot *s = __rh_find(h, key);
+    if (s != NULL) {
+        /* Moyenne et variance mobiles, mises à jour de façon incrémentale */
+        double diff = x - s->mean;
+        double incr = RH_ALPHA * diff;
+        s->mean += incr;
+        s->var = (1 - RH_ALPHA) * (s->var + diff * incr);
+        s->count++;
+        s->stamp = h->stamp++;
+        return;
+    }
+
+    /* Un emplacement libre, ou à défaut le moins récemment mis à jour */
+    s = &h->slots[key % RH_SLOTS];
+    for (size_t i = 0; i < RH_PROBE && s->key != 0; i++) {
+        struct rhslot *t = &h->slots[(key + i) % RH_SLOTS];
+        if (t->key == 0 || t->stamp < s->stamp) {
+            s = t;
+        }
+    }
+    s->key = key;
+    s->mean = x;
+    s->var = 0;
+    s->count = 1;
+    s->stamp = h->stamp++;
+}
+
+void rh_dispose(RtHist *hp) {
+    munmap(*hp, RH_SIZE);
+    *hp = NULL;
+}
@@ -0,0 +1,295 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "sarena.h"
+
+/* Nombre de blocs décrits par un mot de la table d'occupation */
+#define WORD_BITS 64
+
+struct __sarena {
+    const char *shm_name;   /* Nom de la SHM associée à la zone */
+    size_t nchunks;         /* Nombre de blocs de la zone */
+    size_t nwords;          /* Nombre de mots de la table d'occupation */
+    size_t hint;            /* Bloc à partir duquel chercher (next-fit) */
+    size_t data;            /* Décalage des blocs depuis le début de la SHM */
+    uint32_t gen;           /* Génération de la dernière allocation */
+    sem_t mshm;             /* Mutex pour l'accès à la table d'occupation */
+    uint64_t bitmap[];      /* Table d'occupation (un bit par bloc) */
+};
+
+/**
+ * En-tête d'une allocation, placé en début de son premier bloc.
+ */
+struct __sa_block {
+    uint32_t nchunks;       /* Nombre de blocs occupés */
+    uint32_t length;        /* Longueur demandée */
+    pid_t owner;            /* Processus responsable, 0 si aucun */
+    uint32_t gen;           /* Génération de l'allocation */
+};
+
+/* Les décalages renvoyés désignent l'octet qui suit l'en-tête */
+#define SA_BLOCK(sa, off) \
+    ((struct __sa_block *) ((char *) (sa) + (sa)->data + (off) \
+                            - sizeof(struct __sa_block)))
+
+#define BIT_TEST(sa, i) ((sa)->bitmap[(i) / WORD_BITS] >> ((i) % WORD_BITS) & 1)
+#define BIT_SET(sa, i) ((sa)->bitmap[(i) / WORD_BITS] |= \
+            (uint64_t) 1 << ((i) % WORD_BITS))
+#define BIT_CLEAR(sa, i) ((sa)->bitmap[(i) / WORD_BITS] &= \
+            ~((uint64_t) 1 << ((i) % WORD_BITS)))
+
+SArena sa_empty(const char *shm_name, size_t size) {
+    size_t nchunks = size / SA_CHUNK;
+    if (nchunks == 0) {
+        return NULL;
+    }
+    size_t nwords = (nchunks + WORD_BITS - 1) / WORD_BITS;
+    size_t data = sizeof(struct __sarena) + nwords * sizeof(uint64_t);
+    data = (data + SA_CHUNK - 1) / SA_CHUNK * SA_CHUNK;
+    size_t shm_size = data + nchunks * SA_CHUNK;
+
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    if (ftruncate(fd, (off_t) shm_size) == -1) {
+        return NULL;
+    }
+
+    struct __sarena *sa = mmap(NULL, shm_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    if (sa == MAP_FAILED) {
+        return NULL;
+    }
+
+    close(fd);
+
+    sa->shm_name = shm_name;
+    sa->nchunks = nchunks;
+    sa->nwords = nwords;
+    sa->hint = 0;
+    sa->data = data;
+    sa->gen = 0;
+    memset(sa->bitmap, 0, nwords * sizeof(uint64_t));
+
+    if (sem_init(&sa->mshm, 1, 1) == -1) {
+        shm_unlink(shm_name);
+        return NULL;
+    }
+
+    return sa;
+}
+
+SArena sa_open(const char *shm_name) {
+    int fd = shm_open(shm_name, O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return NULL;
+    }
+
+    struct __sarena *sa = mmap(NULL, (size_t) st.st_size,
+            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (sa == MAP_FAILED) {
+        return NULL;
+    }
+
+    close(fd);
+    return sa;
+}
+
+/**
+ * Recherche n blocs libres consécutifs à partir du bloc from.
+ *
+ * @return  L'indice du premier bloc trouvé, nchunks si aucun ne convient.
+ */
+static size_t __sa_find(struct __sarena *sa, size_t from, size_t n) {
+    size_t run = 0;
+    for (size_t i = from; i < sa->nchunks; i++) {
+        /* Saute les mots entièrement occupés */
+        if (i % WORD_BITS == 0 && sa->bitmap[i / WORD_BITS] == UINT64_MAX) {
+            run = 0;
+            i += WORD_BITS - 1;
+            continue;
+        }
+        if (BIT_TEST(sa, i)) {
+            run = 0;
+            continue;
+        }
+        if (++run == n) {
+            return i + 1 - n;
+        }
+    }
+    return sa->nchunks;
+}
+
+ssize_t sa_alloc(SArena sa, size_t len) {
+    if (sa == NULL || len > UINT32_MAX) {
+        return -1;
+    }
+
+    size_t n = (sizeof(struct __sa_block) + len + SA_CHUNK - 1) / SA_CHUNK;
+    if (n > sa->nchunks) {
+        return -1;
+    }
+
+    if (sem_wait(&sa->mshm) == -1) {
+        return -1;
+    }
+
+    size_t first = __sa_find(sa, sa->hint, n);
+    if (first == sa->nchunks) {
+        first = __sa_find(sa, 0, n);
+    }
+
+    /* L'en-tête est écrit sous le mutex : sa_reclaim le lit pour parcourir
+     * les allocations */
+    ssize_t off = -1;
+    if (first != sa->nchunks) {
+        for (size_t i = first; i < first + n; i++) {
+            BIT_SET(sa, i);
+        }
+        sa->hint = (first + n) % sa->nchunks;
+        off = (ssize_t) (first * SA_CHUNK + sizeof(struct __sa_block));
+
+        struct __sa_block *b = SA_BLOCK(sa, (size_t) off);
+        b->nchunks = (uint32_t) n;
+        b->length = (uint32_t) len;
+        b->owner = getpid();
+        b->gen = ++sa->gen;
+    }
+
+    if (sem_post(&sa->mshm) == -1) {
+        return -1;
+    }
+
+    return off;
+}
+
+void *sa_ptr(SArena sa, size_t off) {
+    return (char *) sa + sa->data + off;
+}
+
+size_t sa_length(SArena sa, size_t off) {
+    return SA_BLOCK(sa, off)->length;
+}
+
+uint32_t sa_gen(SArena sa, size_t off) {
+    return SA_BLOCK(sa, off)->gen;
+}
+
+/**
+ * Teste si off désigne le début d'une allocation de la zone sa. Le mutex doit
+ * être détenu par l'appelant.
+ */
+static bool __sa_allocated(struct __sarena *sa, size_t off) {
+    if (off < sizeof(struct __sa_block) || off >= sa->nchunks * SA_CHUNK
+            || (off - sizeof(struct __sa_block)) % SA_CHUNK != 0) {
+        return false;
+    }
+    size_t first = (off - sizeof(struct __sa_block)) / SA_CHUNK;
+    size_t n = SA_BLOCK(sa, off)->nchunks;
+    return n != 0 && n <= sa->nchunks - first && BIT_TEST(sa, first);
+}
+
+int sa_own(SArena sa, size_t off, uint32_t gen, pid_t owner) {
+    if (sa == NULL || sem_wait(&sa->mshm) == -1) {
+        return -1;
+    }
+
+    int ret = -1;
+    if (__sa_allocated(sa, off) && SA_BLOCK(sa, off)->gen == gen) {
+        SA_BLOCK(sa, off)->owner = owner;
+        ret = 0;
+    }
+
+    if (sem_post(&sa->mshm) == -1) {
+        return -1;
+    }
+    return ret;
+}
+
+ssize_t sa_reclaim(SArena sa) {
+    if (sa == NULL || sem_wait(&sa->mshm) == -1) {
+        return -1;
+    }
+
+    /* Les allocations d'un même processus se suivent souvent : le résultat
+     * du dernier test est conservé */
+    pid_t last = 0;
+    bool gone = false;
+    ssize_t count = 0;
+    size_t i = 0;
+    while (i < sa->nchunks) {
+        size_t off = i * SA_CHUNK + sizeof(struct __sa_block);
+        if (!__sa_allocated(sa, off)) {
+            i++;
+            continue;
+        }
+
+        struct __sa_block *b = SA_BLOCK(sa, off);
+        size_t n = b->nchunks;
+        if (b->owner != 0 && b->owner != last) {
+            last = b->owner;
+            gone = kill(last, 0) == -1 && errno == ESRCH;
+        }
+        if (b->owner != 0 && gone) {
+            b->nchunks = 0;
+            for (size_t j = i; j < i + n; j++) {
+                BIT_CLEAR(sa, j);
+            }
+            count++;
+        }
+        i += n;
+    }
+
+    if (sem_post(&sa->mshm) == -1) {
+        return -1;
+    }
+    return count;
+}
+
+int sa_free(SArena sa, size_t off) {
+    if (sa == NULL || sem_wait(&sa->mshm) == -1) {
+        return -1;
+    }
+
+    /* Un bloc déjà libéré porte un nombre de blocs nul */
+    if (!__sa_allocated(sa, off)) {
+        sem_post(&sa->mshm);
+        return -1;
+    }
+    size_t first = (off - sizeof(struct __sa_block)) / SA_CHUNK;
+    size_t n = SA_BLOCK(sa, off)->nchunks;
+    SA_BLOCK(sa, off)->nchunks = 0;
+
+    for (size_t i = first; i < first + n; i++) {
+        BIT_CLEAR(sa, i);
+    }
+
+    if (sem_post(&sa->mshm) == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void sa_dispose(SArena *sap) {
+    struct __sarena *sa = *sap;
+    sem_destroy(&sa->mshm);
+    shm_unlink(sa->shm_name);
+    *sap = NULL;
+}
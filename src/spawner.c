@@ -0,0 +1,197 @@
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "spawner.h"
+
+/* Code de retour du fils lorsque la commande n'a pas pu être exécutée */
+#define SP_EXIT_EXEC 127
+
+/* Taille de la pile du fils pour SP_VFORK */
+#define SP_STACK_SIZE (64 * 1024)
+
+/**
+ * Prépare le processus fils avant l'exécution de la commande.
+ *
+ * Les gestionnaires de signaux installés par le daemon sont remplacés par le
+ * comportement par défaut avant que le masque ne soit vidé, afin qu'aucun
+ * d'entre eux ne puisse s'exécuter dans le fils.
+ *
+ * @return  0 en cas de succès, -1 sinon.
+ */
+static int __sp_child(const struct sp_fds *fds) {
+    struct sigaction dfl = { .sa_handler = SIG_DFL };
+    for (int sig = 1; sig < NSIG; sig++) {
+        struct sigaction cur;
+        if (sigaction(sig, NULL, &cur) == 0 && cur.sa_handler != SIG_IGN
+                && cur.sa_handler != SIG_DFL) {
+            sigaction(sig, &dfl, NULL);
+        }
+    }
+
+    sigset_t set;
+    sigemptyset(&set);
+    if (sigprocmask(SIG_SETMASK, &set, NULL) == -1) {
+        return -1;
+    }
+
+    if (fds->in != -1 && dup2(fds->in, STDIN_FILENO) == -1) {
+        return -1;
+    }
+    if (fds->out != -1 && dup2(fds->out, STDOUT_FILENO) == -1) {
+        return -1;
+    }
+    if (fds->err != -1 && dup2(fds->err, STDERR_FILENO) == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Exécute la commande argv depuis le fichier file s'il est connu, en
+ * cherchant argv[0] dans PATH sinon ou si file ne peut pas être exécuté (un
+ * chemin périmé, ou un fichier que execvp confie à /bin/sh).
+ *
+ * Ne revient qu'en cas d'échec, errno indiquant alors l'erreur.
+ */
+static void __sp_exec(const char *file, char *const argv[]) {
+    if (file != NULL) {
+        execv(file, argv);
+    }
+    execvp(argv[0], argv);
+}
+
+/* --- SP_FORK ------------------------------------------------------------- */
+
+static pid_t __sp_fork(const char *file, char *const argv[],
+        const struct sp_fds *fds) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (__sp_child(fds) == 0) {
+            __sp_exec(file, argv);
+        }
+        _exit(SP_EXIT_EXEC);
+    }
+    return pid;
+}
+
+/* --- SP_VFORK ------------------------------------------------------------ */
+
+/**
+ * Paramètres du fils créé par clone(). Le fils partageant la mémoire du
+ * worker, il y inscrit err en cas d'échec avant de se terminer.
+ */
+struct __sp_vfork {
+    const char *file;
+    char *const *argv;
+    const struct sp_fds *fds;
+    int err;
+};
+
+static int __sp_vfork_child(void *arg) {
+    struct __sp_vfork *v = arg;
+    if (__sp_child(v->fds) == 0) {
+        __sp_exec(v->file, v->argv);
+    }
+    v->err = errno;
+    _exit(SP_EXIT_EXEC);
+}
+
+static pid_t __sp_vfork(const char *file, char *const argv[],
+        const struct sp_fds *fds) {
+    _Alignas(16) char stack[SP_STACK_SIZE];
+    struct __sp_vfork v = { file, argv, fds, 0 };
+
+    /* Le worker reprend la main une fois la commande exécutée ou le fils
+     * terminé : v.err est alors à jour */
+    pid_t pid = clone(__sp_vfork_child, stack + sizeof(stack),
+            CLONE_VM | CLONE_VFORK | SIGCHLD, &v);
+    if (pid == -1) {
+        return -1;
+    }
+
+    if (v.err != 0) {
+        waitpid(pid, NULL, 0);
+        errno = v.err;
+        return -1;
+    }
+    return pid;
+}
+
+/* --- SP_POSIX_SPAWN ------------------------------------------------------ */
+
+static pid_t __sp_posix_spawn(const char *file, char *const argv[],
+        const struct sp_fds *fds) {
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    int err;
+
+    if ((err = posix_spawn_file_actions_init(&fa)) != 0) {
+        errno = err;
+        return -1;
+    }
+    if ((err = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&fa);
+        errno = err;
+        return -1;
+    }
+
+    if (fds->in != -1) {
+        posix_spawn_file_actions_adddup2(&fa, fds->in, STDIN_FILENO);
+    }
+    if (fds->out != -1) {
+        posix_spawn_file_actions_adddup2(&fa, fds->out, STDOUT_FILENO);
+    }
+    if (fds->err != -1) {
+        posix_spawn_file_actions_adddup2(&fa, fds->err, STDERR_FILENO);
+    }
+
+    sigset_t none, all;
+    sigemptyset(&none);
+    sigfillset(&all);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &all);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK
+            | POSIX_SPAWN_SETSIGDEF);
+
+    /* Comme pour __sp_exec(), la commande est cherchée dans PATH si le
+     * fichier ne peut pas être exécuté */
+    pid_t pid;
+    err = ENOENT;
+    if (file != NULL) {
+        err = posix_spawn(&pid, file, &fa, &attr, argv, environ);
+    }
+    if (err != 0) {
+        err = posix_spawnp(&pid, argv[0], &fa, &attr, argv, environ);
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+/* ------------------------------------------------------------------------- */
+
+pid_t sp_spawn(enum sp_backend backend, const char *file,
+        char *const argv[], const struct sp_fds *fds) {
+    switch (backend) {
+    case SP_FORK:
+        return __sp_fork(file, argv, fds);
+    case SP_VFORK:
+        return __sp_vfork(file, argv, fds);
+    case SP_POSIX_SPAWN:
+        return __sp_posix_spawn(file, argv, fds);
+    }
+    errno = EINVAL;
+    return -1;
+}
@@ -1,48 +1,262 @@
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "squeue.h"
 
+/* Taille d'une ligne de cache, utilisée pour séparer les compteurs de l'anneau
+ * et aligner ses cases */
+#define SQ_CACHELINE 64
+
 struct __squeue {
     const char *shm_name;   /* Nom de la SHM associée à la file */
+    enum sq_engine engine;  /* Moteur utilisé par la file */
+    size_t size;            /* Taille des éléments de la file */
+    size_t stride;          /* Écart entre deux cases de la zone de données */
+    size_t max_length;      /* Longueur maximale de la file */
+
+    /* --- Moteur SQ_ENGINE_SEM --- */
     size_t head;            /* Indice de tête de file */
     size_t tail;            /* Indice de queue de file */
-    size_t size;            /* Taille des éléments de la file */
     size_t length;          /* Longueur courante de la file */
-    size_t max_length;      /* Longueur maximale de la file */
     sem_t mshm;             /* Mutex pour l'accès à la SHM */
     sem_t mnfull;           /* Mutex bloquant lorsque la file est pleine */
     sem_t mnempty;          /* Mutex bloquant lorsque la file est vide */
-    char data[];            /* Données (éléments) de la file */
+
+    /* --- Moteur SQ_ENGINE_RING --- */
+    _Alignas(SQ_CACHELINE) atomic_size_t enqpos;   /* Prochaine position à
+                                                      remplir */
+    _Alignas(SQ_CACHELINE) atomic_size_t deqpos;   /* Prochaine position à
+                                                      vider */
+    _Alignas(SQ_CACHELINE) _Atomic uint32_t fnempty; /* Futex "non vide" */
+    _Atomic uint32_t wnempty;                        /* Attentes sur fnempty */
+    _Alignas(SQ_CACHELINE) _Atomic uint32_t fnfull;  /* Futex "non pleine" */
+    _Atomic uint32_t wnfull;                         /* Attentes sur fnfull */
+
+    _Alignas(SQ_CACHELINE) char data[]; /* Données (éléments) de la file */
+};
+
+/**
+ * Case de l'anneau : un numéro de séquence suivi de l'élément.
+ *
+ * Pour la position pos, la case vaut pos lorsqu'elle est libre, pos + 1
+ * lorsqu'elle contient un élément, et pos + max_length une fois vidée.
+ */
+struct __sq_slot {
+    atomic_size_t seq;
+    char data[];
 };
 
+#define SQ_SLOT(sq, pos) \
+    ((struct __sq_slot *) ((sq)->data + ((pos) % (sq)->max_length) \
+                           * (sq)->stride))
+
 static void __sq_cleanup(struct __squeue *sq) {
-    if (&sq->mshm != NULL) {
+    if (sq->engine == SQ_ENGINE_SEM) {
         sem_destroy(&sq->mshm);
+        sem_destroy(&sq->mnfull);
+        sem_destroy(&sq->mnempty);
     }
 
-    if (&sq->mnfull != NULL) {
-        sem_destroy(&sq->mnfull);
+    shm_unlink(sq->shm_name);
+}
+
+/* --- FUTEX --------------------------------------------------------------- */
+
+/* Les futex sont utilisés sans FUTEX_PRIVATE_FLAG : la file est partagée entre
+ * plusieurs processus. */
+
+static int __futex_wait(_Atomic uint32_t *addr, uint32_t val) {
+    long r = syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT, val, NULL,
+            NULL, 0);
+    if (r == -1 && errno != EAGAIN) {
+        return -1;
     }
+    return 0;
+}
 
-    if (&sq->mnempty != NULL) {
-        sem_destroy(&sq->mnempty);
+static void __futex_wake(_Atomic uint32_t *addr, int n) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+/**
+ * Réveille jusqu'à n processus en attente sur le futex addr, s'il y en a.
+ *
+ * La barrière assure qu'un processus qui s'apprête à attendre voit la
+ * modification de l'anneau, ou que celle-ci voit son inscription dans waiters.
+ */
+static void __sq_notify(_Atomic uint32_t *addr, _Atomic uint32_t *waiters,
+        size_t n) {
+    if (n == 0) {
+        return;
     }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(addr, 1, memory_order_release);
+        __futex_wake(addr, n > INT_MAX ? INT_MAX : (int) n);
+    }
+}
 
-    shm_unlink(sq->shm_name);
+/* --- ANNEAU -------------------------------------------------------------- */
+
+/**
+ * Tente d'enfiler obj dans l'anneau sans bloquer.
+ *
+ * @return  0 en cas de succès, -1 si l'anneau est plein.
+ */
+static int __ring_tryenqueue(struct __squeue *sq, const void *obj) {
+    size_t pos = atomic_load_explicit(&sq->enqpos, memory_order_relaxed);
+    struct __sq_slot *slot;
+    while (1) {
+        slot = SQ_SLOT(sq, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&sq->enqpos, &pos,
+                        pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&sq->enqpos, memory_order_relaxed);
+        }
+    }
+
+    memcpy(slot->data, obj, sq->size);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return 0;
 }
 
-SQueue sq_empty(const char *shm_name, size_t size, size_t max_length) {
-    size_t shm_size = sizeof(struct __squeue) + max_length * size;
+/**
+ * Tente de défiler un élément de l'anneau dans buf sans bloquer.
+ *
+ * @return  0 en cas de succès, -1 si l'anneau est vide.
+ */
+static int __ring_trydequeue(struct __squeue *sq, void *buf) {
+    size_t pos = atomic_load_explicit(&sq->deqpos, memory_order_relaxed);
+    struct __sq_slot *slot;
+    while (1) {
+        slot = SQ_SLOT(sq, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&sq->deqpos, &pos,
+                        pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&sq->deqpos, memory_order_relaxed);
+        }
+    }
+
+    memcpy(buf, slot->data, sq->size);
+    atomic_store_explicit(&slot->seq, pos + sq->max_length,
+            memory_order_release);
+    return 0;
+}
+
+/**
+ * Attend sur le futex addr tant que l'opération op échoue.
+ *
+ * Le processus s'inscrit dans waiters avant de retenter l'opération une
+ * dernière fois, puis s'endort si la valeur du futex n'a pas changé entre
+ * temps.
+ */
+static int __ring_wait(struct __squeue *sq, void *arg,
+        int (*op)(struct __squeue *, void *),
+        _Atomic uint32_t *addr, _Atomic uint32_t *waiters) {
+    while (op(sq, arg) == -1) {
+        uint32_t val = atomic_load_explicit(addr, memory_order_acquire);
+        atomic_fetch_add_explicit(waiters, 1, memory_order_seq_cst);
+        if (op(sq, arg) == 0) {
+            atomic_fetch_sub_explicit(waiters, 1, memory_order_relaxed);
+            return 0;
+        }
+        int r = __futex_wait(addr, val);
+        atomic_fetch_sub_explicit(waiters, 1, memory_order_relaxed);
+        if (r == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int __ring_enqueue_op(struct __squeue *sq, void *obj) {
+    return __ring_tryenqueue(sq, obj);
+}
+
+static int __ring_dequeue_op(struct __squeue *sq, void *buf) {
+    return __ring_trydequeue(sq, buf);
+}
+
+/* Les consommateurs en attente sont prévenus avant que le producteur ne
+ * s'endorme sur une file pleine, puis une seule fois pour le reste du lot. */
+static int __ring_enqueue_batch(struct __squeue *sq, const void *objs,
+        size_t n) {
+    const char *obj = objs;
+    size_t pending = 0;
+    for (size_t i = 0; i < n; i++, obj += sq->size) {
+        if (__ring_tryenqueue(sq, obj) == -1) {
+            __sq_notify(&sq->fnempty, &sq->wnempty, pending);
+            pending = 0;
+            if (__ring_wait(sq, (void *) obj, __ring_enqueue_op, &sq->fnfull,
+                        &sq->wnfull) == -1) {
+                return -1;
+            }
+        }
+        pending++;
+    }
+    __sq_notify(&sq->fnempty, &sq->wnempty, pending);
+    return 0;
+}
+
+static ssize_t __ring_dequeue_batch(struct __squeue *sq, void *buf,
+        size_t n) {
+    if (__ring_wait(sq, buf, __ring_dequeue_op, &sq->fnempty,
+                &sq->wnempty) == -1) {
+        return -1;
+    }
+    size_t k = 1;
+    char *e = (char *) buf + sq->size;
+    while (k < n && __ring_trydequeue(sq, e) == 0) {
+        k++;
+        e += sq->size;
+    }
+    __sq_notify(&sq->fnfull, &sq->wnfull, k);
+    return (ssize_t) k;
+}
+
+/* ------------------------------------------------------------------------- */
+
+SQueue sq_empty(const char *shm_name, size_t size, size_t max_length,
+        enum sq_engine engine) {
+    if (size == 0 || max_length == 0) {
+        return NULL;
+    }
+
+    size_t stride = size;
+    if (engine == SQ_ENGINE_RING) {
+        stride = sizeof(struct __sq_slot) + size;
+        stride = (stride + SQ_CACHELINE - 1) / SQ_CACHELINE * SQ_CACHELINE;
+    }
+    size_t shm_size = sizeof(struct __squeue) + max_length * stride;
 
     int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
     if (fd == -1) {
@@ -61,13 +275,28 @@ SQueue sq_empty(const char *shm_name, size_t size, size_t max_length) {
 
     close(fd);
 
+    sq->engine = engine;
     sq->head = 0;
     sq->tail = 0;
     sq->length = 0;
     sq->max_length = max_length;
     sq->size = size;
+    sq->stride = stride;
     sq->shm_name = shm_name;
 
+    if (engine == SQ_ENGINE_RING) {
+        atomic_init(&sq->enqpos, 0);
+        atomic_init(&sq->deqpos, 0);
+        atomic_init(&sq->fnempty, 0);
+        atomic_init(&sq->wnempty, 0);
+        atomic_init(&sq->fnfull, 0);
+        atomic_init(&sq->wnfull, 0);
+        for (size_t i = 0; i < max_length; i++) {
+            atomic_init(&SQ_SLOT(sq, i)->seq, i);
+        }
+        return sq;
+    }
+
     if (sem_init(&sq->mshm, 1, 1) == -1) {
         __sq_cleanup(sq);
         return NULL;
@@ -110,63 +339,158 @@ SQueue sq_open(const char *shm_name) {
 #define FUN_SUCCESS 0
 #define FUN_FAILURE -1
 
-int sq_enqueue(SQueue sq, const void *obj) {
-    if (sq == NULL || obj == NULL) {
-        return FUN_FAILURE;
+/**
+ * Réserve entre 1 et n places (ou éléments) du sémaphore sem.
+ *
+ * La première place est attendue, les suivantes ne sont prises que si elles
+ * sont immédiatement disponibles.
+ *
+ * @return  Le nombre de places réservées, 0 en cas d'erreur.
+ */
+static size_t __sem_take(sem_t *sem, size_t n) {
+    if (sem_wait(sem) == -1) {
+        return 0;
+    }
+    size_t k = 1;
+    while (k < n && sem_trywait(sem) == 0) {
+        k++;
     }
+    return k;
+}
 
-    if (sem_wait(&sq->mnfull) == -1) {
-        return FUN_FAILURE;
+/**
+ * Rend k places (ou éléments) au sémaphore sem.
+ */
+static int __sem_give(sem_t *sem, size_t k) {
+    for (size_t i = 0; i < k; i++) {
+        if (sem_post(sem) == -1) {
+            return FUN_FAILURE;
+        }
     }
+    return FUN_SUCCESS;
+}
 
+/**
+ * Copie k éléments de objs en queue de file, sous le mutex mshm.
+ */
+static int __sem_put(struct __squeue *sq, const char *objs, size_t k) {
     if (sem_wait(&sq->mshm) == -1) {
         return FUN_FAILURE;
     }
 
-    memcpy(sq->data + sq->tail * sq->size, obj, sq->size);
-    sq->tail = (sq->tail + 1) % sq->max_length;
-    sq->length++;
-    
+    for (size_t i = 0; i < k; i++) {
+        memcpy(sq->data + sq->tail * sq->size, objs + i * sq->size, sq->size);
+        sq->tail = (sq->tail + 1) % sq->max_length;
+    }
+    sq->length += k;
+
     if (sem_post(&sq->mshm) == -1) {
         return FUN_FAILURE;
     }
 
-    if (sem_post(&sq->mnempty) == -1) {
+    return __sem_give(&sq->mnempty, k);
+}
+
+/**
+ * Copie k éléments de tête de file dans buf, sous le mutex mshm.
+ */
+static int __sem_get(struct __squeue *sq, char *buf, size_t k) {
+    if (sem_wait(&sq->mshm) == -1) {
         return FUN_FAILURE;
     }
 
-    return FUN_SUCCESS; 
+    for (size_t i = 0; i < k; i++) {
+        memcpy(buf + i * sq->size, sq->data + sq->head * sq->size, sq->size);
+        sq->head = (sq->head + 1) % sq->max_length;
+    }
+    sq->length -= k;
+
+    if (sem_post(&sq->mshm) == -1) {
+        return FUN_FAILURE;
+    }
+
+    return __sem_give(&sq->mnfull, k);
+}
+
+int sq_enqueue(SQueue sq, const void *obj) {
+    return sq_enqueue_batch(sq, obj, 1);
 }
 
 int sq_dequeue(SQueue sq, void *buf) {
-    if (sq == NULL || buf == NULL) {
+    return sq_dequeue_batch(sq, buf, 1) == -1 ? FUN_FAILURE : FUN_SUCCESS;
+}
+
+int sq_enqueue_batch(SQueue sq, const void *objs, size_t n) {
+    if (sq == NULL || objs == NULL) {
         return FUN_FAILURE;
     }
 
-    if (sem_wait(&sq->mnempty) == -1) {
+    if (sq->engine == SQ_ENGINE_RING) {
+        return __ring_enqueue_batch(sq, objs, n);
+    }
+
+    const char *obj = objs;
+    while (n > 0) {
+        size_t k = __sem_take(&sq->mnfull, n);
+        if (k == 0 || __sem_put(sq, obj, k) == FUN_FAILURE) {
+            return FUN_FAILURE;
+        }
+        obj += k * sq->size;
+        n -= k;
+    }
+
+    return FUN_SUCCESS;
+}
+
+ssize_t sq_dequeue_batch(SQueue sq, void *buf, size_t n) {
+    if (sq == NULL || buf == NULL || n == 0) {
         return FUN_FAILURE;
     }
-    
-    if (sem_wait(&sq->mshm) == -1) {
+
+    if (sq->engine == SQ_ENGINE_RING) {
+        return __ring_dequeue_batch(sq, buf, n);
+    }
+
+    size_t k = __sem_take(&sq->mnempty, n);
+    if (k == 0 || __sem_get(sq, buf, k) == FUN_FAILURE) {
         return FUN_FAILURE;
     }
 
-    memcpy(buf, sq->data + sq->head * sq->size, sq->size);
-    sq->head = (sq->head + 1) % sq->max_length;
-    sq->length--;
+    return (ssize_t) k;
+}
 
-    if (sem_post(&sq->mshm) == -1) {
+int sq_try_dequeue(SQueue sq, void *buf) {
+    if (sq == NULL || buf == NULL) {
         return FUN_FAILURE;
     }
 
-    if (sem_post(&sq->mnfull) == -1) {
+    if (sq->engine == SQ_ENGINE_RING) {
+        if (__ring_trydequeue(sq, buf) == -1) {
+            errno = EAGAIN;
+            return FUN_FAILURE;
+        }
+        __sq_notify(&sq->fnfull, &sq->wnfull, 1);
+        return FUN_SUCCESS;
+    }
+
+    if (sem_trywait(&sq->mnempty) == -1) {
         return FUN_FAILURE;
     }
 
-    return FUN_SUCCESS;
+    return __sem_get(sq, buf, 1);
 }
 
 ssize_t sq_length(const SQueue sq) {
+    if (sq->engine == SQ_ENGINE_RING) {
+        size_t deq = atomic_load_explicit(&sq->deqpos, memory_order_acquire);
+        size_t enq = atomic_load_explicit(&sq->enqpos, memory_order_acquire);
+        if (enq <= deq) {
+            return 0;
+        }
+        return (ssize_t) (enq - deq > sq->max_length ?
+                sq->max_length : enq - deq);
+    }
+
     if (sem_wait(&sq->mshm) == -1) {
         return FUN_FAILURE;
     }
@@ -180,31 +504,52 @@ ssize_t sq_length(const SQueue sq) {
     return res;
 }
 
+/* Avec le moteur SQ_ENGINE_RING, sq_apply parcourt un instantané de l'anneau :
+ * les éléments enfilés ou défilés en parallèle peuvent être ignorés. */
+static int __ring_apply(struct __squeue *sq, int (*fun)(void *)) {
+    size_t deq = atomic_load_explicit(&sq->deqpos, memory_order_acquire);
+    size_t enq = atomic_load_explicit(&sq->enqpos, memory_order_acquire);
+    for (size_t pos = deq; pos < enq; pos++) {
+        struct __sq_slot *slot = SQ_SLOT(sq, pos);
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire)
+                != pos + 1) {
+            continue;
+        }
+        int ret = fun(slot->data);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return FUN_SUCCESS;
+}
+
 int sq_apply(SQueue sq, int (*fun)(void *)) {
     if (sq == NULL) {
         return FUN_FAILURE;
     }
 
+    if (sq->engine == SQ_ENGINE_RING) {
+        return __ring_apply(sq, fun);
+    }
+
     if (sem_wait(&sq->mshm) == -1) {
         return FUN_FAILURE;
     }
 
-    size_t i = sq->head;
-    char *e = sq->data + sq->head * sq->size;
-    do {
-        int ret = fun(e);
-        if (ret != 0) {
-            return ret;
-        }
-        i = (i + 1) % sq->max_length;
-        e = sq->data + i * sq->size;
-    } while (i != sq->tail);
+    /* La file pleine et la file vide ont la même tête et la même queue : le
+     * parcours s'appuie sur la longueur. Le mutex est rendu même lorsque fun
+     * interrompt le parcours. */
+    int ret = FUN_SUCCESS;
+    for (size_t k = 0, i = sq->head; k < sq->length && ret == FUN_SUCCESS;
+            k++, i = (i + 1) % sq->max_length) {
+        ret = fun(sq->data + i * sq->size);
+    }
 
     if (sem_post(&sq->mshm) == -1) {
         return FUN_FAILURE;
     }
 
-    return FUN_SUCCESS;
+    return ret;
 }
 
 void sq_dispose(SQueue *sqp) {
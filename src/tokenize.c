@@ -0,0 +1,139 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "tokenize.h"
+
+/* Caractères séparant les arguments */
+#define TK_BLANKS " \t\n"
+
+/* Caractères interrompant une suite de caractères ordinaires */
+#define TK_SPECIALS TK_BLANKS "'\"\\|"
+
+/* Caractères protégés par '\' entre guillemets */
+#define TK_DQESCAPES "\"\\$`\n"
+
+ssize_t tk_split(const char *str, char *args, uint32_t offs[],
+        size_t *argc) {
+    size_t n = 0;
+    size_t len = 0;
+    bool inword = false;
+    const char *p = str;
+    while (*p != '\0') {
+        /* Une fin de ligne protégée disparaît, y compris entre deux
+         * arguments */
+        if (p[0] == '\\' && p[1] == '\n') {
+            p += 2;
+            continue;
+        }
+        if (strchr(TK_BLANKS, *p) != NULL) {
+            if (inword) {
+                args[len++] = '\0';
+                inword = false;
+            }
+            p++;
+            continue;
+        }
+        if (*p == '|') {
+            if (inword) {
+                args[len++] = '\0';
+                inword = false;
+            }
+            if (n == 0 || offs[n - 1] == TK_PIPE) {
+                goto error;
+            }
+            offs[n++] = TK_PIPE;
+            p++;
+            continue;
+        }
+        if (!inword) {
+            offs[n++] = (uint32_t) len;
+            inword = true;
+        }
+
+        size_t k;
+        switch (*p) {
+        case '\'':
+            k = strcspn(p + 1, "'");
+            if (p[1 + k] == '\0') {
+                goto error;
+            }
+            memcpy(args + len, p + 1, k);
+            len += k;
+            p += k + 2;
+            break;
+        case '"':
+            for (p++; *p != '"'; p++) {
+                if (*p == '\0') {
+                    goto error;
+                }
+                if (*p == '\\' && p[1] != '\0'
+                        && strchr(TK_DQESCAPES, p[1]) != NULL) {
+                    p++;
+                    if (*p == '\n') {
+                        continue;
+                    }
+                }
+                args[len++] = *p;
+            }
+            p++;
+            break;
+        case '\\':
+            if (p[1] == '\0') {
+                goto error;
+            }
+            args[len++] = p[1];
+            p += 2;
+            break;
+        default:
+            /* Les caractères ordinaires sont recopiés d'un bloc */
+            k = strcspn(p, TK_SPECIALS);
+            memcpy(args + len, p, k);
+            len += k;
+            p += k;
+        }
+    }
+    if (inword) {
+        args[len++] = '\0';
+    }
+    if (n > 0 && offs[n - 1] == TK_PIPE) {
+        goto error;
+    }
+
+    *argc = n;
+    return (ssize_t) len;
+
+error:
+    errno = EINVAL;
+    return -1;
+}
+
+int tk_check(const char *args, size_t argslen, const uint32_t offs[],
+        size_t argc) {
+    size_t start = 0;
+    for (size_t i = 0; i < argc; i++) {
+        if (offs[i] == TK_PIPE) {
+            if (i == 0 || i == argc - 1 || offs[i - 1] == TK_PIPE) {
+                return -1;
+            }
+            continue;
+        }
+        if (offs[i] != start || start >= argslen) {
+            return -1;
+        }
+        const char *end = memchr(args + start, '\0', argslen - start);
+        if (end == NULL) {
+            return -1;
+        }
+        start = (size_t) (end - args) + 1;
+    }
+    return start == argslen ? 0 : -1;
+}
+
+size_t tk_stages(const uint32_t offs[], size_t argc) {
+    size_t n = (argc > 0);
+    for (size_t i = 0; i < argc; i++) {
+        n += (offs[i] == TK_PIPE);
+    }
+    return n;
+}
@@ -0,0 +1,467 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "zygote.h"
+
+/* Taille maximale des arguments d'une commande transmise au zygote */
+#define ZY_ARGS_MAX (1024 * 1024)
+
+/* Descripteurs joints à une requête (champ mask de struct __zy_request) */
+#define ZY_FD_IN 0x1
+#define ZY_FD_OUT 0x2
+#define ZY_FD_ERR 0x4
+
+/**
+ * Message du zygote. Une requête de lancement reçoit un message contenant le
+ * PID du processus lancé (ou -1 et l'erreur err), suivi, si le lancement a
+ * réussi, d'un second message (exited non nul) contenant le statut du
+ * processus et les ressources qu'il a consommées. Ce dernier peut précéder la
+ * réponse à une requête de lancement ultérieure sur le même canal.
+ */
+struct __zy_reply {
+    pid_t pid;
+    int err;
+    int exited;
+    int status;
+    struct rusage ru;
+};
+
+struct __zygote {
+    pid_t pid;                  /* Le processus zygote */
+    size_t n;                   /* Nombre de canaux */
+    size_t *npending;           /* Nombre de fins reçues par zy_spawn() */
+    struct __zy_reply *pending; /* Ces fins, ZY_CHILDREN_MAX par canal */
+    int ch[];                   /* Extrémités des canaux côté daemon */
+};
+
+/**
+ * En-tête d'une requête de lancement. Il est accompagné des descripteurs
+ * désignés par mask (dans l'ordre entrée, sortie, erreur) et suivi des len
+ * octets des argc arguments, chacun terminé par un caractère nul, puis des
+ * filelen octets du chemin du fichier à exécuter (sans caractère nul, aucun
+ * si la commande est cherchée dans PATH).
+ */
+struct __zy_request {
+    uint32_t argc;
+    uint32_t len;
+    uint32_t filelen;
+    uint32_t mask;
+};
+
+/**
+ * Reçoit exactement len octets sur le canal fd.
+ *
+ * @return  0 en cas de succès, -1 sinon (errno vaut EPIPE si le canal a été
+ *          fermé par l'autre extrémité).
+ */
+static int __zy_recv(int fd, void *buf, size_t len) {
+    for (size_t n = 0; n < len; ) {
+        ssize_t r = recv(fd, (char *) buf + n, len - n, MSG_WAITALL);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            errno = (r == 0 ? EPIPE : errno);
+            return -1;
+        }
+        n += (size_t) r;
+    }
+    return 0;
+}
+
+/**
+ * Envoie exactement len octets sur le canal fd.
+ *
+ * @return  0 en cas de succès, -1 sinon.
+ */
+static int __zy_send(int fd, const void *buf, size_t len) {
+    for (size_t n = 0; n < len; ) {
+        ssize_t r = send(fd, (const char *) buf + n, len - n, MSG_NOSIGNAL);
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        n += (size_t) r;
+    }
+    return 0;
+}
+
+/* --- ZYGOTE -------------------------------------------------------------- */
+
+/**
+ * Reçoit une requête de lancement sur le canal ch et lance la commande.
+ *
+ * @arg     pids    Les PID des processus en cours lancés par le canal, 0
+ *                  pour un emplacement libre. Celui du processus lancé y est
+ *                  ajouté.
+ * @return          0 si la requête a été traitée, -1 si le canal a été fermé
+ *                  ou n'est plus exploitable.
+ */
+static int __zy_serve(int ch, enum sp_backend backend,
+        pid_t pids[ZY_CHILDREN_MAX]) {
+    struct __zy_request rq;
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = { &rq, sizeof(rq) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctl.buf,
+        .msg_controllen = sizeof(ctl.buf)
+    };
+
+    ssize_t r;
+    while ((r = recvmsg(ch, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC)) == -1
+            && errno == EINTR);
+    if (r != (ssize_t) sizeof(rq)) {
+        return -1;
+    }
+
+    int rfds[3] = { -1, -1, -1 };
+    size_t nfds = 0;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+            && cmsg->cmsg_type == SCM_RIGHTS) {
+        nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        nfds = nfds > 3 ? 3 : nfds;
+        memcpy(rfds, CMSG_DATA(cmsg), nfds * sizeof(int));
+    }
+
+    /* Les descripteurs reçus sont attribués dans l'ordre de mask */
+    int *slots[3];
+    struct sp_fds fds = { -1, -1, -1 };
+    size_t k = 0;
+    if (rq.mask & ZY_FD_IN) {
+        slots[k++] = &fds.in;
+    }
+    if (rq.mask & ZY_FD_OUT) {
+        slots[k++] = &fds.out;
+    }
+    if (rq.mask & ZY_FD_ERR) {
+        slots[k++] = &fds.err;
+    }
+
+    struct __zy_reply rp = { .pid = -1, .err = EPROTO };
+    char *data = NULL;
+    char **argv = NULL;
+    size_t slot = 0;
+    int ret = -1;
+
+    if (k != nfds || rq.argc == 0 || rq.len == 0 || rq.len > ZY_ARGS_MAX
+            || rq.filelen > ZY_ARGS_MAX) {
+        goto end;
+    }
+    for (size_t i = 0; i < k; i++) {
+        *slots[i] = rfds[i];
+    }
+
+    data = malloc((size_t) rq.len + rq.filelen + 1);
+    argv = malloc((rq.argc + 1) * sizeof(*argv));
+    if (data == NULL || argv == NULL) {
+        goto end;
+    }
+    if (__zy_recv(ch, data, (size_t) rq.len + rq.filelen) == -1) {
+        goto end;
+    }
+    data[rq.len + rq.filelen] = '\0';
+
+    /* Le canal reste exploitable : une requête invalide reçoit une erreur */
+    ret = 0;
+    size_t argc = 0;
+    for (size_t i = 0; i < rq.len && argc < rq.argc; argc++) {
+        argv[argc] = data + i;
+        i += strnlen(data + i, rq.len - i) + 1;
+    }
+    if (argc != rq.argc || data[rq.len - 1] != '\0') {
+        goto end;
+    }
+    argv[argc] = NULL;
+
+    /* Le processus lancé occupe un emplacement libre du canal */
+    while (slot < ZY_CHILDREN_MAX && pids[slot] != 0) {
+        slot++;
+    }
+    if (slot == ZY_CHILDREN_MAX) {
+        rp.err = EAGAIN;
+        goto end;
+    }
+
+    rp.pid = sp_spawn(backend, rq.filelen > 0 ? data + rq.len : NULL, argv,
+            &fds);
+    rp.err = (rp.pid == -1 ? errno : 0);
+
+end:
+    for (size_t i = 0; i < nfds; i++) {
+        close(rfds[i]);
+    }
+    free(argv);
+    free(data);
+
+    if (ret == -1) {
+        return -1;
+    }
+    if (__zy_send(ch, &rp, sizeof(rp)) == -1) {
+        return -1;
+    }
+    if (rp.pid != -1) {
+        pids[slot] = rp.pid;
+    }
+    return 0;
+}
+
+/**
+ * Boucle principale du zygote : les requêtes de lancement sont reçues sur les
+ * n canaux ch, et le statut de chaque fils terminé est transmis sur le canal
+ * qui l'a lancé.
+ */
+static void __zy_main(const int ch[], size_t n, enum sp_backend backend) {
+    /* Le gestionnaire de SIGTERM du daemon libère les ressources de
+     * celui-ci : le zygote ne le conserve pas */
+    signal(SIGTERM, SIG_DFL);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    int sfd = signalfd(-1, &set, SFD_CLOEXEC);
+    if (sfd == -1) {
+        _exit(EXIT_FAILURE);
+    }
+
+    struct pollfd pfds[n + 1];
+    pid_t pids[n * ZY_CHILDREN_MAX];
+    memset(pids, 0, sizeof(pids));
+    for (size_t i = 0; i < n; i++) {
+        pfds[i] = (struct pollfd) { .fd = ch[i], .events = POLLIN };
+    }
+    pfds[n] = (struct pollfd) { .fd = sfd, .events = POLLIN };
+
+    while (1) {
+        if (poll(pfds, n + 1, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if (pfds[i].revents != 0
+                    && __zy_serve(ch[i], backend,
+                        pids + i * ZY_CHILDREN_MAX) == -1) {
+                /* Le daemon a fermé ses canaux ou s'est terminé */
+                _exit(EXIT_SUCCESS);
+            }
+        }
+
+        if (pfds[n].revents == 0) {
+            continue;
+        }
+
+        /* Plusieurs SIGCHLD peuvent n'être signalés qu'une fois : tous les
+         * fils terminés sont attendus */
+        struct signalfd_siginfo si;
+        while (read(sfd, &si, sizeof(si)) == -1 && errno == EINTR);
+
+        struct __zy_reply rp = { .err = 0, .exited = 1 };
+        while ((rp.pid = wait4(-1, &rp.status, WNOHANG, &rp.ru)) > 0) {
+            for (size_t k = 0; k < n * ZY_CHILDREN_MAX; k++) {
+                if (pids[k] == rp.pid) {
+                    pids[k] = 0;
+                    __zy_send(ch[k / ZY_CHILDREN_MAX], &rp, sizeof(rp));
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* --- DAEMON -------------------------------------------------------------- */
+
+Zygote zy_create(size_t n, enum sp_backend backend) {
+    if (n == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct __zygote *zy = malloc(sizeof(struct __zygote) + n * sizeof(int));
+    if (zy == NULL) {
+        return NULL;
+    }
+    zy->n = 0;
+
+    int peer[n];
+    zy->npending = calloc(n, sizeof(*zy->npending));
+    zy->pending = calloc(n * ZY_CHILDREN_MAX, sizeof(*zy->pending));
+    if (zy->npending == NULL || zy->pending == NULL) {
+        goto error;
+    }
+    for (size_t i = 0; i < n; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+            goto error;
+        }
+        zy->ch[i] = sv[0];
+        peer[i] = sv[1];
+        zy->n++;
+    }
+
+    zy->pid = fork();
+    if (zy->pid == -1) {
+        goto error;
+    }
+    if (zy->pid == 0) {
+        for (size_t i = 0; i < n; i++) {
+            close(zy->ch[i]);
+        }
+        __zy_main(peer, n, backend);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        close(peer[i]);
+    }
+    return zy;
+
+error:
+    for (size_t i = 0; i < zy->n; i++) {
+        close(zy->ch[i]);
+        close(peer[i]);
+    }
+    free(zy->npending);
+    free(zy->pending);
+    free(zy);
+    return NULL;
+}
+
+pid_t zy_spawn(Zygote zy, size_t ch, const char *file, char *const argv[],
+        const struct sp_fds *fds) {
+    struct __zy_request rq = { .argc = 0, .len = 0, .filelen = 0, .mask = 0 };
+    size_t len = 0;
+    for (size_t i = 0; argv[i] != NULL; i++) {
+        len += strlen(argv[i]) + 1;
+        rq.argc++;
+    }
+    size_t filelen = (file != NULL ? strlen(file) : 0);
+    if (len == 0 || len > ZY_ARGS_MAX || filelen > ZY_ARGS_MAX) {
+        errno = E2BIG;
+        return -1;
+    }
+    rq.len = (uint32_t) len;
+    rq.filelen = (uint32_t) filelen;
+
+    char *data = malloc(len + filelen);
+    if (data == NULL) {
+        return -1;
+    }
+    for (size_t i = 0, off = 0; argv[i] != NULL; i++) {
+        size_t n = strlen(argv[i]) + 1;
+        memcpy(data + off, argv[i], n);
+        off += n;
+    }
+    if (filelen > 0) {
+        memcpy(data + len, file, filelen);
+    }
+
+    int sfds[3];
+    size_t nfds = 0;
+    if (fds->in != -1) {
+        rq.mask |= ZY_FD_IN;
+        sfds[nfds++] = fds->in;
+    }
+    if (fds->out != -1) {
+        rq.mask |= ZY_FD_OUT;
+        sfds[nfds++] = fds->out;
+    }
+    if (fds->err != -1) {
+        rq.mask |= ZY_FD_ERR;
+        sfds[nfds++] = fds->err;
+    }
+
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = { &rq, sizeof(rq) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (nfds > 0) {
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), sfds, nfds * sizeof(int));
+    }
+
+    int fd = zy->ch[ch];
+    ssize_t r;
+    while ((r = sendmsg(fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+    if (r != -1 && r != (ssize_t) sizeof(rq)) {
+        errno = EPIPE;
+        r = -1;
+    }
+    if (r == -1 || __zy_send(fd, data, len + filelen) == -1) {
+        free(data);
+        return -1;
+    }
+    free(data);
+
+    /* La fin d'un processus lancé précédemment sur le canal est conservée
+     * pour zy_wait() */
+    struct __zy_reply rp;
+    while (1) {
+        if (__zy_recv(fd, &rp, sizeof(rp)) == -1) {
+            return -1;
+        }
+        if (!rp.exited) {
+            break;
+        }
+        if (zy->npending[ch] == ZY_CHILDREN_MAX) {
+            errno = EPROTO;
+            return -1;
+        }
+        zy->pending[ch * ZY_CHILDREN_MAX + zy->npending[ch]++] = rp;
+    }
+    if (rp.pid == -1) {
+        errno = rp.err;
+    }
+    return rp.pid;
+}
+
+pid_t zy_wait(Zygote zy, size_t ch, int *status, struct rusage *ru) {
+    struct __zy_reply rp;
+    if (zy->npending[ch] > 0) {
+        struct __zy_reply *pending = zy->pending + ch * ZY_CHILDREN_MAX;
+        rp = pending[0];
+        memmove(pending, pending + 1,
+                --zy->npending[ch] * sizeof(*pending));
+    } else if (__zy_recv(zy->ch[ch], &rp, sizeof(rp)) == -1) {
+        return -1;
+    }
+    *status = rp.status;
+    *ru = rp.ru;
+    return rp.pid;
+}
+
+void zy_dispose(Zygote *zyp) {
+    struct __zygote *zy = *zyp;
+    for (size_t i = 0; i < zy->n; i++) {
+        close(zy->ch[i]);
+    }
+    while (waitpid(zy->pid, NULL, 0) == -1 && errno == EINTR);
+    free(zy->npending);
+    free(zy->pending);
+    free(zy);
+    *zyp = NULL;
+}
@@ -0,0 +1,367 @@
+/* Générateur de charge de bout en bout : lance des clients cmdl contre le
+ * daemon en cours d'exécution et mesure, pour chaque requête, le délai entre
+ * sa soumission et le premier octet de sortie reçu, puis la fin du client.
+ *
+ * - En boucle fermée (par défaut), -c clients enchaînent leurs requêtes.
+ * - En boucle ouverte (-r), les requêtes arrivent selon un processus de
+ * Poisson de taux donné, dans la limite de -c requêtes simultanées. Une
+ * requête retardée par cette limite est mesurée depuis son instant d'arrivée
+ * prévu, ce qui évite de masquer l'attente qu'elle subit.
+ * - Chaque requête tire sa commande dans le mélange -m, une liste de
+ * commandes séparées par ';', chacune éventuellement précédée de son poids
+ * ("3:true;1:sleep 0.01").
+ *
+ * Le résumé est affiché, et ajouté à la fin du fichier -o (CSV, ou une ligne
+ * JSON par exécution si son nom se termine par .json) pour suivre les
+ * résultats d'une version à l'autre.
+ *
+ * Usage : bench_load [-c clients] [-n requêtes] [-r requêtes/s] [-m mélange]
+ *                    [-s] [-o fichier] [-x chemin de cmdl] [-S graine]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "histo.h"
+
+#define CLIENTS 16
+#define REQUESTS 2000
+#define MIX "echo hello"
+#define CMDL "./cmdl"
+#define MIX_MAX 32
+
+extern char **environ;
+
+/* Commande du mélange et son poids */
+struct entry {
+    char *cmd;
+    double weight;
+};
+
+/* Requête en cours : le client lancé, sa sortie et son pidfd */
+struct req {
+    pid_t pid;
+    int out;
+    int pidfd;
+    long t0;        /* Soumission (ns) */
+    long first;     /* Premier octet de sortie, 0 si aucun */
+};
+
+static struct entry mix[MIX_MAX];
+static size_t nmix;
+static double total_weight;
+static const char *cmdl = CMDL;
+static bool sock;
+static unsigned short seed[3] = { 1, 0, 0 };
+
+static struct histo first_h;
+static struct histo exit_h;
+static size_t errors;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Découpe le mélange spec en commandes pondérées */
+static void parse_mix(char *spec) {
+    for (char *tok = strtok(spec, ";"); tok != NULL; tok = strtok(NULL, ";")) {
+        if (nmix == MIX_MAX) {
+            fprintf(stderr, "Error: at most %d commands in the mix\n",
+                    MIX_MAX);
+            exit(EXIT_FAILURE);
+        }
+        double w = 1;
+        char *end;
+        double v = strtod(tok, &end);
+        if (end != tok && *end == ':' && v > 0) {
+            w = v;
+            tok = end + 1;
+        }
+        if (*tok == '\0') {
+            continue;
+        }
+        mix[nmix++] = (struct entry) { tok, w };
+        total_weight += w;
+    }
+    if (nmix == 0) {
+        fprintf(stderr, "Error: empty command mix\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static const char *pick(void) {
+    double x = erand48(seed) * total_weight;
+    for (size_t i = 0; i < nmix - 1; i++) {
+        if (x < mix[i].weight) {
+            return mix[i].cmd;
+        }
+        x -= mix[i].weight;
+    }
+    return mix[nmix - 1].cmd;
+}
+
+/* Lance un client cmdl dont la sortie standard est lue par le générateur */
+static void submit(struct req *r, long t0) {
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        exit(EXIT_FAILURE);
+    }
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, p[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null",
+            O_WRONLY, 0);
+    char *argv[] = { (char *) cmdl, (char *) "-s", (char *) pick(), NULL };
+    if (!sock) {
+        argv[1] = argv[2];
+        argv[2] = NULL;
+    }
+    int err = posix_spawn(&r->pid, cmdl, &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(p[1]);
+    if (err != 0) {
+        fprintf(stderr, "Error: failed to run %s (%s)\n", cmdl,
+                strerror(err));
+        exit(EXIT_FAILURE);
+    }
+
+    r->out = p[0];
+    r->pidfd = (int) syscall(SYS_pidfd_open, r->pid, 0);
+    if (r->pidfd == -1) {
+        perror("pidfd_open");
+        exit(EXIT_FAILURE);
+    }
+    r->t0 = t0;
+    r->first = 0;
+}
+
+/* Traite les événements de la requête r, et indique si elle est terminée */
+static bool progress(struct req *r, short out_ev, short pid_ev) {
+    if (r->out != -1 && out_ev != 0) {
+        char buf[4096];
+        ssize_t n = read(r->out, buf, sizeof(buf));
+        if (n > 0 && r->first == 0) {
+            r->first = now_ns();
+        } else if (n == 0 || (n == -1 && errno != EINTR)) {
+            close(r->out);
+            r->out = -1;
+        }
+    }
+
+    /* La fin du client n'est comptée qu'une fois sa sortie entièrement lue */
+    if (pid_ev == 0 || r->out != -1) {
+        return false;
+    }
+    long t1 = now_ns();
+    int status;
+    if (waitpid(r->pid, &status, 0) == -1 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0) {
+        errors++;
+    }
+    close(r->pidfd);
+    if (r->first != 0) {
+        hi_record(&first_h, (uint64_t) (r->first - r->t0));
+    }
+    hi_record(&exit_h, (uint64_t) (t1 - r->t0));
+    return true;
+}
+
+/* Écrit s entre guillemets, au format JSON ou CSV */
+static void print_quoted(FILE *f, const char *s, bool json) {
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"') {
+            fputs(json ? "\\\"" : "\"\"", f);
+        } else if (json && *s == '\\') {
+            fputs("\\\\", f);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+int main(int argc, char *argv[]) {
+    size_t clients = CLIENTS;
+    size_t requests = REQUESTS;
+    double rate = 0;
+    char spec[4096] = MIX;
+    const char *outpath = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:n:r:m:so:x:S:")) != -1) {
+        switch (c) {
+        case 'c':
+            clients = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            requests = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            rate = strtod(optarg, NULL);
+            break;
+        case 'm':
+            snprintf(spec, sizeof(spec), "%s", optarg);
+            break;
+        case 's':
+            sock = true;
+            break;
+        case 'o':
+            outpath = optarg;
+            break;
+        case 'x':
+            cmdl = optarg;
+            break;
+        case 'S':
+            seed[0] = (unsigned short) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c clients] [-n requests] "
+                    "[-r rate] [-m mix] [-s] [-o file] [-x cmdl] "
+                    "[-S seed]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (clients == 0 || requests == 0 || rate < 0) {
+        fprintf(stderr, "Error: invalid parameters\n");
+        return EXIT_FAILURE;
+    }
+    char mixdesc[sizeof(spec)];
+    snprintf(mixdesc, sizeof(mixdesc), "%s", spec);
+    parse_mix(spec);
+
+    struct req *reqs = calloc(clients, sizeof(*reqs));
+    struct pollfd *pfds = calloc(2 * clients, sizeof(*pfds));
+    if (reqs == NULL || pfds == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    /* Instant d'arrivée de la prochaine requête en boucle ouverte : les
+     * intervalles suivent une loi exponentielle de paramètre rate */
+    long start = now_ns();
+    long next = start;
+    size_t issued = 0;
+    size_t done = 0;
+    size_t inflight = 0;
+
+    while (done < requests) {
+        long now = now_ns();
+        while (issued < requests && inflight < clients
+                && (rate == 0 || next <= now)) {
+            submit(&reqs[inflight++], rate == 0 ? now : next);
+            issued++;
+            if (rate > 0) {
+                next += (long) (-log(1 - erand48(seed)) / rate * 1e9);
+            }
+        }
+
+        for (size_t i = 0; i < inflight; i++) {
+            pfds[2 * i] = (struct pollfd) { reqs[i].out, POLLIN, 0 };
+            pfds[2 * i + 1] = (struct pollfd) { reqs[i].pidfd, POLLIN, 0 };
+        }
+        int timeout = -1;
+        if (rate > 0 && issued < requests && inflight < clients) {
+            long wait = next - now_ns();
+            timeout = wait <= 0 ? 0 : (int) (wait / 1000000) + 1;
+        }
+        if (poll(pfds, 2 * inflight, timeout) == -1 && errno != EINTR) {
+            perror("poll");
+            return EXIT_FAILURE;
+        }
+
+        /* Une requête terminée est remplacée par la dernière du tableau */
+        for (size_t i = inflight; i > 0; i--) {
+            size_t k = i - 1;
+            if (progress(&reqs[k], pfds[2 * k].revents,
+                        pfds[2 * k + 1].revents)) {
+                reqs[k] = reqs[--inflight];
+                done++;
+            }
+        }
+    }
+
+    double elapsed = (double) (now_ns() - start) / 1e9;
+    double tput = (double) requests / elapsed;
+    static const double qs[] = { 0.50, 0.99, 0.999 };
+    double first[3];
+    double last[3];
+    for (size_t i = 0; i < 3; i++) {
+        first[i] = (double) hi_percentile(&first_h, qs[i]) / 1e6;
+        last[i] = (double) hi_percentile(&exit_h, qs[i]) / 1e6;
+    }
+
+    printf("mode        %s, %zu clients", rate == 0 ? "closed" : "open",
+            clients);
+    if (rate > 0) {
+        printf(", %.1f req/s", rate);
+    }
+    printf("%s\nmix         %s\n", sock ? ", socket" : "", mixdesc);
+    printf("requests    %zu (%zu errors) in %.3f s\n", requests, errors,
+            elapsed);
+    printf("throughput  %.1f req/s\n", tput);
+    printf("%-11s %10s %10s %10s %10s\n", "(ms)", "p50", "p99", "p999",
+            "max");
+    printf("%-11s %10.3f %10.3f %10.3f %10.3f\n", "first byte", first[0],
+            first[1], first[2], (double) first_h.max / 1e6);
+    printf("%-11s %10.3f %10.3f %10.3f %10.3f\n", "exit", last[0], last[1],
+            last[2], (double) exit_h.max / 1e6);
+
+    if (outpath == NULL) {
+        return EXIT_SUCCESS;
+    }
+
+    /* Le fichier de résultats est complété d'une ligne par exécution */
+    FILE *f = fopen(outpath, "a");
+    if (f == NULL) {
+        perror(outpath);
+        return EXIT_FAILURE;
+    }
+    size_t len = strlen(outpath);
+    bool json = len >= 5 && strcmp(outpath + len - 5, ".json") == 0;
+    time_t t = time(NULL);
+    if (json) {
+        fprintf(f, "{\"time\":%lld,\"mode\":\"%s\",\"clients\":%zu,"
+                "\"rate\":%.3f,\"socket\":%s,\"mix\":", (long long) t,
+                rate == 0 ? "closed" : "open", clients, rate,
+                sock ? "true" : "false");
+        print_quoted(f, mixdesc, true);
+        fprintf(f, ",\"requests\":%zu,\"errors\":%zu,\"elapsed_s\":%.6f,"
+                "\"throughput\":%.3f,\"first_ms\":{\"p50\":%.6f,"
+                "\"p99\":%.6f,\"p999\":%.6f},\"exit_ms\":{\"p50\":%.6f,"
+                "\"p99\":%.6f,\"p999\":%.6f}}\n", requests, errors, elapsed,
+                tput, first[0], first[1], first[2], last[0], last[1],
+                last[2]);
+    } else {
+        struct stat st;
+        if (fstat(fileno(f), &st) == 0 && st.st_size == 0) {
+            fprintf(f, "time,mode,clients,rate,socket,mix,requests,errors,"
+                    "elapsed_s,throughput,first_p50_ms,first_p99_ms,"
+                    "first_p999_ms,exit_p50_ms,exit_p99_ms,exit_p999_ms\n");
+        }
+        fprintf(f, "%lld,%s,%zu,%.3f,%d,", (long long) t,
+                rate == 0 ? "closed" : "open", clients, rate, sock);
+        print_quoted(f, mixdesc, false);
+        fprintf(f, ",%zu,%zu,%.6f,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+                requests, errors, elapsed, tput, first[0], first[1],
+                first[2], last[0], last[1], last[2]);
+    }
+    fclose(f);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+/* Mesure le débit et le temps processeur consommé par le module relay pour
+ * transférer un flux depuis un tube (comme la sortie d'une commande dans le
+ * tube nommé de cmdl) vers différentes destinations.
+ *
+ * Usage : bench_relay [taille en Mio] [fichier de destination]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "relay.h"
+
+#define SIZE_MIB 2048
+#define FILE_DEFAULT "/tmp/bench_relay.out"
+#define CHUNK (1 << 20)
+#define ROUNDS 3
+
+static const char *names[] = { "splice", "sendfile", "copy" };
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static double cputime(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (double) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+            + (double) (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/* Lance un processus écrivant size octets dans un tube, et renvoie
+ * l'extrémité en lecture du tube */
+static int producer(size_t size, pid_t *pid) {
+    int p[2];
+    if (pipe(p) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(p[1], F_SETPIPE_SZ, CHUNK);
+
+    *pid = fork();
+    if (*pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (*pid == 0) {
+        close(p[0]);
+        char *buf = malloc(CHUNK);
+        if (buf == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+        memset(buf, 'x', CHUNK);
+        for (size_t n = 0; n < size; ) {
+            size_t len = size - n < CHUNK ? size - n : CHUNK;
+            ssize_t w = write(p[1], buf, len);
+            if (w == -1) {
+                _exit(EXIT_FAILURE);
+            }
+            n += (size_t) w;
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(p[1]);
+    return p[0];
+}
+
+/* Lance un processus lisant et ignorant le contenu d'un tube, et renvoie
+ * l'extrémité en écriture du tube */
+static int consumer(pid_t *pid) {
+    int p[2];
+    if (pipe(p) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(p[0], F_SETPIPE_SZ, CHUNK);
+
+    *pid = fork();
+    if (*pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (*pid == 0) {
+        close(p[1]);
+        int null = open("/dev/null", O_WRONLY);
+        if (rl_relay(p[0], null, RL_SPLICE, NULL) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(p[0]);
+    return p[1];
+}
+
+/* Destinations du transfert */
+enum dest { DEST_NULL, DEST_FILE, DEST_PIPE };
+static const char *dests[] = { "/dev/null", "file", "pipe" };
+
+static const char *file = FILE_DEFAULT;
+
+static int dest_open(enum dest d, pid_t *pid) {
+    int fd = -1;
+    switch (d) {
+    case DEST_NULL:
+        fd = open("/dev/null", O_WRONLY);
+        break;
+    case DEST_FILE:
+        fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        break;
+    case DEST_PIPE:
+        fd = consumer(pid);
+        break;
+    }
+    if (fd == -1) {
+        perror("open");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static void dest_close(enum dest d, int fd, pid_t pid) {
+    close(fd);
+    if (d == DEST_FILE) {
+        unlink(file);
+    } else if (d == DEST_PIPE) {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+/* Chaque mesure est répétée ROUNDS fois et la meilleure est retenue : le
+ * premier accès à des pages neuves (cache, tmpfs) fausse souvent la première */
+static void bench(enum dest d, enum rl_method m, size_t size) {
+    double best = 0.0;
+    double cpu = 0.0;
+    enum rl_method used = m;
+
+    for (int i = 0; i < ROUNDS; i++) {
+        pid_t ppid;
+        pid_t cpid = -1;
+        int in = producer(size, &ppid);
+        int out = dest_open(d, &cpid);
+
+        double t0 = now();
+        double c0 = cputime();
+        ssize_t n = rl_relay(in, out, m, &used);
+        double c1 = cputime();
+        double t1 = now();
+
+        close(in);
+        waitpid(ppid, NULL, 0);
+        dest_close(d, out, cpid);
+
+        if (n != (ssize_t) size) {
+            fprintf(stderr, "Error: %zd bytes relayed, %zu expected\n", n,
+                    size);
+            exit(EXIT_FAILURE);
+        }
+
+        double rate = (double) size / (1 << 20) / (t1 - t0);
+        if (rate > best) {
+            best = rate;
+            cpu = c1 - c0;
+        }
+    }
+
+    printf("%-10s %-9s %8.1f MiB/s  cpu %6.3f s\n", dests[d], names[used],
+            best, cpu);
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = (argc > 1 ? strtoul(argv[1], NULL, 10) : SIZE_MIB) << 20;
+    if (argc > 2) {
+        file = argv[2];
+    }
+
+    printf("%zu MiB, best of %d\n", size >> 20, ROUNDS);
+    for (enum dest d = DEST_NULL; d <= DEST_PIPE; d++) {
+        bench(d, RL_SPLICE, size);
+        bench(d, RL_COPY, size);
+    }
+
+    return EXIT_SUCCESS;
+}
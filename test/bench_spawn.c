@@ -0,0 +1,116 @@
+/* Mesure la latence de lancement (spawn + waitpid de /bin/true) de chaque
+ * mécanisme du module spawner, pour des tailles croissantes de mémoire
+ * résidente du processus appelant. La dernière ligne de chaque taille mesure
+ * fork au travers d'un zygote créé avant la croissance de la mémoire.
+ *
+ * Usage : bench_spawn [itérations] [taille max en Mio]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "spawner.h"
+#include "zygote.h"
+
+#define ITERATIONS 200
+#define RSS_MAX_MIB 1024
+
+static const char *names[] = { "fork", "vfork", "posix_spawn", "zygote" };
+
+/* Pseudo-mécanisme désignant le lancement par le zygote */
+#define ZYGOTE (SP_POSIX_SPAWN + 1)
+
+static Zygote zygote;
+
+static int cmp(const void *a, const void *b) {
+    long x = *(const long *) a;
+    long y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void bench(int b, size_t rss, long *samples, size_t n) {
+    char cmd[] = "/bin/true";
+    char *argv[] = { cmd, NULL };
+    struct sp_fds fds = { -1, -1, -1 };
+
+    long total = 0;
+    for (size_t i = 0; i < n; i++) {
+        long t0 = now_ns();
+        pid_t pid = (b == ZYGOTE
+                ? zy_spawn(zygote, 0, NULL, argv, &fds)
+                : sp_spawn((enum sp_backend) b, NULL, argv, &fds));
+        if (pid == -1) {
+            perror("spawn");
+            exit(EXIT_FAILURE);
+        }
+        if (b == ZYGOTE) {
+            int status;
+            struct rusage ru;
+            zy_wait(zygote, 0, &status, &ru);
+        } else {
+            waitpid(pid, NULL, 0);
+        }
+        samples[i] = now_ns() - t0;
+        total += samples[i];
+    }
+
+    qsort(samples, n, sizeof(*samples), cmp);
+    printf("%6zu MiB  %-12s mean %8.1f us  p50 %8.1f us  p99 %8.1f us\n",
+            rss, names[b], (double) total / (double) n / 1000.0,
+            (double) samples[n / 2] / 1000.0,
+            (double) samples[n * 99 / 100] / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : ITERATIONS;
+    size_t max = argc > 2 ? strtoul(argv[2], NULL, 10) : RSS_MAX_MIB;
+    if (n == 0) {
+        n = 1;
+    }
+
+    long *samples = malloc(n * sizeof(*samples));
+    if (samples == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    zygote = zy_create(1, SP_FORK);
+    if (zygote == NULL) {
+        perror("zy_create");
+        return EXIT_FAILURE;
+    }
+
+    /* La mémoire est touchée pour être effectivement résidente : c'est la
+     * copie des tables de pages qui pénalise fork */
+    char *ballast = NULL;
+    for (size_t rss = 0; rss <= max; rss = (rss == 0 ? 64 : rss * 4)) {
+        free(ballast);
+        ballast = NULL;
+        if (rss > 0) {
+            ballast = malloc(rss << 20);
+            if (ballast == NULL) {
+                perror("malloc");
+                return EXIT_FAILURE;
+            }
+            memset(ballast, 1, rss << 20);
+        }
+
+        for (int b = SP_FORK; b <= ZYGOTE; b++) {
+            bench(b, rss, samples, n);
+        }
+    }
+
+    zy_dispose(&zygote);
+    free(ballast);
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,362 @@
+/* Met à l'épreuve les files synchronisées entre plusieurs processus et mesure
+ * leur débit, pour chaque moteur et différentes tailles d'éléments et
+ * longueurs de file.
+ *
+ * - Des processus producteurs enfilent chacun leur part des éléments,
+ * numérotés, dans une file créée par sq_empty et ouverte par sq_open ; des
+ * processus consommateurs les défilent jusqu'à recevoir un élément de fin.
+ * - Chaque élément défilé est marqué dans un tableau partagé : un élément
+ * perdu, reçu deux fois ou altéré (son numéro est recopié à la fin de
+ * l'élément) fait échouer la mesure.
+ * - Un processus supplémentaire parcourt la file en continu avec sq_apply,
+ * interrompu au premier élément, et consulte sa longueur : un verrou qui ne
+ * serait pas rendu bloque la mesure, interrompue après TIMEOUT secondes.
+ *
+ * Le débit compte les éléments transférés par seconde ; les latences sont
+ * celles d'un appel à sq_enqueue_batch ou sq_dequeue_batch (un élément par
+ * appel par défaut, voir -b).
+ *
+ * Usage : bench_squeue [-p producteurs] [-c consommateurs] [-n éléments]
+ *                      [-b éléments par appel]
+ */
+
+#include <inttypes.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "histo.h"
+#include "squeue.h"
+
+#define SHM_QUEUE "/bench_squeue_shm"
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define ITEMS 200000
+#define PROCS_MAX 64
+#define BATCH_MAX 64
+#define TIMEOUT 60
+
+/* Numéro de l'élément de fin, qui arrête un consommateur */
+#define END UINT64_MAX
+
+static const char *engines[] = { "sem", "ring" };
+static const size_t sizes[] = { 16, 256, 4096 };
+static const size_t lengths[] = { 16, 1024 };
+
+/* Résultats d'une mesure, partagés avec les processus fils */
+struct shared {
+    atomic_bool go;             /* Départ commun des producteurs et
+                                   consommateurs */
+    atomic_bool stop;           /* Fin du parcours par sq_apply */
+    _Atomic uint64_t corrupt;   /* Éléments altérés */
+    uint64_t applies;           /* Parcours effectués par sq_apply */
+    struct histo enq[PROCS_MAX];
+    struct histo deq[PROCS_MAX];
+};
+
+static struct shared *sh;
+static _Atomic uint8_t *seen;   /* Nombre de réceptions de chaque élément */
+static size_t producers = PRODUCERS;
+static size_t consumers = CONSUMERS;
+static size_t items = ITEMS;
+static size_t batch = 1;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void *map_shared(size_t len) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void on_timeout(int sig) {
+    (void) sig;
+    static const char msg[] = "Error: timeout, the queue is stuck\n";
+    ssize_t r = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    (void) r;
+    shm_unlink(SHM_QUEUE);
+    _exit(EXIT_FAILURE);
+}
+
+/* Écrit le numéro id au début et à la fin de l'élément e */
+static void stamp(char *e, size_t size, uint64_t id) {
+    memcpy(e, &id, sizeof(id));
+    memcpy(e + size - sizeof(id), &id, sizeof(id));
+}
+
+/* Lance un processus fils qui s'arrête avec le processus de mesure */
+static pid_t spawn(void) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        while (!atomic_load(&sh->go) && !atomic_load(&sh->stop)) {
+            sched_yield();
+        }
+    }
+    return pid;
+}
+
+static SQueue open_queue(void) {
+    SQueue q = sq_open(SHM_QUEUE);
+    if (q == NULL) {
+        perror("sq_open");
+        _exit(EXIT_FAILURE);
+    }
+    return q;
+}
+
+static void produce(size_t p, size_t size) {
+    SQueue q = open_queue();
+    char *buf = malloc(batch * size);
+    struct histo *h = &sh->enq[p];
+    size_t first = items * p / producers;
+    size_t last = items * (p + 1) / producers;
+    for (size_t i = first; i < last; ) {
+        size_t n = last - i < batch ? last - i : batch;
+        for (size_t k = 0; k < n; k++) {
+            stamp(buf + k * size, size, i + k);
+        }
+        long t0 = now_ns();
+        if (sq_enqueue_batch(q, buf, n) == -1) {
+            perror("sq_enqueue_batch");
+            _exit(EXIT_FAILURE);
+        }
+        hi_record(h, (uint64_t) (now_ns() - t0));
+        i += n;
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+static void consume(size_t c, size_t size) {
+    SQueue q = open_queue();
+    char *buf = malloc(batch * size);
+    struct histo *h = &sh->deq[c];
+    while (1) {
+        long t0 = now_ns();
+        ssize_t n = sq_dequeue_batch(q, buf, batch);
+        if (n == -1) {
+            perror("sq_dequeue_batch");
+            _exit(EXIT_FAILURE);
+        }
+        hi_record(h, (uint64_t) (now_ns() - t0));
+
+        /* Les éléments de fin suivent tous les autres, et sont rendus à la
+         * file pour les autres consommateurs */
+        size_t ends = 0;
+        char *end = NULL;
+        for (ssize_t k = 0; k < n; k++) {
+            char *e = buf + (size_t) k * size;
+            uint64_t id, tail;
+            memcpy(&id, e, sizeof(id));
+            memcpy(&tail, e + size - sizeof(tail), sizeof(tail));
+            if (id != tail || (id >= items && id != END)) {
+                atomic_fetch_add(&sh->corrupt, 1);
+            } else if (id == END) {
+                end = e;
+                ends++;
+            } else {
+                atomic_fetch_add_explicit(&seen[id], 1, memory_order_relaxed);
+            }
+        }
+        if (ends > 0) {
+            for (size_t k = 0; k < ends; k++) {
+                sq_enqueue(q, end);
+            }
+            _exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+static int stop_first(void *e) {
+    (void) e;
+    return 1;
+}
+
+static void inspect(void) {
+    SQueue q = open_queue();
+    while (!atomic_load(&sh->stop)) {
+        if (sq_apply(q, stop_first) == -1 || sq_length(q) == -1) {
+            perror("sq_apply");
+            _exit(EXIT_FAILURE);
+        }
+        sh->applies++;
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/* Cumule l'histogramme src dans dst */
+static void merge(struct histo *dst, const struct histo *src) {
+    dst->count += src->count;
+    dst->sum += src->sum;
+    dst->max = src->max > dst->max ? src->max : dst->max;
+    for (size_t i = 0; i < HI_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+static void wait_child(pid_t pid) {
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error: a benchmark process failed\n");
+        shm_unlink(SHM_QUEUE);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Mesure une configuration, et indique si aucun élément n'a été perdu,
+ * dupliqué ou altéré */
+static bool bench(enum sq_engine engine, size_t size, size_t length) {
+    memset(sh, 0, sizeof(*sh));
+    memset(seen, 0, items);
+    shm_unlink(SHM_QUEUE);
+    SQueue q = sq_empty(SHM_QUEUE, size, length, engine);
+    if (q == NULL) {
+        perror("sq_empty");
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t pids[2 * PROCS_MAX + 1];
+    size_t n = 0;
+    for (size_t i = 0; i < producers; i++) {
+        if ((pids[n++] = spawn()) == 0) {
+            produce(i, size);
+        }
+    }
+    for (size_t i = 0; i < consumers; i++) {
+        if ((pids[n++] = spawn()) == 0) {
+            consume(i, size);
+        }
+    }
+    pid_t inspector = spawn();
+    if (inspector == 0) {
+        inspect();
+    }
+
+    alarm(TIMEOUT);
+    long t0 = now_ns();
+    atomic_store(&sh->go, true);
+    for (size_t i = 0; i < producers; i++) {
+        wait_child(pids[i]);
+    }
+    char *end = calloc(1, size);
+    stamp(end, size, END);
+    if (sq_enqueue(q, end) == -1) {
+        perror("sq_enqueue");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = producers; i < n; i++) {
+        wait_child(pids[i]);
+    }
+    double elapsed = (double) (now_ns() - t0) / 1e9;
+    atomic_store(&sh->stop, true);
+    wait_child(inspector);
+    alarm(0);
+
+    /* Seul l'élément de fin reste en file */
+    struct histo enq, deq;
+    hi_reset(&enq);
+    hi_reset(&deq);
+    for (size_t i = 0; i < producers; i++) {
+        merge(&enq, &sh->enq[i]);
+    }
+    for (size_t i = 0; i < consumers; i++) {
+        merge(&deq, &sh->deq[i]);
+    }
+    size_t lost = 0, dup = 0;
+    for (size_t i = 0; i < items; i++) {
+        lost += seen[i] == 0;
+        dup += seen[i] > 1;
+    }
+    bool ok = lost == 0 && dup == 0 && sh->corrupt == 0
+        && sq_length(q) == 1;
+
+    printf("%-4s %5zu %5zu %8.3f  %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "  %8"
+            PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "  %s\n",
+            engines[engine], size, length, (double) items / elapsed / 1e6,
+            hi_percentile(&enq, 0.5), hi_percentile(&enq, 0.99),
+            hi_percentile(&enq, 0.999), hi_percentile(&deq, 0.5),
+            hi_percentile(&deq, 0.99), hi_percentile(&deq, 0.999),
+            sh->applies, ok ? "ok" : "FAILED");
+    if (!ok) {
+        fprintf(stderr, "Error: %zu lost, %zu duplicated, %" PRIu64
+                " corrupted items\n", lost, dup, sh->corrupt);
+    }
+
+    free(end);
+    sq_dispose(&q);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int c;
+    while ((c = getopt(argc, argv, "p:c:n:b:")) != -1) {
+        switch (c) {
+        case 'p':
+            producers = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            consumers = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            items = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            batch = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p producers] [-c consumers] "
+                    "[-n items] [-b batch]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (producers == 0 || producers > PROCS_MAX || consumers == 0
+            || consumers > PROCS_MAX || items == 0 || batch == 0
+            || batch > BATCH_MAX) {
+        fprintf(stderr, "Error: invalid parameters\n");
+        return EXIT_FAILURE;
+    }
+
+    sh = map_shared(sizeof(*sh));
+    seen = map_shared(items);
+    signal(SIGALRM, on_timeout);
+
+    printf("%zu producers, %zu consumers, %zu items, %zu per call\n",
+            producers, consumers, items, batch);
+    printf("%-4s %5s %5s %8s  %26s  %26s %8s\n", "", "size", "len", "Mops/s",
+            "enqueue p50/p99/p999", "dequeue p50/p99/p999", "applies");
+    bool ok = true;
+    for (int e = SQ_ENGINE_SEM; e <= SQ_ENGINE_RING; e++) {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+            for (size_t j = 0; j < sizeof(lengths) / sizeof(*lengths); j++) {
+                if (!bench((enum sq_engine) e, sizes[i], lengths[j])) {
+                    ok = false;
+                }
+            }
+        }
+    }
+    printf("(latencies in ns)\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,178 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "alog.h"
+
+#define LOG_PATH "/tmp/test_alog.log"
+
+/* Nombre de threads et de messages par thread du test concurrent */
+#define THREADS 8
+#define MESSAGES 20000
+
+/**
+ * Lit le fichier du journal et renvoie son contenu, terminé par '\0'.
+ */
+static char *tslurp(size_t *len) {
+    FILE *f = fopen(LOG_PATH, "r");
+    assert(f != NULL);
+    size_t size = 1 << 16;
+    char *buf = malloc(size);
+    size_t n = 0;
+    size_t r;
+    while ((r = fread(buf + n, 1, size - n - 1, f)) > 0) {
+        n += r;
+        if (n == size - 1) {
+            size *= 2;
+            buf = realloc(buf, size);
+            assert(buf != NULL);
+        }
+    }
+    fclose(f);
+    buf[n] = '\0';
+    *len = n;
+    return buf;
+}
+
+/**
+ * Créé un journal vers LOG_PATH, après avoir supprimé le fichier précédent.
+ */
+static ALog tcreate(int level, size_t capacity) {
+    unlink(LOG_PATH);
+    ALog l = al_create("test", LOG_DAEMON, level, LOG_PATH, capacity);
+    assert(l != NULL);
+    return l;
+}
+
+void test_al_log(void) {
+    printf("Testing al_log...\n");
+    assert(al_create("test", LOG_DAEMON, LOG_DEBUG + 1, LOG_PATH, 16)
+            == NULL);
+    assert(al_create("test", LOG_DAEMON, LOG_INFO, LOG_PATH, 0) == NULL);
+
+    ALog l = tcreate(LOG_INFO, 16);
+    al_log(l, LOG_INFO, "hello %d", 42);
+    al_log(l, LOG_DEBUG, "filtered %d", 1);
+    al_log(l, LOG_ERR, "error %s", "foo");
+    assert(al_dropped(l) == 0);
+    al_dispose(&l);
+    assert(l == NULL);
+
+    /* Les messages filtrés ne sont pas écrits, les autres le sont dans
+     * l'ordre, avec leur niveau */
+    size_t len;
+    char *buf = tslurp(&len);
+    char expected[64];
+    snprintf(expected, sizeof(expected), " test[%d] info: hello 42\n",
+            (int) getpid());
+    char *line = strstr(buf, expected);
+    assert(line != NULL);
+    snprintf(expected, sizeof(expected), " test[%d] err: error foo\n",
+            (int) getpid());
+    assert(strstr(line, expected) != NULL);
+    assert(strstr(buf, "filtered") == NULL);
+    size_t lines = 0;
+    for (size_t i = 0; i < len; i++) {
+        lines += buf[i] == '\n';
+    }
+    assert(lines == 2);
+    free(buf);
+}
+
+void test_al_truncate(void) {
+    printf("Testing al_log (AL_MSG_MAX)...\n");
+    ALog l = tcreate(LOG_INFO, 16);
+    char msg[2 * AL_MSG_MAX];
+    memset(msg, 'x', sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = '\0';
+    al_log(l, LOG_INFO, "%s", msg);
+    al_dispose(&l);
+
+    /* Le message est tronqué, la ligne reste complète */
+    size_t len;
+    char *buf = tslurp(&len);
+    char *x = strchr(buf, 'x');
+    assert(x != NULL);
+    assert(strspn(x, "x") == AL_MSG_MAX - 1);
+    assert(strcmp(x + AL_MSG_MAX - 1, "\n") == 0);
+    free(buf);
+}
+
+static void *tlog(void *arg) {
+    ALog l = arg;
+    for (int i = 0; i < MESSAGES; i++) {
+        al_log(l, LOG_INFO, "msg %lu %d", (unsigned long) pthread_self(), i);
+    }
+    return NULL;
+}
+
+void test_al_concurrent(void) {
+    printf("Testing al_log (concurrent)...\n");
+    ALog l = tcreate(LOG_INFO, 256);
+
+    pthread_t th[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&th[i], NULL, tlog, l) == 0);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    uint64_t dropped = al_dropped(l);
+    al_dispose(&l);
+
+    /* Chaque message est écrit ou compté comme perdu, et les messages d'un
+     * même thread restent dans l'ordre */
+    size_t len;
+    char *buf = tslurp(&len);
+    size_t written = 0;
+    uint64_t reported = 0;
+    int last[THREADS];
+    unsigned long ids[THREADS];
+    size_t nids = 0;
+    for (char *line = strtok(buf, "\n"); line != NULL;
+            line = strtok(NULL, "\n")) {
+        unsigned long id;
+        int i;
+        uint64_t n;
+        char *m = strstr(line, "info: msg ");
+        if (m != NULL && sscanf(m, "info: msg %lu %d", &id, &i) == 2) {
+            size_t k = 0;
+            while (k < nids && ids[k] != id) {
+                k++;
+            }
+            if (k == nids) {
+                assert(nids < THREADS);
+                ids[nids++] = id;
+                last[k] = -1;
+            }
+            assert(i > last[k]);
+            last[k] = i;
+            written++;
+        } else {
+            m = strstr(line, "warning: ");
+            assert(m != NULL);
+            assert(sscanf(m, "warning: %" SCNu64 " log messages dropped",
+                        &n) == 1);
+            reported += n;
+        }
+    }
+    assert(written + dropped == THREADS * MESSAGES);
+    assert(reported == dropped);
+    free(buf);
+}
+
+int main(void) {
+    test_al_log();
+    test_al_truncate();
+    test_al_concurrent();
+    unlink(LOG_PATH);
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flight.h"
+
+/* Propriétaires des requêtes en cours des tests */
+static const int owner1;
+static const int owner2;
+
+/**
+ * Créé un tube dont les deux extrémités sont fermées à l'exécution.
+ */
+static void tpipe(int p[2]) {
+    assert(pipe2(p, O_CLOEXEC) == 0);
+}
+
+/**
+ * Vérifie que l'entrée in contient exactement la chaîne expected jusqu'à la
+ * fin de fichier, puis la ferme.
+ */
+static void tread(int in, const char *expected) {
+    char buf[256];
+    size_t len = 0;
+    ssize_t r;
+    while ((r = read(in, buf + len, sizeof(buf) - len)) > 0) {
+        len += (size_t) r;
+    }
+    assert(r == 0);
+    assert(len == strlen(expected) && memcmp(buf, expected, len) == 0);
+    close(in);
+}
+
+/**
+ * Détache tous les abonnés de f et renvoie leur nombre.
+ */
+static size_t tdetach(Flight f) {
+    size_t n = 0;
+    void *data;
+    while (fl_detach(f, &data) == 0) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Données du thread d'écriture : il écrit first dans out, rattache un abonné
+ * de sortie late à la clé "k", puis écrit second et ferme out.
+ */
+struct twriter {
+    FlTable t;
+    int out;
+    const char *first;
+    int late;
+    const char *second;
+    size_t repeat;      /* Nombre d'écritures de second */
+};
+
+static void *twrite(void *arg) {
+    struct twriter *w = arg;
+    assert(write(w->out, w->first, strlen(w->first))
+            == (ssize_t) strlen(w->first));
+    nanosleep(&(struct timespec) { .tv_nsec = 20000000 }, NULL);
+    if (w->late != -1) {
+        assert(fl_join(w->t, "k", 1, &owner2, w->late, NULL) == 0);
+    }
+    nanosleep(&(struct timespec) { .tv_nsec = 20000000 }, NULL);
+    for (size_t i = 0; i < w->repeat; i++) {
+        size_t len = strlen(w->second);
+        assert(write(w->out, w->second, len) == (ssize_t) len);
+    }
+    close(w->out);
+    return NULL;
+}
+
+void test_fl_join(void) {
+    printf("Testing fl_join...\n");
+    FlTable t = fl_create();
+    assert(t != NULL);
+
+    int p[2];
+    tpipe(p);
+    assert(fl_join(t, "a\0b", 3, &owner1, p[1], NULL) == 1);
+    assert(fl_join(t, "a\0b", 3, &owner2, dup(p[1]), NULL) == 0);
+
+    /* La clé est comparée en entier, au-delà des '\0' qu'elle contient */
+    assert(fl_join(t, "a\0c", 3, &owner2, dup(p[1]), NULL) == 1);
+    assert(fl_join(t, "a", 1, &owner2, dup(p[1]), NULL) == 1);
+
+    /* Seul le propriétaire trouve sa requête en cours */
+    Flight f = fl_find(t, "a\0b", 3, &owner1);
+    assert(f != NULL && fl_owner(f) == &owner1);
+    assert(fl_find(t, "a\0b", 3, &owner2) == NULL);
+    assert(fl_find(t, "a\0d", 3, &owner1) == NULL);
+
+    /* Une requête terminée quitte la table */
+    fl_finish(t, f);
+    assert(fl_find(t, "a\0b", 3, &owner1) == NULL);
+    assert(tdetach(f) == 2);
+    fl_close(&f);
+    assert(f == NULL);
+    assert(fl_join(t, "a\0b", 3, &owner2, dup(p[1]), NULL) == 1);
+
+    size_t n = 0;
+    while ((f = fl_drain(t)) != NULL) {
+        tdetach(f);
+        fl_close(&f);
+        n++;
+    }
+    assert(n == 3);
+    fl_dispose(&t);
+    assert(t == NULL);
+    close(p[0]);
+}
+
+void test_fl_run(void) {
+    printf("Testing fl_run...\n");
+    FlTable t = fl_create();
+    assert(t != NULL);
+
+    int in[2], a[2], b[2], gone[2];
+    tpipe(in);
+    tpipe(a);
+    tpipe(b);
+    tpipe(gone);
+    int data = 42;
+    assert(fl_join(t, "k", 1, &owner1, a[1], &data) == 1);
+    Flight f = fl_find(t, "k", 1, &owner1);
+    assert(f != NULL);
+
+    /* Un abonné dont le client est terminé est ignoré */
+    close(gone[0]);
+    assert(fl_join(t, "k", 1, &owner2, gone[1], NULL) == 0);
+
+    /* L'abonné rattaché en cours de lecture reçoit la sortie déjà produite */
+    struct twriter w = { t, in[1], "hello ", b[1], "world", 1 };
+    pthread_t th;
+    assert(pthread_create(&th, NULL, twrite, &w) == 0);
+    assert(fl_run(t, f, in[0]) == 0);
+    pthread_join(th, NULL);
+    close(in[0]);
+
+    fl_finish(t, f);
+    size_t len;
+    const char *out = fl_output(f, &len);
+    assert(out != NULL && len == 11 && memcmp(out, "hello world", 11) == 0);
+
+    /* Les abonnés sont détachés du plus récent au plus ancien */
+    void *d;
+    assert(fl_detach(f, &d) == 0 && d == NULL);
+    assert(fl_detach(f, &d) == 0 && d == NULL);
+    assert(fl_detach(f, &d) == 0 && d == &data);
+    assert(fl_detach(f, &d) == -1);
+    fl_close(&f);
+    tread(a[0], "hello world");
+    tread(b[0], "hello world");
+    fl_dispose(&t);
+}
+
+void test_fl_seal(void) {
+    printf("Testing fl_run (FL_REPLAY_MAX)...\n");
+    FlTable t = fl_create();
+    assert(t != NULL);
+
+    int in[2];
+    tpipe(in);
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    assert(null != -1);
+    assert(fl_join(t, "k", 1, &owner1, null, NULL) == 1);
+    Flight f = fl_find(t, "k", 1, &owner1);
+
+    /* Au-delà de FL_REPLAY_MAX, la sortie n'est plus conservée et une
+     * nouvelle requête de même clé crée une autre requête en cours */
+    static char chunk[64 * 1024];
+    memset(chunk, 'x', sizeof(chunk) - 1);
+    struct twriter w = { t, in[1], "x", -1, chunk,
+        FL_REPLAY_MAX / (sizeof(chunk) - 1) + 1 };
+    pthread_t th;
+    assert(pthread_create(&th, NULL, twrite, &w) == 0);
+    assert(fl_run(t, f, in[0]) == 0);
+    pthread_join(th, NULL);
+    close(in[0]);
+
+    assert(fl_find(t, "k", 1, &owner1) == NULL);
+    int p[2];
+    tpipe(p);
+    assert(fl_join(t, "k", 1, &owner2, p[1], NULL) == 1);
+    close(p[0]);
+
+    fl_finish(t, f);
+    size_t len;
+    assert(fl_output(f, &len) == NULL);
+    assert(tdetach(f) == 1);
+    fl_close(&f);
+
+    f = fl_drain(t);
+    assert(f != NULL && fl_owner(f) == &owner2);
+    tdetach(f);
+    fl_close(&f);
+    assert(fl_drain(t) == NULL);
+    fl_dispose(&t);
+}
+
+int main(void) {
+    /* Un abonné terminé provoque EPIPE plutôt que SIGPIPE */
+    signal(SIGPIPE, SIG_IGN);
+
+    test_fl_join();
+    test_fl_run();
+    test_fl_seal();
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,355 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobsched.h"
+
+#define JS_LENGTH 64
+
+/* Une requête par travail de test : seule sa classe de priorité importe */
+static struct request *rqs[JS_LENGTH];
+
+/**
+ * Ajoute à la file s le travail n du client (uid, name), de classe prio, reçu
+ * à l'instant t (en secondes).
+ */
+static void tpush(JobSched s, size_t n, uint32_t uid, const char *name,
+        uint32_t prio, time_t t) {
+    rqs[n]->prio = prio;
+    rqs[n]->uid = uid;
+    strcpy(rqs[n]->tenant, name);
+    struct job job = { .rq = rqs[n], .conn = -1, .queued = { t, 0 } };
+    assert(js_push(s, &job) == 0);
+}
+
+/**
+ * Ajoute à la file s le travail n de classe prio, reçu à l'instant t (en
+ * secondes).
+ */
+static void push(JobSched s, size_t n, uint32_t prio, time_t t) {
+    tpush(s, n, 0, "", prio, t);
+}
+
+/**
+ * Retire de la file s le prochain travail à l'instant t (en secondes), le
+ * copie dans job et renvoie son numéro.
+ */
+static size_t jpop(JobSched s, time_t t, struct job *job) {
+    struct timespec now = { t, 0 };
+    assert(js_pop(s, &now, job) == 0);
+    size_t n = 0;
+    while (rqs[n] != job->rq) {
+        n++;
+    }
+    js_done(s, job);
+    return n;
+}
+
+/**
+ * Retire de la file s le prochain travail à l'instant t (en secondes) et
+ * renvoie son numéro. Le travail est aussitôt terminé.
+ */
+static size_t pop(JobSched s, time_t t) {
+    struct timespec now = { t, 0 };
+    struct job job;
+    assert(js_pop(s, &now, &job) == 0);
+    js_done(s, &job);
+    size_t n = 0;
+    while (rqs[n] != job.rq) {
+        n++;
+    }
+    return n;
+}
+
+void test_js_strict(void) {
+    printf("Testing js_pop (strict)...\n");
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_STRICT, JS_FIFO, 0, 0);
+    assert(s != NULL);
+    push(s, 0, RQ_PRIO_LOW, 0);
+    push(s, 1, RQ_PRIO_NORMAL, 0);
+    push(s, 2, RQ_PRIO_HIGH, 0);
+    push(s, 3, RQ_PRIO_LOW, 0);
+    push(s, 4, RQ_PRIO_HIGH, 0);
+
+    /* Les classes sont servies par priorité, chacune dans l'ordre
+     * d'arrivée */
+    size_t expected[] = { 2, 4, 1, 0, 3 };
+    for (size_t i = 0; i < 5; i++) {
+        assert(pop(s, 1) == expected[i]);
+    }
+    struct job job;
+    assert(js_pop(s, NULL, &job) == -1);
+    js_dispose(&s);
+    assert(s == NULL);
+}
+
+void test_js_weighted(void) {
+    printf("Testing js_pop (weighted)...\n");
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_WEIGHTED, JS_FIFO, 0, 0);
+    for (size_t i = 0; i < 14; i++) {
+        push(s, i, (uint32_t) (i % RQ_PRIO_COUNT), 0);
+    }
+    assert(js_length(s) == 14);
+
+    /* Un tour sert 4 travaux high, 2 normal puis 1 low */
+    int counts[RQ_PRIO_COUNT] = { 0 };
+    for (size_t i = 0; i < 7; i++) {
+        counts[rqs[pop(s, 1)]->prio]++;
+    }
+    assert(counts[RQ_PRIO_HIGH] == JS_WEIGHT_HIGH);
+    assert(counts[RQ_PRIO_NORMAL] == JS_WEIGHT_NORMAL);
+    assert(counts[RQ_PRIO_LOW] == JS_WEIGHT_LOW);
+
+    /* Une classe vide cède son tour aux autres */
+    while (js_length(s) > 0) {
+        pop(s, 1);
+    }
+    push(s, 0, RQ_PRIO_LOW, 0);
+    push(s, 1, RQ_PRIO_LOW, 0);
+    assert(pop(s, 1) == 0);
+    assert(pop(s, 1) == 1);
+    js_dispose(&s);
+}
+
+void test_js_aging(void) {
+    printf("Testing js_pop (aging)...\n");
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_STRICT, JS_FIFO, 5000, 0);
+    push(s, 0, RQ_PRIO_LOW, 0);
+    push(s, 1, RQ_PRIO_HIGH, 3);
+    push(s, 2, RQ_PRIO_HIGH, 4);
+
+    /* Le travail low n'a pas encore assez attendu */
+    assert(pop(s, 4) == 1);
+
+    /* Il passe désormais avant les travaux high plus récents */
+    assert(pop(s, 6) == 0);
+    assert(pop(s, 6) == 2);
+
+    /* Sans instant présent, le vieillissement est ignoré */
+    push(s, 3, RQ_PRIO_LOW, 0);
+    push(s, 4, RQ_PRIO_HIGH, 9);
+    struct job job;
+    assert(js_pop(s, NULL, &job) == 0 && job.rq == rqs[4]);
+    js_dispose(&s);
+}
+
+void test_js_waits(void) {
+    printf("Testing js_waits...\n");
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_WEIGHTED, JS_FIFO, 0, 0);
+    push(s, 0, RQ_PRIO_HIGH, 1);
+    push(s, 1, RQ_PRIO_LOW, 1);
+    pop(s, 2);
+    pop(s, 4);
+
+    const struct histo *h = js_waits(s, RQ_PRIO_HIGH);
+    assert(h->count == 1 && h->max == 1000000000);
+    h = js_waits(s, RQ_PRIO_LOW);
+    assert(h->count == 1 && h->max == 3000000000);
+    assert(js_waits(s, RQ_PRIO_NORMAL)->count == 0);
+    js_dispose(&s);
+}
+
+void test_js_expire(void) {
+    printf("Testing js_expire...\n");
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_WEIGHTED, JS_FIFO, 0, 0);
+    struct timespec ts;
+    assert(js_deadline(s, &ts) == -1);
+
+    rqs[0]->prio = RQ_PRIO_HIGH;
+    rqs[1]->prio = RQ_PRIO_LOW;
+    rqs[0]->tenant[0] = rqs[1]->tenant[0] = '\0';
+    struct job a = { .rq = rqs[0], .deadline = { 8, 0 } };
+    struct job b = { .rq = rqs[1], .deadline = { 5, 0 } };
+    assert(js_push(s, &a) == 0 && js_push(s, &b) == 0);
+
+    /* L'échéance la plus proche est cherchée dans toutes les classes */
+    assert(js_deadline(s, &ts) == 0 && ts.tv_sec == 5);
+
+    struct timespec now = { 6, 0 };
+    struct job job;
+    assert(js_expire(s, &now, &job) == 0 && job.rq == rqs[1]);
+    assert(js_expire(s, &now, &job) == -1);
+    assert(js_length(s) == 1);
+    js_dispose(&s);
+}
+
+void test_js_full(void) {
+    printf("Testing js_push (full)...\n");
+    JobSched s = js_create(4, JS_LENGTH, JS_WEIGHTED, JS_FIFO, 0, 0);
+
+    /* La longueur maximale vaut pour toutes les classes confondues, et une
+     * classe invalide est ramenée à normal */
+    push(s, 0, RQ_PRIO_HIGH, 0);
+    push(s, 1, RQ_PRIO_LOW, 0);
+    push(s, 2, RQ_PRIO_COUNT + 1, 0);
+    push(s, 3, RQ_PRIO_HIGH, 0);
+    struct job job = { .rq = rqs[4] };
+    assert(js_push(s, &job) == -1);
+    assert(js_waits(s, RQ_PRIO_NORMAL)->count == 0);
+
+    size_t expected[] = { 0, 3, 2, 1 };
+    for (size_t i = 0; i < 4; i++) {
+        assert(pop(s, 0) == expected[i]);
+    }
+    assert(js_waits(s, RQ_PRIO_NORMAL)->count == 1);
+    js_dispose(&s);
+}
+
+void test_js_fair(void) {
+    printf("Testing js_pop (fair share)...\n");
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_STRICT, JS_FIFO, 0, 0);
+
+    /* Le client 1 soumet 8 travaux avant que les clients 2 et 3 n'en
+     * soumettent 2 chacun : ceux-ci sont servis sans attendre les 8 */
+    for (size_t i = 0; i < 8; i++) {
+        tpush(s, i, 1, "", RQ_PRIO_NORMAL, 0);
+    }
+    tpush(s, 8, 2, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 9, 3, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 10, 2, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 11, 3, "", RQ_PRIO_NORMAL, 0);
+    size_t expected[] = { 0, 8, 9, 1, 10, 11, 2, 3 };
+    for (size_t i = 0; i < 8; i++) {
+        assert(pop(s, 1) == expected[i]);
+    }
+    while (js_length(s) > 0) {
+        pop(s, 1);
+    }
+
+    /* Un travail de coût double consomme deux tours de son client */
+    tpush(s, 0, 1, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 1, 2, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 2, 2, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 3, 2, "", RQ_PRIO_NORMAL, 0);
+    struct job job = { .rq = rqs[4], .cost = 2 * JS_QUANTUM };
+    rqs[4]->prio = RQ_PRIO_NORMAL;
+    rqs[4]->uid = 1;
+    rqs[4]->tenant[0] = '\0';
+    assert(js_push(s, &job) == 0);
+    size_t weighted[] = { 0, 1, 2, 4, 3 };
+    for (size_t i = 0; i < 5; i++) {
+        assert(pop(s, 1) == weighted[i]);
+    }
+
+    /* Un nom de client remplace l'uid */
+    tpush(s, 0, 1, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 1, 1, "team", RQ_PRIO_NORMAL, 0);
+    tpush(s, 2, 1, "", RQ_PRIO_NORMAL, 0);
+    tpush(s, 3, 2, "team", RQ_PRIO_NORMAL, 0);
+    size_t named[] = { 0, 1, 2, 3 };
+    for (size_t i = 0; i < 4; i++) {
+        assert(pop(s, 1) == named[i]);
+    }
+    js_dispose(&s);
+}
+
+void test_js_cap(void) {
+    printf("Testing js_done (tenant cap)...\n");
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_WEIGHTED, JS_FIFO, 0, 2);
+    for (size_t i = 0; i < 4; i++) {
+        tpush(s, i, 1, "", RQ_PRIO_HIGH, 0);
+    }
+    tpush(s, 4, 2, "", RQ_PRIO_LOW, 0);
+
+    /* Le client 1 est borné à deux travaux en cours */
+    struct timespec now = { 1, 0 };
+    struct job running[3];
+    assert(js_pop(s, &now, &running[0]) == 0 && running[0].rq == rqs[0]);
+    assert(js_pop(s, &now, &running[1]) == 0 && running[1].rq == rqs[1]);
+    assert(js_pop(s, &now, &running[2]) == 0 && running[2].rq == rqs[4]);
+    assert(!js_ready(s) && js_length(s) == 2);
+    assert(js_pop(s, &now, &running[2]) == -1);
+
+    js_done(s, &running[0]);
+    assert(js_ready(s));
+    struct job job;
+    assert(jpop(s, 1, &job) == 2);
+
+    /* Le vidage ignore la borne */
+    assert(js_drain(s, &job) == 0 && job.rq == rqs[3]);
+    assert(js_drain(s, &job) == -1);
+    js_done(s, &running[1]);
+    js_dispose(&s);
+}
+
+/**
+ * Ajoute à la file s le travail n de coût cost (en quanta), reçu à l'instant
+ * t (en secondes).
+ */
+static void cpush(JobSched s, size_t n, uint32_t cost, time_t t) {
+    rqs[n]->prio = RQ_PRIO_NORMAL;
+    rqs[n]->uid = 0;
+    rqs[n]->tenant[0] = '\0';
+    struct job job = { .rq = rqs[n], .queued = { t, 0 },
+        .cost = cost * JS_QUANTUM };
+    assert(js_push(s, &job) == 0);
+}
+
+void test_js_order(void) {
+    printf("Testing js_pop (sjf, ljf)...\n");
+    uint32_t costs[] = { 3, 1, 2, 1, 0 };
+    size_t sjf[] = { 1, 3, 4, 2, 0 };
+    size_t ljf[] = { 0, 2, 1, 3, 4 };
+
+    /* Un coût nul vaut JS_COST_DEFAULT, soit un quantum */
+    JobSched s = js_create(JS_LENGTH, JS_LENGTH, JS_STRICT, JS_SJF, 0, 0);
+    for (size_t i = 0; i < 5; i++) {
+        cpush(s, i, costs[i], 0);
+    }
+    for (size_t i = 0; i < 5; i++) {
+        assert(pop(s, 1) == sjf[i]);
+    }
+    js_dispose(&s);
+
+    s = js_create(JS_LENGTH, JS_LENGTH, JS_STRICT, JS_LJF, 0, 0);
+    for (size_t i = 0; i < 5; i++) {
+        cpush(s, i, costs[i], 0);
+    }
+    for (size_t i = 0; i < 5; i++) {
+        assert(pop(s, 1) == ljf[i]);
+    }
+    js_dispose(&s);
+
+    /* Le vieillissement sert le plus ancien travail, même long */
+    s = js_create(JS_LENGTH, JS_LENGTH, JS_STRICT, JS_SJF, 5000, 0);
+    cpush(s, 0, 9, 0);
+    cpush(s, 1, 1, 2);
+    cpush(s, 2, 1, 3);
+    assert(pop(s, 4) == 1);
+    assert(pop(s, 6) == 0);
+    assert(pop(s, 6) == 2);
+
+    /* Le vidage suit l'ordre d'arrivée */
+    cpush(s, 0, 9, 0);
+    cpush(s, 1, 1, 0);
+    struct job job;
+    assert(js_drain(s, &job) == 0 && job.rq == rqs[0]);
+    assert(js_drain(s, &job) == 0 && job.rq == rqs[1]);
+    js_dispose(&s);
+}
+
+int main(void) {
+    for (size_t i = 0; i < JS_LENGTH; i++) {
+        rqs[i] = malloc(sizeof(struct request));
+        assert(rqs[i] != NULL);
+    }
+
+    test_js_strict();
+    test_js_weighted();
+    test_js_aging();
+    test_js_waits();
+    test_js_expire();
+    test_js_full();
+    test_js_fair();
+    test_js_cap();
+    test_js_order();
+
+    for (size_t i = 0; i < JS_LENGTH; i++) {
+        free(rqs[i]);
+    }
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "metrics.h"
+
+#define SHM_NAME "/test_metrics_shm"
+
+/* Nombre de threads et de mises à jour par thread du test concurrent */
+#define THREADS 8
+#define UPDATES 100000
+
+/**
+ * Créé une page vide, après avoir supprimé les restes d'une exécution
+ * interrompue.
+ */
+static Metrics tempty(void) {
+    shm_unlink(SHM_NAME);
+    Metrics m = mt_empty(SHM_NAME);
+    assert(m != NULL);
+    return m;
+}
+
+void test_mt_empty(void) {
+    printf("Testing mt_empty...\n");
+    Metrics m = tempty();
+
+    /* Les noms sont uniques */
+    assert(mt_empty(SHM_NAME) == NULL);
+
+    for (size_t i = 0; i < MT_COUNTERS; i++) {
+        assert(mt_counter(m, (enum mt_counter) i) == 0);
+    }
+    for (size_t i = 0; i < MT_GAUGES; i++) {
+        assert(mt_gauge(m, (enum mt_gauge) i) == 0);
+    }
+    struct histo h;
+    mt_histo(m, MT_RUN, &h);
+    assert(h.count == 0 && h.max == 0 && hi_percentile(&h, 0.5) == 0);
+    assert(mt_uptime(m) >= 0);
+
+    mt_dispose(&m);
+    assert(m == NULL);
+    assert(mt_open(SHM_NAME) == NULL);
+}
+
+void test_mt_update(void) {
+    printf("Testing mt_add/mt_set/mt_record...\n");
+    Metrics m = tempty();
+    Metrics o = mt_open(SHM_NAME);
+    assert(o != NULL);
+
+    /* Un lecteur voit les mises à jour de la page */
+    mt_add(m, MT_SUBMITTED, 3);
+    mt_add(m, MT_COMPLETED, 1);
+    assert(mt_counter(o, MT_SUBMITTED) == 3);
+    assert(mt_counter(o, MT_COMPLETED) == 1);
+    assert(mt_counter(o, MT_REJECTED) == 0);
+
+    mt_set(m, MT_QUEUED, 5);
+    mt_adjust(m, MT_QUEUED, -2);
+    mt_adjust(m, MT_BUSY, 1);
+    assert(mt_gauge(o, MT_QUEUED) == 3);
+    assert(mt_gauge(o, MT_BUSY) == 1);
+
+    /* Les centiles sont ceux de histo.h */
+    struct histo ref;
+    hi_reset(&ref);
+    for (uint64_t v = 1; v <= 1000; v++) {
+        mt_record(m, MT_WAIT, v * 1000);
+        hi_record(&ref, v * 1000);
+    }
+    struct histo h;
+    mt_histo(o, MT_WAIT, &h);
+    assert(h.count == 1000 && h.sum == ref.sum && h.max == 1000000);
+    assert(hi_percentile(&h, 0.5) == hi_percentile(&ref, 0.5));
+    assert(hi_percentile(&h, 0.99) == hi_percentile(&ref, 0.99));
+    mt_histo(o, MT_SPAWN, &h);
+    assert(h.count == 0);
+
+    /* Le lecteur ne supprime pas la page */
+    mt_dispose(&o);
+    o = mt_open(SHM_NAME);
+    assert(o != NULL);
+    mt_dispose(&o);
+    mt_dispose(&m);
+}
+
+static void *tupdate(void *arg) {
+    Metrics m = arg;
+    for (uint64_t i = 0; i < UPDATES; i++) {
+        mt_add(m, MT_STARTED, 1);
+        mt_adjust(m, MT_BUSY, 1);
+        mt_record(m, MT_RUN, i);
+        mt_adjust(m, MT_BUSY, -1);
+    }
+    return NULL;
+}
+
+void test_mt_concurrent(void) {
+    printf("Testing mt_add (concurrent)...\n");
+    Metrics m = tempty();
+
+    pthread_t th[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&th[i], NULL, tupdate, m) == 0);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(th[i], NULL);
+    }
+
+    /* Aucune mise à jour n'est perdue */
+    assert(mt_counter(m, MT_STARTED) == THREADS * UPDATES);
+    assert(mt_gauge(m, MT_BUSY) == 0);
+    struct histo h;
+    mt_histo(m, MT_RUN, &h);
+    assert(h.count == THREADS * UPDATES);
+    assert(h.max == UPDATES - 1);
+    assert(h.sum == THREADS * ((uint64_t) UPDATES * (UPDATES - 1) / 2));
+    mt_dispose(&m);
+}
+
+int main(void) {
+    test_mt_empty();
+    test_mt_update();
+    test_mt_concurrent();
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pcache.h"
+
+/* Délai maximal de prise en compte d'une modification, en millisecondes */
+#define WATCH_TIMEOUT 2000
+
+static char dira[] = "/tmp/test_pcache_a.XXXXXX";
+static char dirb[] = "/tmp/test_pcache_b.XXXXXX";
+
+/**
+ * Renvoie le chemin du fichier name du répertoire dir (tampon statique).
+ */
+static const char *tpath(const char *dir, const char *name) {
+    static char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return path;
+}
+
+/**
+ * Créé le fichier name dans le répertoire dir, avec les droits mode.
+ */
+static void tcreate(const char *dir, const char *name, mode_t mode) {
+    int fd = open(tpath(dir, name), O_WRONLY | O_CREAT | O_TRUNC, mode);
+    assert(fd != -1);
+    close(fd);
+}
+
+/**
+ * Attend que la commande name soit résolue en dir/name, au plus
+ * WATCH_TIMEOUT millisecondes.
+ */
+static void twait(PCache pc, const char *name, const char *dir) {
+    char file[PATH_MAX];
+    struct timespec ms = { 0, 1000000 };
+    for (int i = 0; i < WATCH_TIMEOUT; i++) {
+        if (pc_resolve(pc, name, file, sizeof(file)) != -1
+                && strcmp(file, tpath(dir, name)) == 0) {
+            return;
+        }
+        nanosleep(&ms, NULL);
+    }
+    assert(0);
+}
+
+void test_pc_resolve(void) {
+    printf("Testing pc_resolve...\n");
+    char path[2 * PATH_MAX];
+    snprintf(path, sizeof(path), "%s:%s", dira, dirb);
+    PCache pc = pc_create(path);
+    assert(pc != NULL);
+
+    char file[PATH_MAX];
+    errno = 0;
+    assert(pc_resolve(pc, "foo", file, sizeof(file)) == -1);
+    assert(errno == ENOENT);
+    assert(pc_resolve(pc, "/bin/sh", file, sizeof(file)) == -1);
+    assert(errno == EINVAL);
+    assert(pc_resolve(pc, "", file, sizeof(file)) == -1);
+    assert(errno == EINVAL);
+
+    /* Un fichier non exécutable ou un répertoire sont ignorés */
+    tcreate(dira, "foo", 0644);
+    assert(mkdir(tpath(dira, "bar"), 0755) == 0);
+    tcreate(dirb, "foo", 0755);
+    tcreate(dirb, "bar", 0755);
+    twait(pc, "foo", dirb);
+    assert(pc_resolve(pc, "foo", file, sizeof(file)) == 1);
+    assert(strcmp(file, tpath(dirb, "foo")) == 0);
+    assert(pc_resolve(pc, "bar", file, sizeof(file)) == 0);
+    assert(strcmp(file, tpath(dirb, "bar")) == 0);
+    assert(pc_resolve(pc, "bar", file, sizeof(file)) == 1);
+
+    /* Le chemin ne tient pas dans le tampon */
+    errno = 0;
+    assert(pc_resolve(pc, "foo", file, 4) == -1);
+    assert(errno == ENAMETOOLONG);
+
+    /* Un changement de droits, une suppression ou une création invalident
+     * le cache */
+    assert(chmod(tpath(dira, "foo"), 0755) == 0);
+    twait(pc, "foo", dira);
+    assert(pc_resolve(pc, "foo", file, sizeof(file)) == 1);
+    assert(unlink(tpath(dira, "foo")) == 0);
+    twait(pc, "foo", dirb);
+    assert(rmdir(tpath(dira, "bar")) == 0);
+    tcreate(dira, "bar", 0755);
+    twait(pc, "bar", dira);
+
+    pc_dispose(&pc);
+    assert(pc == NULL);
+
+    unlink(tpath(dira, "bar"));
+    unlink(tpath(dirb, "foo"));
+    unlink(tpath(dirb, "bar"));
+}
+
+void test_pc_path(void) {
+    printf("Testing pc_create (PATH)...\n");
+    char file[PATH_MAX];
+
+    /* La valeur par défaut de PATH est celle de execvp */
+    PCache pc = pc_create(NULL);
+    assert(pc != NULL);
+    assert(pc_resolve(pc, "sh", file, sizeof(file)) == 0);
+    assert(strcmp(file, "/bin/sh") == 0);
+    assert(pc_resolve(pc, "sh", file, sizeof(file)) == 1);
+    pc_dispose(&pc);
+
+    /* Une commande cherchée dans un répertoire relatif n'est pas résolue */
+    pc = pc_create("/nonexistent:bin:/bin");
+    assert(pc != NULL);
+    errno = 0;
+    assert(pc_resolve(pc, "sh", file, sizeof(file)) == -1);
+    assert(errno == EINVAL);
+    pc_dispose(&pc);
+
+    pc = pc_create(":/bin");
+    assert(pc != NULL);
+    assert(pc_resolve(pc, "sh", file, sizeof(file)) == -1);
+    pc_dispose(&pc);
+}
+
+int main(void) {
+    assert(mkdtemp(dira) != NULL);
+    assert(mkdtemp(dirb) != NULL);
+
+    test_pc_resolve();
+    test_pc_path();
+
+    rmdir(dira);
+    rmdir(dirb);
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
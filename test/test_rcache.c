@@ -0,0 +1,181 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rcache.h"
+
+#define SHM_NAME "/test_rcache_shm"
+#define ARENA_NAME "/test_rcache_arena"
+
+/* Capacité de la zone d'allocation des tests */
+#define ARENA_SIZE (64 * 1024)
+
+/**
+ * Créé un cache vide, après avoir supprimé les restes d'une exécution
+ * interrompue.
+ */
+static RCache tempty(void) {
+    shm_unlink(SHM_NAME);
+    shm_unlink(ARENA_NAME);
+    RCache c = rc_empty(SHM_NAME, ARENA_NAME, ARENA_SIZE);
+    assert(c != NULL);
+    return c;
+}
+
+/**
+ * Vérifie que la clé key (chaîne C, '\0' compris) est associée au statut
+ * status et à la sortie out.
+ */
+static void tcheck(RCache c, const char *key, int status, const char *out) {
+    int st;
+    char *data;
+    size_t len;
+    assert(rc_lookup(c, key, strlen(key) + 1, &st, &data, &len) == 0);
+    assert(st == status);
+    assert(len == strlen(out) && memcmp(data, out, len) == 0);
+    free(data);
+}
+
+/**
+ * Indique si la clé key (chaîne C, '\0' compris) est présente dans le cache.
+ */
+static int tfound(RCache c, const char *key) {
+    int st;
+    char *data;
+    size_t len;
+    if (rc_lookup(c, key, strlen(key) + 1, &st, &data, &len) == -1) {
+        return 0;
+    }
+    free(data);
+    return 1;
+}
+
+void test_rc_empty(void) {
+    printf("Testing rc_empty...\n");
+    RCache c = tempty();
+
+    /* Les noms sont uniques */
+    assert(rc_empty(SHM_NAME, ARENA_NAME, ARENA_SIZE) == NULL);
+
+    assert(!tfound(c, "uname -a"));
+    rc_dispose(&c);
+    assert(c == NULL);
+    assert(rc_open(SHM_NAME, ARENA_NAME) == NULL);
+}
+
+void test_rc_insert(void) {
+    printf("Testing rc_insert...\n");
+    RCache c = tempty();
+
+    assert(rc_insert(c, "uname", 6, 0, "Linux\n", 6, 60000) == 0);
+    tcheck(c, "uname", 0, "Linux\n");
+
+    /* Une sortie vide et un statut non nul sont enregistrés */
+    assert(rc_insert(c, "false", 6, 256, "", 0, 60000) == 0);
+    tcheck(c, "false", 256, "");
+
+    /* Une nouvelle insertion remplace l'entrée de même clé */
+    assert(rc_insert(c, "uname", 6, 0, "Darwin\n", 7, 60000) == 0);
+    tcheck(c, "uname", 0, "Darwin\n");
+
+    /* La clé est comparée en entier, au-delà des '\0' qu'elle contient */
+    assert(rc_insert(c, "a\0b", 4, 0, "1", 1, 60000) == 0);
+    assert(rc_insert(c, "a\0c", 4, 0, "2", 1, 60000) == 0);
+    int st;
+    char *data;
+    size_t len;
+    assert(rc_lookup(c, "a\0b", 4, &st, &data, &len) == 0);
+    assert(len == 1 && *data == '1');
+    free(data);
+    assert(rc_lookup(c, "a", 2, &st, &data, &len) == -1);
+
+    /* Une sortie trop grande n'est pas enregistrée */
+    char *big = calloc(1, ARENA_SIZE);
+    assert(big != NULL);
+    assert(rc_insert(c, "big", 4, 0, big, ARENA_SIZE, 60000) == -1);
+    assert(rc_insert(c, "big", 4, 0, big, RC_OUTPUT_MAX + 1, 60000) == -1);
+    assert(!tfound(c, "big"));
+    free(big);
+    rc_dispose(&c);
+}
+
+void test_rc_open(void) {
+    printf("Testing rc_open...\n");
+    RCache c = tempty();
+    assert(rc_insert(c, "hostname", 9, 0, "box\n", 4, 60000) == 0);
+
+    /* Un autre objet ouvert sur le même cache voit les insertions */
+    RCache o = rc_open(SHM_NAME, ARENA_NAME);
+    assert(o != NULL);
+    tcheck(o, "hostname", 0, "box\n");
+    assert(rc_insert(c, "id", 3, 0, "uid=0\n", 6, 60000) == 0);
+    tcheck(o, "id", 0, "uid=0\n");
+    rc_dispose(&c);
+}
+
+void test_rc_expire(void) {
+    printf("Testing rc_lookup (expiration)...\n");
+    RCache c = tempty();
+    assert(rc_insert(c, "date", 5, 0, "now\n", 4, 20) == 0);
+    tcheck(c, "date", 0, "now\n");
+    nanosleep(&(struct timespec) { .tv_nsec = 50000000 }, NULL);
+    assert(!tfound(c, "date"));
+    rc_dispose(&c);
+}
+
+void test_rc_evict(void) {
+    printf("Testing rc_insert (eviction)...\n");
+    RCache c = tempty();
+
+    /* Chaque entrée occupe un quart de la zone : seules trois tiennent */
+    static char out[ARENA_SIZE / 4];
+    memset(out, 'x', sizeof(out));
+    assert(rc_insert(c, "one", 4, 0, out, sizeof(out), 60000) == 0);
+    nanosleep(&(struct timespec) { .tv_nsec = 2000000 }, NULL);
+    assert(rc_insert(c, "two", 4, 0, out, sizeof(out), 60000) == 0);
+    nanosleep(&(struct timespec) { .tv_nsec = 2000000 }, NULL);
+    assert(rc_insert(c, "three", 6, 0, out, sizeof(out), 60000) == 0);
+    nanosleep(&(struct timespec) { .tv_nsec = 2000000 }, NULL);
+
+    /* La consultation de "one" fait de "two" la moins récemment utilisée */
+    assert(tfound(c, "one"));
+    nanosleep(&(struct timespec) { .tv_nsec = 2000000 }, NULL);
+    assert(rc_insert(c, "four", 5, 0, out, sizeof(out), 60000) == 0);
+    assert(tfound(c, "one"));
+    assert(!tfound(c, "two"));
+    assert(tfound(c, "three"));
+    assert(tfound(c, "four"));
+
+    /* Une entrée expirée est évincée avant les autres */
+    assert(rc_insert(c, "brief", 6, 0, "", 0, 1) == 0);
+    nanosleep(&(struct timespec) { .tv_nsec = 5000000 }, NULL);
+    assert(rc_insert(c, "two", 4, 0, out, sizeof(out), 60000) == 0);
+    assert(!tfound(c, "brief"));
+
+    /* Bien plus d'entrées que l'index n'en contient */
+    char key[32];
+    for (int i = 0; i < 4 * RC_ENTRIES; i++) {
+        snprintf(key, sizeof(key), "echo %d", i);
+        assert(rc_insert(c, key, strlen(key) + 1, 0, key, strlen(key), 60000)
+                == 0);
+    }
+    snprintf(key, sizeof(key), "echo %d", 4 * RC_ENTRIES - 1);
+    tcheck(c, key, 0, key);
+    rc_dispose(&c);
+}
+
+int main(void) {
+    test_rc_empty();
+    test_rc_insert();
+    test_rc_open();
+    test_rc_expire();
+    test_rc_evict();
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
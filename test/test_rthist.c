@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rthist.h"
+
+#define RH_FILE "/tmp/test_rthist.history"
+#define RH_LINK "/tmp/test_rthist.link"
+
+#define NS_PER_MS 1000000ULL
+
+void test_rh_open(void) {
+    printf("Testing rh_open...\n");
+    unlink(RH_FILE);
+    RtHist h = rh_open(RH_FILE);
+    assert(h != NULL);
+    double mean;
+    double stddev;
+    assert(rh_estimate(h, "sleep 1", &mean, &stddev) == -1);
+    rh_dispose(&h);
+    assert(h == NULL);
+
+    /* Un fichier invalide est réinitialisé */
+    FILE *f = fopen(RH_FILE, "w");
+    assert(f != NULL);
+    fputs("garbage", f);
+    fclose(f);
+    h = rh_open(RH_FILE);
+    assert(h != NULL);
+    assert(rh_estimate(h, "sleep 1", &mean, &stddev) == -1);
+    rh_dispose(&h);
+
+    /* Un lien symbolique ou un fichier aux liens multiples est refusé, sans
+     * que sa cible soit modifiée */
+    f = fopen(RH_FILE, "w");
+    assert(f != NULL);
+    fputs("garbage", f);
+    fclose(f);
+    unlink(RH_LINK);
+    assert(symlink(RH_FILE, RH_LINK) == 0);
+    assert(rh_open(RH_LINK) == NULL && errno == ELOOP);
+    unlink(RH_LINK);
+    assert(link(RH_FILE, RH_LINK) == 0);
+    assert(rh_open(RH_LINK) == NULL && errno == EPERM);
+    unlink(RH_LINK);
+    struct stat st;
+    assert(stat(RH_FILE, &st) == 0 && st.st_size == 7);
+}
+
+void test_rh_record(void) {
+    printf("Testing rh_record...\n");
+    unlink(RH_FILE);
+    RtHist h = rh_open(RH_FILE);
+    double mean;
+    double stddev;
+
+    rh_record(h, "make all", 100 * NS_PER_MS);
+    assert(rh_estimate(h, "make all", &mean, &stddev) == 0);
+    assert(mean == 100 && stddev == 0);
+
+    /* La moyenne se rapproche des nouvelles durées, et la dispersion
+     * apparaît */
+    rh_record(h, "make all", 200 * NS_PER_MS);
+    assert(rh_estimate(h, "make all", &mean, &stddev) == 0);
+    assert(fabs(mean - (100 + RH_ALPHA * 100)) < 1e-9 && stddev > 0);
+    for (int i = 0; i < 200; i++) {
+        rh_record(h, "make all", 200 * NS_PER_MS);
+    }
+    assert(rh_estimate(h, "make all", &mean, &stddev) == 0);
+    assert(fabs(mean - 200) < 1e-3 && stddev < 1e-3);
+
+    /* Les autres commandes ne sont pas affectées */
+    assert(rh_estimate(h, "make", &mean, &stddev) == -1);
+    assert(rh_estimate(h, "make clean", &mean, &stddev) == -1);
+    rh_dispose(&h);
+}
+
+void test_rh_normalise(void) {
+    printf("Testing rh_estimate (normalisation)...\n");
+    unlink(RH_FILE);
+    RtHist h = rh_open(RH_FILE);
+    double mean;
+    double stddev;
+
+    rh_record(h, "/usr/bin/sleep  1", 5 * NS_PER_MS);
+    assert(rh_estimate(h, "sleep 1", &mean, &stddev) == 0 && mean == 5);
+    assert(rh_estimate(h, "  ./sleep\t1  ", &mean, &stddev) == 0);
+    assert(rh_estimate(h, "sleep 2", &mean, &stddev) == -1);
+    assert(rh_estimate(h, "sleep 1/2", &mean, &stddev) == -1);
+    rh_dispose(&h);
+}
+
+void test_rh_persist(void) {
+    printf("Testing rh_open (persistence)...\n");
+    unlink(RH_FILE);
+    RtHist h = rh_open(RH_FILE);
+    rh_record(h, "ls -l", 42 * NS_PER_MS);
+    rh_dispose(&h);
+
+    h = rh_open(RH_FILE);
+    double mean;
+    double stddev;
+    assert(rh_estimate(h, "ls -l", &mean, &stddev) == 0 && mean == 42);
+    rh_dispose(&h);
+}
+
+void test_rh_evict(void) {
+    printf("Testing rh_record (eviction)...\n");
+    unlink(RH_FILE);
+    RtHist h = rh_open(RH_FILE);
+
+    /* Bien plus de commandes que d'emplacements : les plus récentes restent
+     * connues */
+    char cmd[32];
+    for (int i = 0; i < 4 * RH_SLOTS; i++) {
+        snprintf(cmd, sizeof(cmd), "job %d", i);
+        rh_record(h, cmd, (unsigned long long) i * NS_PER_MS);
+    }
+    double mean;
+    double stddev;
+    snprintf(cmd, sizeof(cmd), "job %d", 4 * RH_SLOTS - 1);
+    assert(rh_estimate(h, cmd, &mean, &stddev) == 0);
+    assert(mean == 4 * RH_SLOTS - 1);
+    rh_dispose(&h);
+    unlink(RH_FILE);
+}
+
+int main(void) {
+    test_rh_open();
+    test_rh_record();
+    test_rh_normalise();
+    test_rh_persist();
+    test_rh_evict();
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sarena.h"
+
+#define SHM_ARENA "/testshmarena"
+#define SA_SIZE (64 * SA_CHUNK)
+
+void sighandler(int sig) {
+    if (sig == SIGABRT || sig == SIGSEGV || sig == SIGINT) {
+        char dir[64] = "/dev/shm";
+        remove(strcat(dir, SHM_ARENA));
+    }
+}
+
+void test_sa_empty(void) {
+    printf("Testing sa_empty...\n");
+    SArena a = sa_empty(SHM_ARENA, SA_SIZE);
+    assert(a != NULL);
+    sa_dispose(&a);
+    assert(a == NULL);
+}
+
+void test_sa_alloc(void) {
+    printf("Testing sa_alloc...\n");
+    SArena a = sa_empty(SHM_ARENA, SA_SIZE);
+    ssize_t o1 = sa_alloc(a, 10);
+    ssize_t o2 = sa_alloc(a, 3 * SA_CHUNK);
+    assert(o1 != -1 && o2 != -1 && o1 != o2);
+    assert(sa_length(a, (size_t) o1) == 10);
+    assert(sa_length(a, (size_t) o2) == 3 * SA_CHUNK);
+
+    /* Les allocations ne se recouvrent pas */
+    memset(sa_ptr(a, (size_t) o1), 'a', 10);
+    memset(sa_ptr(a, (size_t) o2), 'b', 3 * SA_CHUNK);
+    assert(((char *) sa_ptr(a, (size_t) o1))[9] == 'a');
+    assert(sa_length(a, (size_t) o2) == 3 * SA_CHUNK);
+
+    /* Une allocation plus grande que la zone échoue */
+    assert(sa_alloc(a, SA_SIZE) == -1);
+    sa_dispose(&a);
+}
+
+void test_sa_free(void) {
+    printf("Testing sa_free...\n");
+    SArena a = sa_empty(SHM_ARENA, SA_SIZE);
+
+    /* Remplit la zone, puis vérifie qu'elle redevient utilisable */
+    ssize_t offs[64];
+    int n = 0;
+    while ((offs[n] = sa_alloc(a, 1)) != -1) {
+        n++;
+    }
+    assert(n == 64);
+    for (int i = 0; i < n; i++) {
+        assert(sa_free(a, (size_t) offs[i]) == 0);
+    }
+    assert(sa_free(a, (size_t) offs[0]) == -1);
+
+    ssize_t o = sa_alloc(a, SA_SIZE / 2);
+    assert(o != -1);
+    assert(sa_free(a, (size_t) o) == 0);
+    sa_dispose(&a);
+}
+
+void test_sa_shared(void) {
+    printf("Testing shared allocations...\n");
+    SArena a = sa_empty(SHM_ARENA, SA_SIZE);
+
+    fflush(stdout);
+    int fds[2];
+    assert(pipe(fds) == 0);
+    switch (fork()) {
+    case -1:
+        perror("fork");
+        exit(EXIT_FAILURE);
+
+    case 0: {
+        SArena b = sa_open(SHM_ARENA);
+        ssize_t o = sa_alloc(b, 6);
+        memcpy(sa_ptr(b, (size_t) o), "hello", 6);
+        if (write(fds[1], &o, sizeof(o)) != sizeof(o)) {
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    default: {
+        ssize_t o;
+        assert(read(fds[0], &o, sizeof(o)) == sizeof(o));
+        assert(strcmp(sa_ptr(a, (size_t) o), "hello") == 0);
+        assert(sa_free(a, (size_t) o) == 0);
+    }
+    }
+
+    wait(NULL);
+    close(fds[0]);
+    close(fds[1]);
+    sa_dispose(&a);
+}
+
+void test_sa_reclaim(void) {
+    printf("Testing sa_own/sa_reclaim...\n");
+    SArena a = sa_empty(SHM_ARENA, SA_SIZE);
+    ssize_t mine = sa_alloc(a, 10);
+    assert(mine != -1);
+
+    /* Le fils laisse deux allocations, dont une confiée à personne */
+    fflush(stdout);
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pid_t pid = fork();
+    switch (pid) {
+    case -1:
+        perror("fork");
+        exit(EXIT_FAILURE);
+
+    case 0: {
+        SArena b = sa_open(SHM_ARENA);
+        ssize_t o[2] = { sa_alloc(b, 10), sa_alloc(b, 2 * SA_CHUNK) };
+        if (o[0] == -1 || o[1] == -1
+                || sa_own(b, (size_t) o[0], sa_gen(b, (size_t) o[0]), 0)
+                == -1 || write(fds[1], o, sizeof(o)) != sizeof(o)) {
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    default: {
+        ssize_t o[2];
+        assert(read(fds[0], o, sizeof(o)) == sizeof(o));
+        assert(waitpid(pid, NULL, 0) == pid);
+
+        /* Seule l'allocation du fils terminé est récupérée */
+        assert(sa_reclaim(a) == 1);
+        assert(sa_reclaim(a) == 0);
+        assert(sa_free(a, (size_t) o[1]) == -1);
+        assert(sa_free(a, (size_t) o[0]) == 0);
+
+        /* Une génération périmée ne désigne plus l'allocation */
+        uint32_t gen = sa_gen(a, (size_t) mine);
+        assert(sa_own(a, (size_t) mine, gen + 1, 0) == -1);
+        assert(sa_own(a, (size_t) mine, gen, 0) == 0);
+        assert(sa_free(a, (size_t) mine) == 0);
+        assert(sa_own(a, (size_t) mine, gen, 0) == -1);
+    }
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    sa_dispose(&a);
+}
+
+int main(void) {
+    struct sigaction action;
+    action.sa_handler = sighandler;
+    action.sa_flags = 0;
+    if (sigfillset(&action.sa_mask) == -1) {
+        perror("sigfillset");
+        exit(EXIT_FAILURE);
+    }
+    if (sigaction(SIGABRT, &action, NULL) == -1) {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+    if (sigaction(SIGSEGV, &action, NULL) == -1) {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+    if (sigaction(SIGINT, &action, NULL) == -1) {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+
+    test_sa_empty();
+    test_sa_alloc();
+    test_sa_free();
+    test_sa_reclaim();
+    test_sa_shared();
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -12,6 +13,8 @@
 #define SHM_QUEUE "/testshmqueue"
 #define SQ_LENGTH 16
 
+static const char *engines[] = { "sem", "ring" };
+
 struct dummy {
     int a;
     const char *str;
@@ -33,32 +36,32 @@ void sighandler(int sig) {
     }
 }
 
-void test_sq_empty(void) {
-    printf("Testing sq_empty...\n");
-    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH);
+void test_sq_empty(enum sq_engine engine) {
+    printf("Testing sq_empty (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
     assert(q != NULL);
     sq_dispose(&q);
 }
 
-void test_sq_dispose(void) {
-    printf("Testing sq_dispose...\n");
-    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH);
+void test_sq_dispose(enum sq_engine engine) {
+    printf("Testing sq_dispose (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
     sq_dispose(&q);
     assert(q == NULL);
 }
 
-void test_sq_enqueue(void) {
-    printf("Testing sq_enqueue...\n");
-    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH);
+void test_sq_enqueue(enum sq_engine engine) {
+    printf("Testing sq_enqueue (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
     struct dummy d = { 10, "foo" };
     assert(sq_enqueue(q, &d) == 0);
     assert(sq_length(q) == 1);
     sq_dispose(&q);
 }
 
-void test_sq_dequeue(void) {
-    printf("Testing sq_dequeue...\n");
-    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH);
+void test_sq_dequeue(enum sq_engine engine) {
+    printf("Testing sq_dequeue (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
     struct dummy d = { 10, "foo" };
     sq_enqueue(q, &d);
     struct dummy r;
@@ -68,35 +71,129 @@ void test_sq_dequeue(void) {
     sq_dispose(&q);
 }
 
-int main(void) {
-    struct sigaction action;
-    action.sa_handler = sighandler;
-    action.sa_flags = 0;
-    if (sigfillset(&action.sa_mask) == -1) {
-        perror("sigfillset");
-        exit(EXIT_FAILURE);
+void test_sq_batch(enum sq_engine engine) {
+    printf("Testing sq_enqueue_batch/sq_dequeue_batch (%s)...\n",
+            engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
+    struct dummy d[5];
+    for (int i = 0; i < 5; i++) {
+        d[i] = (struct dummy) { i, "foo" };
     }
-    if (sigaction(SIGABRT, &action, NULL) == -1) {
-        perror("sigaction");
-        exit(EXIT_FAILURE);
+    assert(sq_enqueue_batch(q, d, 5) == 0);
+    assert(sq_length(q) == 5);
+
+    struct dummy r[8];
+    assert(sq_dequeue_batch(q, r, 3) == 3);
+    assert(sq_dequeue_batch(q, r + 3, 8) == 2);
+    for (int i = 0; i < 5; i++) {
+        assert(dummy_cmp(&d[i], &r[i]));
     }
-    if (sigaction(SIGSEGV, &action, NULL) == -1) {
-        perror("sigaction");
-        exit(EXIT_FAILURE);
+    assert(sq_length(q) == 0);
+    sq_dispose(&q);
+}
+
+void test_sq_try_dequeue(enum sq_engine engine) {
+    printf("Testing sq_try_dequeue (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
+    struct dummy d = { 10, "foo" };
+    struct dummy r;
+    assert(sq_try_dequeue(q, &r) == -1 && errno == EAGAIN);
+    sq_enqueue(q, &d);
+    assert(sq_try_dequeue(q, &r) == 0);
+    assert(dummy_cmp(&d, &r));
+    assert(sq_try_dequeue(q, &r) == -1);
+    sq_dispose(&q);
+}
+
+/* Nombre d'appels de dummy_count, et appel auquel il interrompt le parcours */
+static int count_calls;
+static int count_stop;
+
+int dummy_count(const struct dummy *d) {
+    assert(d->a == count_calls);
+    return ++count_calls == count_stop ? 42 : 0;
+}
+
+void test_sq_apply(enum sq_engine engine) {
+    printf("Testing sq_apply (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
+
+    /* Une file vide n'a aucun élément à parcourir */
+    count_calls = 0;
+    count_stop = -1;
+    assert(sq_apply(q, (int (*)(void *)) dummy_count) == 0);
+    assert(count_calls == 0);
+
+    /* Le parcours suit l'ordre de la file, après un retour au début du
+     * tableau circulaire */
+    struct dummy d = { 0, "foo" };
+    struct dummy r;
+    for (int i = 0; i < SQ_LENGTH / 2; i++) {
+        sq_enqueue(q, &d);
+        sq_dequeue(q, &r);
     }
-    if (sigaction(SIGINT, &action, NULL) == -1) {
-        perror("sigaction");
+    for (int i = 0; i < SQ_LENGTH; i++) {
+        d.a = i;
+        sq_enqueue(q, &d);
+    }
+    assert(sq_apply(q, (int (*)(void *)) dummy_count) == 0);
+    assert(count_calls == SQ_LENGTH);
+
+    /* Un parcours interrompu renvoie le retour de fun et laisse la file
+     * utilisable */
+    count_calls = 0;
+    count_stop = 3;
+    assert(sq_apply(q, (int (*)(void *)) dummy_count) == 42);
+    assert(count_calls == 3);
+    assert(sq_length(q) == SQ_LENGTH);
+    assert(sq_dequeue(q, &r) == 0 && r.a == 0);
+    sq_dispose(&q);
+}
+
+void test_sq_blocking_batch(enum sq_engine engine) {
+    printf("Testing blocking batch operations (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
+
+    fflush(stdout);
+    switch (fork()) {
+    case -1:
+        perror("fork");
         exit(EXIT_FAILURE);
+
+    case 0: {
+        struct dummy d[3 * SQ_LENGTH];
+        for (int i = 0; i < 3 * SQ_LENGTH; i++) {
+            d[i] = (struct dummy) { i, "foo" };
+        }
+        exit(sq_enqueue_batch(q, d, 3 * SQ_LENGTH) == 0 ?
+                EXIT_SUCCESS : EXIT_FAILURE);
     }
 
-    test_sq_empty();
-    test_sq_dispose();
-    test_sq_enqueue();
-    test_sq_dequeue();
+    default: {
+        int next = 0;
+        while (next < 3 * SQ_LENGTH) {
+            struct dummy r[SQ_LENGTH / 2];
+            ssize_t n = sq_dequeue_batch(q, r, SQ_LENGTH / 2);
+            assert(n > 0);
+            for (ssize_t i = 0; i < n; i++) {
+                assert(r[i].a == next++);
+            }
+        }
+    }
+    }
 
+    int status;
+    wait(&status);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    assert(sq_length(q) == 0);
+    sq_dispose(&q);
+}
 
-    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH);
+void test_sq_blocking(enum sq_engine engine) {
+    printf("Testing blocking operations (%s)...\n", engines[engine]);
+    SQueue q = sq_empty(SHM_QUEUE, sizeof(struct dummy), SQ_LENGTH, engine);
 
+    fflush(stdout);
     switch (fork()) {
     case -1:
         perror("fork");
@@ -113,6 +210,7 @@ int main(void) {
         for (int i = 0; i < 5; i++) {
             struct dummy d;
             sq_dequeue(q, &d);
+            assert(d.a == i);
         }
     }
 
@@ -121,6 +219,40 @@ int main(void) {
     assert(sq_length(q) == SQ_LENGTH);
 
     sq_dispose(&q);
+}
+
+int main(void) {
+    struct sigaction action;
+    action.sa_handler = sighandler;
+    action.sa_flags = 0;
+    if (sigfillset(&action.sa_mask) == -1) {
+        perror("sigfillset");
+        exit(EXIT_FAILURE);
+    }
+    if (sigaction(SIGABRT, &action, NULL) == -1) {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+    if (sigaction(SIGSEGV, &action, NULL) == -1) {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+    if (sigaction(SIGINT, &action, NULL) == -1) {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int e = SQ_ENGINE_SEM; e <= SQ_ENGINE_RING; e++) {
+        test_sq_empty((enum sq_engine) e);
+        test_sq_dispose((enum sq_engine) e);
+        test_sq_enqueue((enum sq_engine) e);
+        test_sq_dequeue((enum sq_engine) e);
+        test_sq_batch((enum sq_engine) e);
+        test_sq_try_dequeue((enum sq_engine) e);
+        test_sq_apply((enum sq_engine) e);
+        test_sq_blocking((enum sq_engine) e);
+        test_sq_blocking_batch((enum sq_engine) e);
+    }
 
     printf("All tests passed :)\n");
 
@@ -0,0 +1,161 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokenize.h"
+
+/* Séparateur d'étapes attendu parmi les arguments */
+#define PIPE NULL
+
+/**
+ * Découpe str et vérifie que les arguments obtenus sont les n chaînes de
+ * expected (PIPE pour un séparateur d'étapes).
+ */
+static void tsplit(const char *str, const char *expected[], size_t n) {
+    size_t len = strlen(str);
+    char args[len + 1];
+    uint32_t offs[TK_ARGC_MAX(len)];
+    size_t argc;
+    ssize_t argslen = tk_split(str, args, offs, &argc);
+    assert(argslen >= 0);
+    assert((size_t) argslen <= len + 1);
+    assert(argc == n);
+    size_t stages = (n > 0);
+    for (size_t i = 0; i < n; i++) {
+        if (expected[i] == PIPE) {
+            assert(offs[i] == TK_PIPE);
+            stages++;
+        } else {
+            assert(strcmp(args + offs[i], expected[i]) == 0);
+        }
+    }
+    assert(tk_stages(offs, argc) == stages);
+    assert(tk_check(args, (size_t) argslen, offs, argc) == 0);
+}
+
+/**
+ * Vérifie que le découpage de str échoue.
+ */
+static void tinvalid(const char *str) {
+    size_t len = strlen(str);
+    char args[len + 1];
+    uint32_t offs[TK_ARGC_MAX(len)];
+    size_t argc;
+    errno = 0;
+    assert(tk_split(str, args, offs, &argc) == -1);
+    assert(errno == EINVAL);
+}
+
+#define TSPLIT(str, ...) \
+    tsplit(str, (const char *[]) { __VA_ARGS__ }, \
+            sizeof((const char *[]) { __VA_ARGS__ }) / sizeof(char *))
+
+void test_tk_split(void) {
+    printf("Testing tk_split...\n");
+    tsplit("", NULL, 0);
+    tsplit(" \t\n ", NULL, 0);
+    TSPLIT("ls", "ls");
+    TSPLIT("  ls   -l\t-a\n", "ls", "-l", "-a");
+    TSPLIT("a b c d e", "a", "b", "c", "d", "e");
+
+    /* Apostrophes : tout est pris tel quel */
+    TSPLIT("echo 'a  b' 'c\"d' '\\n' '$x'", "echo", "a  b", "c\"d", "\\n",
+            "$x");
+
+    /* Guillemets : seuls certains caractères sont protégés par '\' */
+    TSPLIT("echo \"a  b\" \"c'd\" \"\\\"\\\\\\$\\`\" \"\\n\"", "echo", "a  b",
+            "c'd", "\"\\$`", "\\n");
+    TSPLIT("echo \"a\\\nb\"", "echo", "ab");
+
+    /* Hors citation, '\' protège le caractère suivant */
+    TSPLIT("echo a\\ b \\'c\\' \\\\", "echo", "a b", "'c'", "\\");
+    TSPLIT("echo a \\\n b", "echo", "a", "b");
+    TSPLIT("echo a\\\nb", "echo", "ab");
+
+    /* Les parties d'un même argument se suivent sans séparateur */
+    TSPLIT("echo a'b c'\"d e\"f", "echo", "ab cd ef");
+
+    /* Citations vides */
+    TSPLIT("echo '' \"\" a''", "echo", "", "", "a");
+    TSPLIT("''", "");
+
+    /* Aucune substitution */
+    TSPLIT("bash -c 'for x in $(seq 3); do echo $x; done'", "bash", "-c",
+            "for x in $(seq 3); do echo $x; done");
+    TSPLIT("a;b&c*", "a;b&c*");
+}
+
+void test_tk_split_pipeline(void) {
+    printf("Testing tk_split (pipeline)...\n");
+    TSPLIT("ls | wc -l", "ls", PIPE, "wc", "-l");
+    TSPLIT("a|b|c", "a", PIPE, "b", PIPE, "c");
+    TSPLIT("cat f |\n grep -v x | sort -u", "cat", "f", PIPE, "grep", "-v",
+            "x", PIPE, "sort", "-u");
+
+    /* Un '|' cité ou protégé est un caractère comme les autres */
+    TSPLIT("grep 'a|b' \"c|d\" e\\|f", "grep", "a|b", "c|d", "e|f");
+    TSPLIT("echo ''|cat", "echo", "", PIPE, "cat");
+}
+
+void test_tk_split_invalid(void) {
+    printf("Testing tk_split (invalid)...\n");
+    tinvalid("echo 'a");
+    tinvalid("echo \"a");
+    tinvalid("echo \"a\\\"");
+    tinvalid("echo a\\");
+    tinvalid("'");
+
+    /* Étapes vides */
+    tinvalid("|");
+    tinvalid("| ls");
+    tinvalid("ls |");
+    tinvalid("ls | \t");
+    tinvalid("a || b");
+    tinvalid("a | | b");
+}
+
+void test_tk_check(void) {
+    printf("Testing tk_check...\n");
+    const char args[] = "ls\0-l\0\0";
+    uint32_t offs[] = { 0, 3, 6 };
+    assert(tk_check(args, 7, offs, 3) == 0);
+    assert(tk_check(args, 0, offs, 0) == 0);
+    assert(tk_check(args, 3, offs, 1) == 0);
+
+    /* Tampon non entièrement couvert, ou argument non terminé */
+    assert(tk_check(args, 7, offs, 2) == -1);
+    assert(tk_check(args, 2, offs, 1) == -1);
+    assert(tk_check(args, 0, offs, 1) == -1);
+
+    /* Décalages ne désignant pas le début des arguments */
+    uint32_t bad[] = { 0, 4, 6 };
+    assert(tk_check(args, 7, bad, 3) == -1);
+    uint32_t over[] = { 0, 3, 7 };
+    assert(tk_check(args, 7, over, 3) == -1);
+    uint32_t late[] = { 1 };
+    assert(tk_check(args, 3, late, 1) == -1);
+
+    /* Séparateurs d'étapes */
+    uint32_t pipeline[] = { 0, TK_PIPE, 3, TK_PIPE, 6 };
+    assert(tk_check(args, 7, pipeline, 5) == 0);
+    assert(tk_stages(pipeline, 5) == 3);
+    assert(tk_stages(pipeline, 0) == 0);
+    assert(tk_check(args, 3, pipeline, 2) == -1);
+    uint32_t first[] = { TK_PIPE, 0 };
+    assert(tk_check(args, 3, first, 2) == -1);
+    uint32_t twice[] = { 0, TK_PIPE, TK_PIPE, 3 };
+    assert(tk_check(args, 6, twice, 4) == -1);
+}
+
+int main(void) {
+    test_tk_split();
+    test_tk_split_pipeline();
+    test_tk_split_invalid();
+    test_tk_check();
+
+    printf("All tests passed :)\n");
+
+    return EXIT_SUCCESS;
+}